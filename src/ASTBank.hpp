@@ -1,67 +1,359 @@
 // A data structure that owns ASTs parsed from sources
 // Supports finding trees by file path
+// Each tree is indexed once at parse time (see DirectiveIndex)
+// Files are parsed once per process into a SharedASTStore and shared by every ASTBank;
+// a bank keeps the files it added alive and owns its anonymous sources.
 
 #ifndef HAYROLL_ASTBANK_HPP
 #define HAYROLL_ASTBANK_HPP
 
 #include <unordered_map>
-#include <fstream>
+#include <deque>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <memory>
 #include <filesystem>
 #include <tuple>
+#include <optional>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "subprocess.hpp"
 
 #include "TreeSitter.hpp"
+#include "TreeSitterCPreproc.hpp"
 #include "TempDir.hpp"
+#include "DirectiveIndex.hpp"
 
 namespace Hayroll
 {
 
-class ASTBank
+// Process-wide store of parsed files, keyed by canonical path.
+// Locking is sharded by path, and each file is parsed by exactly one thread while others wait for it.
+// Trees and indices are immutable once built, so they are read from any thread without locking.
+// The store does not own the trees: a file stays parsed while some ASTBank (or other holder) references it,
+// e.g. a header shared by concurrently running translation units, and is dropped after the last one.
+class SharedASTStore
 {
 public:
-    ASTBank(const ts::TSLanguage * language)
-        : parser(language)
+    struct ParsedFile
+    {
+        TSTree tree;
+        DirectiveIndex index;
+    };
+    using ParsedFilePtr = std::shared_ptr<const ParsedFile>;
+
+    static SharedASTStore & instance()
     {
+        static SharedASTStore store;
+        return store;
     }
 
-    // Add a file to the bank or find it if it already exists.
-    // The bank parses the file and stores the syntax tree.
-    const TSTree & addFileOrFind(const std::filesystem::path & path)
+    // std::filesystem::canonical, cached for absolute paths, which do not depend on the working directory.
+    std::filesystem::path canonical(const std::filesystem::path & path)
     {
+        if (!path.is_absolute()) return std::filesystem::canonical(path);
+        Shard & shard = shardOf(path);
+        {
+            std::lock_guard lock(shard.mutex);
+            if (auto it = shard.canonicalPaths.find(path); it != shard.canonicalPaths.end()) return it->second;
+        }
         std::filesystem::path pathCanonical = std::filesystem::canonical(path);
+        std::lock_guard lock(shard.mutex);
+        shard.canonicalPaths.emplace(path, pathCanonical);
+        return pathCanonical;
+    }
 
-        // Check if the file is already in the bank
+    // Parse the file at a canonical path, or find it if some thread already did.
+    // A file whose size or modification time changed since it was parsed is parsed again.
+    ParsedFilePtr addFileOrFind(const std::filesystem::path & pathCanonical)
+    {
+        const Stamp stamp = stampOf(pathCanonical);
+        std::shared_ptr<Slot> slot;
+        {
+            Shard & shard = shardOf(pathCanonical);
+            std::lock_guard lock(shard.mutex);
+            std::shared_ptr<Slot> & entry = shard.slots[pathCanonical];
+            if (!entry || entry->stamp != stamp) entry = std::make_shared<Slot>(stamp);
+            slot = entry;
+        }
+        return parseOnce(*slot, pathCanonical);
+    }
 
-        if (auto it = bank.find(pathCanonical); it != bank.end())
+    // A file that changed on disk since it was parsed, parsed again incrementally from its previous tree
+    struct Reparse
+    {
+        ParsedFilePtr previous;
+        ParsedFilePtr current;
+        ts::TSInputEdit edit; // Applied to the previous tree before reparsing
+    };
+
+    // Bring a file in the store up to date with the disk, reusing its previous tree.
+    // Returns nullopt if the file is not held by anyone or its content did not change.
+    // Banks holding the previous tree keep it, unedited. The caller must hold the current tree to keep it.
+    std::optional<Reparse> update(const std::filesystem::path & pathCanonical)
+    {
+        std::shared_ptr<Slot> previousSlot;
+        {
+            Shard & shard = shardOf(pathCanonical);
+            std::lock_guard lock(shard.mutex);
+            if (auto it = shard.slots.find(pathCanonical); it != shard.slots.end()) previousSlot = it->second;
+        }
+        if (!previousSlot) return std::nullopt;
+        ParsedFilePtr previous;
+        {
+            std::lock_guard lock(previousSlot->parseMutex);
+            previous = previousSlot->file.lock();
+        }
+        // Nobody holds it, so the next addFileOrFind parses the new content from scratch anyway
+        if (!previous) return std::nullopt;
+
+        const Stamp stamp = stampOf(pathCanonical);
+        const MappedFile file(pathCanonical);
+        const std::string_view source = file.view();
+        if (source == previous->tree.getSource())
+        {
+            // Touched but not changed; remember the new stamp so the file is not parsed again
+            std::lock_guard lock(shardOf(pathCanonical).mutex);
+            previousSlot->stamp = stamp;
+            return std::nullopt;
+        }
+
+        const ts::TSInputEdit edit = diff(previous->tree.getSource(), source);
+        TSTree edited = previous->tree.copy();
+        edited.edit(&edit);
+        TSParser parser(lang);
+        TSTree tree = parser.parseString(source, edited);
+        DirectiveIndex index = DirectiveIndex::build(lang, tree.rootNode());
+        parseCount.fetch_add(1, std::memory_order_relaxed);
+        ParsedFilePtr current = std::make_shared<ParsedFile>(ParsedFile{std::move(tree), std::move(index)});
+
+        auto slot = std::make_shared<Slot>(stamp);
+        slot->file = current;
         {
-            return it->second;
+            Shard & shard = shardOf(pathCanonical);
+            std::lock_guard lock(shard.mutex);
+            shard.slots[pathCanonical] = slot;
         }
+        return Reparse{previous, current, edit};
+    }
 
-        std::ifstream file(pathCanonical);
-        if (!file.is_open())
+    // Forget a file, e.g. after it changed on disk. Banks holding its tree keep it alive.
+    void invalidate(const std::filesystem::path & pathCanonical)
+    {
+        Shard & shard = shardOf(pathCanonical);
+        std::lock_guard lock(shard.mutex);
+        shard.slots.erase(pathCanonical);
+    }
+
+    // Number of files parsed so far
+    std::size_t parses() const
+    {
+        return parseCount.load(std::memory_order_relaxed);
+    }
+
+    // Number of files whose trees are currently held by someone
+    std::size_t resident()
+    {
+        std::size_t count = 0;
+        for (Shard & shard : shards)
         {
-            throw std::runtime_error("Failed to open file: " + pathCanonical.string());
+            std::lock_guard lock(shard.mutex);
+            std::erase_if(shard.slots, [](const auto & entry) { return entry.second->file.expired(); });
+            count += shard.slots.size();
         }
-        std::string fullSrc = std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-        file.close();
-        
+        return count;
+    }
+
+private:
+    static constexpr std::size_t ShardCount = 16;
+
+    struct Stamp
+    {
+        std::filesystem::file_time_type mtime;
+        std::uintmax_t size;
+
+        bool operator==(const Stamp &) const = default;
+    };
+
+    struct Slot
+    {
+        explicit Slot(Stamp stamp) : stamp(stamp) {}
+
+        Stamp stamp;
+        // Held while parsing, so that the other threads wanting the file wait for the one parse
+        std::mutex parseMutex;
+        // Owned by the holders of the file; once they are all gone, it is parsed again on demand
+        std::weak_ptr<const ParsedFile> file;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::filesystem::path, std::shared_ptr<Slot>> slots;
+        std::unordered_map<std::filesystem::path, std::filesystem::path> canonicalPaths;
+    };
+
+    const CPreproc lang = CPreproc();
+    std::array<Shard, ShardCount> shards;
+    std::atomic<std::size_t> parseCount{0};
+
+    Shard & shardOf(const std::filesystem::path & path)
+    {
+        return shards[std::filesystem::hash_value(path) % ShardCount];
+    }
+
+    static Stamp stampOf(const std::filesystem::path & path)
+    {
+        return Stamp{std::filesystem::last_write_time(path), std::filesystem::file_size(path)};
+    }
+
+    // A file mapped read-only for the duration of a parse; the tree keeps its own copy of the source.
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::filesystem::path & path)
+        {
+            const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Failed to open file: " + path.string());
+            }
+            struct stat fileStat;
+            if (::fstat(fd, &fileStat) != 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("Failed to stat file: " + path.string());
+            }
+            size = static_cast<std::size_t>(fileStat.st_size);
+            if (size > 0) data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED)
+            {
+                throw std::runtime_error("Failed to map file: " + path.string());
+            }
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile & operator=(const MappedFile &) = delete;
+
+        ~MappedFile()
+        {
+            if (data) ::munmap(data, size);
+        }
+
+        std::string_view view() const
+        {
+            return data ? std::string_view(static_cast<const char *>(data), size) : std::string_view();
+        }
+
+    private:
+        void * data = nullptr;
+        std::size_t size = 0;
+    };
+
+    // The file of a slot, parsed now if no one holds it. A parse that throws leaves the slot empty for a retry.
+    ParsedFilePtr parseOnce(Slot & slot, const std::filesystem::path & pathCanonical)
+    {
+        std::lock_guard lock(slot.parseMutex);
+        if (ParsedFilePtr file = slot.file.lock()) return file;
+        ParsedFilePtr file = parse(pathCanonical);
+        slot.file = file;
+        return file;
+    }
+
+    ParsedFilePtr parse(const std::filesystem::path & pathCanonical)
+    {
+        const MappedFile file(pathCanonical);
         try
         {
-            TSTree tree = parser.parseString(std::move(fullSrc));
-            bank[pathCanonical] = std::move(tree);
+            TSParser parser(lang);
+            TSTree tree = parser.parseString(file.view());
+            DirectiveIndex index = DirectiveIndex::build(lang, tree.rootNode());
+            parseCount.fetch_add(1, std::memory_order_relaxed);
+            return std::make_shared<ParsedFile>(ParsedFile{std::move(tree), std::move(index)});
         }
-        catch (const std::exception & e)
+        catch (...)
         {
-            SPDLOG_ERROR("Failed to parse file: {}", path.string());
+            SPDLOG_ERROR("Failed to parse file: {}", pathCanonical.string());
+            throw;
         }
-        
-        return bank.at(pathCanonical);
+    }
+
+    // The single edit turning one source into the other: everything between their common prefix and suffix.
+    static ts::TSInputEdit diff(std::string_view oldSource, std::string_view newSource)
+    {
+        std::size_t prefix = 0;
+        const std::size_t shorter = std::min(oldSource.size(), newSource.size());
+        while (prefix < shorter && oldSource[prefix] == newSource[prefix]) ++prefix;
+        std::size_t suffix = 0;
+        while (suffix < shorter - prefix && oldSource[oldSource.size() - 1 - suffix] == newSource[newSource.size() - 1 - suffix]) ++suffix;
+
+        auto pointAt = [](std::string_view source, std::size_t offset)
+        {
+            ts::TSPoint point{0, 0};
+            for (std::size_t i = 0; i < offset; ++i)
+            {
+                if (source[i] == '\n')
+                {
+                    ++point.row;
+                    point.column = 0;
+                }
+                else
+                {
+                    ++point.column;
+                }
+            }
+            return point;
+        };
+
+        ts::TSInputEdit edit;
+        edit.start_byte = static_cast<uint32_t>(prefix);
+        edit.old_end_byte = static_cast<uint32_t>(oldSource.size() - suffix);
+        edit.new_end_byte = static_cast<uint32_t>(newSource.size() - suffix);
+        edit.start_point = pointAt(oldSource, edit.start_byte);
+        edit.old_end_point = pointAt(oldSource, edit.old_end_byte);
+        edit.new_end_point = pointAt(newSource, edit.new_end_byte);
+        return edit;
+    }
+};
+
+class ASTBank
+{
+public:
+    ASTBank(const CPreproc & lang, SharedASTStore & store = SharedASTStore::instance())
+        : lang(lang), parser(lang), store(&store)
+    {
+    }
+
+    // Add a file to the bank or find it if it already exists.
+    // The file is parsed at most once per process and its tree shared with other banks.
+    const TSTree & addFileOrFind(const std::filesystem::path & path)
+    {
+        std::filesystem::path pathCanonical = store->canonical(path);
+
+        // Check if the file is already in the bank
+
+        if (auto it = bank.find(pathCanonical); it != bank.end())
+        {
+            return it->second->tree;
+        }
+
+        SharedASTStore::ParsedFilePtr file = store->addFileOrFind(pathCanonical);
+        indices.emplace(&file->tree.getSource(), &file->index);
+        return bank.emplace(std::move(pathCanonical), std::move(file)).first->second->tree;
     }
 
     const TSTree & addAnonymousSource(std::string && src)
     {
         TSTree tree = parser.parseString(std::move(src));
+        const DirectiveIndex & index = anonymousIndices.emplace_back(DirectiveIndex::build(lang, tree.rootNode()));
+        indices.emplace(&tree.getSource(), &index);
         anonymousSources.push_back(std::move(tree));
         return anonymousSources.back();
     }
@@ -69,14 +361,26 @@ public:
     // Find a tree in the bank by file path
     const TSTree & find(const std::filesystem::path & path) const
     {
-        std::filesystem::path pathCanonical = std::filesystem::canonical(path);
-        return bank.at(pathCanonical);
+        std::filesystem::path pathCanonical = store->canonical(path);
+        return bank.at(pathCanonical)->tree;
+    }
+
+    // Find the directive index of the tree a node belongs to.
+    // Any node of a tree in the bank works, not only the root.
+    const DirectiveIndex & index(const TSNode & node) const
+    {
+        return *indices.at(&node.getSource());
     }
 
 private:
+    const CPreproc lang;
     TSParser parser;
-    std::unordered_map<std::filesystem::path, TSTree> bank;
-    std::vector<TSTree> anonymousSources;
+    SharedASTStore * store;
+    std::unordered_map<std::filesystem::path, SharedASTStore::ParsedFilePtr> bank;
+    std::deque<TSTree> anonymousSources;
+    std::deque<DirectiveIndex> anonymousIndices;
+    // Keyed by the address of the tree's source, which stays put when the TSTree is moved.
+    std::unordered_map<const std::string *, const DirectiveIndex *> indices;
 };
 
 } // namespace Hayroll
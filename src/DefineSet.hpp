@@ -35,7 +35,8 @@ struct DefineSet
             z3::expr value = model.get_const_interp(v);
             if (prefix == "val")
             {
-                int64_t intValue = value.get_numeral_int64();
+                // Bit-vector values are read as two's complement
+                int64_t intValue = value.is_bv() ? static_cast<int64_t>(value.get_numeral_uint64()) : value.get_numeral_int64();
                 defines.emplace(name, intValue);
             }
             else if (prefix == "def")
@@ -83,55 +84,76 @@ struct DefineSet
         return str;
     }
 
-    bool satisfies(const z3::expr & expr) const
+    // Collect the def/val constants an expression depends on, keyed by AST id.
+    // Shared subexpressions are visited once.
+    static void collectMacroConstants(const z3::expr & expr, std::unordered_map<unsigned, z3::expr> & constants)
     {
-        z3::context & ctx = expr.ctx();
-        std::unordered_set<std::string> seen;
-
-        std::function<void(const z3::expr &)> visit = [&seen, &visit](const z3::expr & e)
+        std::unordered_set<unsigned> visited;
+        std::vector<z3::expr> stack{expr};
+        while (!stack.empty())
         {
-            if (e.is_app())
+            z3::expr e = stack.back();
+            stack.pop_back();
+            if (!e.is_app() || !visited.insert(e.id()).second) continue;
+            if (e.num_args() == 0)
             {
-                if (e.num_args() == 0)
-                {
-                    std::string n = e.decl().name().str();
-                    if (n.starts_with("def") || n.starts_with("val"))
-                        seen.insert(n);
-                }
-                for (unsigned i = 0; i < e.num_args(); ++i) visit(e.arg(i));
+                std::string n = e.decl().name().str();
+                if (n.starts_with("def") || n.starts_with("val")) constants.emplace(e.id(), e);
+                continue;
             }
-        };
-        visit(expr);
+            for (unsigned i = 0; i < e.num_args(); ++i) stack.push_back(e.arg(i));
+        }
+    }
 
-        z3::expr assigns = ctx.bool_val(true);
-        for (const std::string & fullName : seen)
+    // The value this DefineSet gives a def/val constant; undefined macros have value 0
+    z3::expr valueOf(const z3::expr & constant) const
+    {
+        z3::context & ctx = constant.ctx();
+        const std::string fullName = constant.decl().name().str();
+        auto it = defines.find(fullName.substr(3));
+        if (fullName.starts_with("def")) return ctx.bool_val(it != defines.end());
+        int64_t value = 0;
+        if (it != defines.end() && it->second.has_value()) value = it->second.value();
+        return constant.is_bv() ? ctx.bv_val(value, constant.get_sort().bv_size()) : ctx.int_val(value);
+    }
+
+    // A model that assigns the given def/val constants as this DefineSet does
+    z3::model toModel(z3::context & ctx, const std::unordered_map<unsigned, z3::expr> & constants) const
+    {
+        z3::model model(ctx);
+        for (const auto & [id, constant] : constants)
         {
-            std::string prefix = fullName.substr(0, 3);
-            std::string macroName = fullName.substr(3);
-            auto it = defines.find(macroName);
-            if (prefix == "def")
-            {
-                bool defined = (it != defines.end());
-                assigns = assigns && (ctx.bool_const(fullName.c_str()) == ctx.bool_val(defined));
-            }
-            else if (prefix == "val")
-            {
-                int value = 0;
-                if (it != defines.end() && it->second.has_value()) value = it->second.value();
-                assigns = assigns && (ctx.int_const(fullName.c_str()) == ctx.int_val(value));
-            }
+            z3::func_decl decl = constant.decl();
+            z3::expr value = valueOf(constant);
+            model.add_const_interp(decl, value);
         }
+        return model;
+    }
 
-        z3::expr implies = z3::implies(assigns, expr);
-        bool ok = z3CheckTautology(implies);
+    // Check an expression under a model from toModel() that covers its def/val constants.
+    // Evaluation decides it, unless the expression has free constants besides the macros';
+    // then what is left must be a tautology.
+    bool satisfies(const z3::expr & expr, const z3::model & model) const
+    {
+        z3::expr value = model.eval(expr, false);
+        if (value.is_true()) return true;
+        if (value.is_false()) return false;
+        bool ok = z3CheckTautology(value);
         SPDLOG_TRACE
         (
-            "Implication check: set=({}) expr={} assigns={} result={}",
-            toString(), expr.to_string(), assigns.to_string(), ok ? "true" : "false"
+            "Implication check: set=({}) expr={} evaluated={} result={}",
+            toString(), expr.to_string(), value.to_string(), ok ? "true" : "false"
         );
         return ok;
     }
 
+    bool satisfies(const z3::expr & expr) const
+    {
+        std::unordered_map<unsigned, z3::expr> constants;
+        collectMacroConstants(expr, constants);
+        return satisfies(expr, toModel(expr.ctx(), constants));
+    }
+
     static std::string defineSetsToString(const std::vector<DefineSet> & defineSets)
     {
         std::ostringstream oss;
@@ -0,0 +1,121 @@
+// Directives and C token spans of one parsed file, collected in a single pass when the file is parsed.
+// Lets consumers skip walking whole trees, and avoids TSNode::parent(), which walks down from the root.
+
+#ifndef HAYROLL_DIRECTIVEINDEX_HPP
+#define HAYROLL_DIRECTIVEINDEX_HPP
+
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+#include "TreeSitter.hpp"
+#include "TreeSitterCPreproc.hpp"
+
+namespace Hayroll
+{
+
+struct DirectiveIndex
+{
+    // What is known about a block_items node
+    struct Block
+    {
+        TSNode conditional; // Nearest enclosing preproc_if, preproc_ifdef or preproc_ifndef
+        TSNode firstCToken; // First non-comment token of any c_tokens inside, null if there is none
+        TSNode lastCToken; // Last non-comment token of any c_tokens inside, null if there is none
+    };
+
+    std::vector<std::string_view> definedNames; // Names of #define and #undef, in source order
+    std::vector<TSNode> includes; // preproc_include and preproc_include_next
+    std::vector<TSNode> conditionals; // preproc_if, preproc_ifdef and preproc_ifndef
+    std::vector<TSNode> linemarkers; // preproc_line
+    // Every node outside c_tokens and comments, in pre-order: the directives with their tokens,
+    // and the blocks and conditionals holding the C code. Symbolic execution depends on nothing else.
+    std::vector<TSNode> directiveNodes;
+    std::unordered_map<TSNode, Block, TSNode::Hasher> blocks;
+
+    static DirectiveIndex build(const CPreproc & lang, const TSNode & root)
+    {
+        DirectiveIndex index;
+        std::vector<Block> openBlocks;
+        index.visit(lang, root, TSNode{}, openBlocks);
+        return index;
+    }
+
+private:
+    void visit(const CPreproc & lang, const TSNode & node, TSNode conditional, std::vector<Block> & openBlocks)
+    {
+        if (node.isSymbol(lang.comment_s)) return;
+        if (!node.isSymbol(lang.c_tokens_s)) directiveNodes.push_back(node);
+
+        if (node.isSymbol(lang.preproc_if_s) || node.isSymbol(lang.preproc_ifdef_s) || node.isSymbol(lang.preproc_ifndef_s))
+        {
+            conditionals.push_back(node);
+            conditional = node;
+        }
+        else if (node.isSymbol(lang.preproc_def_s) || node.isSymbol(lang.preproc_function_def_s) || node.isSymbol(lang.preproc_undef_s))
+        {
+            // All three carry their macro name in the same "name" field.
+            definedNames.push_back(node.childByFieldId(lang.preproc_def_s.name_f).textView());
+            addDescendants(lang, node);
+            return;
+        }
+        else if (node.isSymbol(lang.preproc_include_s) || node.isSymbol(lang.preproc_include_next_s))
+        {
+            includes.push_back(node);
+            addDescendants(lang, node);
+            return;
+        }
+        else if (node.isSymbol(lang.preproc_line_s))
+        {
+            linemarkers.push_back(node);
+            addDescendants(lang, node);
+            return;
+        }
+        else if (node.isSymbol(lang.c_tokens_s))
+        {
+            if (openBlocks.empty()) return;
+            Block & block = openBlocks.back();
+            for (const TSNode & token : node.iterateChildren())
+            {
+                if (token.isSymbol(lang.comment_s)) continue;
+                if (!block.firstCToken) block.firstCToken = token;
+                block.lastCToken = token;
+            }
+            return;
+        }
+
+        const bool isBlock = node.isSymbol(lang.block_items_s);
+        if (isBlock) openBlocks.push_back(Block{conditional, TSNode{}, TSNode{}});
+        for (const TSNode & child : node.iterateChildren())
+        {
+            visit(lang, child, conditional, openBlocks);
+        }
+        if (isBlock)
+        {
+            Block block = openBlocks.back();
+            openBlocks.pop_back();
+            // Tokens of a nested block count for the enclosing blocks too.
+            if (!openBlocks.empty() && block.firstCToken)
+            {
+                Block & enclosing = openBlocks.back();
+                if (!enclosing.firstCToken) enclosing.firstCToken = block.firstCToken;
+                enclosing.lastCToken = block.lastCToken;
+            }
+            blocks.emplace(node, std::move(block));
+        }
+    }
+
+    void addDescendants(const CPreproc & lang, const TSNode & node)
+    {
+        for (const TSNode & child : node.iterateChildren())
+        {
+            if (child.isSymbol(lang.comment_s)) continue;
+            directiveNodes.push_back(child);
+            addDescendants(lang, child);
+        }
+    }
+};
+
+} // namespace Hayroll
+
+#endif // HAYROLL_DIRECTIVEINDEX_HPP
@@ -2,12 +2,14 @@
 #include <filesystem>
 #include <thread>
 #include <optional>
+#include <map>
 
 #include <spdlog/spdlog.h>
 #include "CLI11.hpp"
 #include "json.hpp"
 
 #include "Pipeline.hpp"
+#include "WatchSession.hpp"
 
 int main(const int argc, const char* argv[])
 {
@@ -28,6 +30,7 @@ int main(const int argc, const char* argv[])
     std::filesystem::path symbolicMacroWhitelistPath;
     bool enableInline = false;
     bool keepSrcLoc = false;
+    PipelineOptions pipelineOptions;
     int verbose = 0;
     std::string binaryTargetName;
 
@@ -36,7 +39,7 @@ int main(const int argc, const char* argv[])
         CLI::App app
         {
             "Hayroll pipeline (supports C2Rust compatibility mode with the 'transpile' subcommand)\n"
-            "Patterns:\n 1) hayroll <compile_commands.json> <output_dir> [opts]\n 2) hayroll transpile <compile_commands.json> -o <output_dir> [opts]"
+            "Patterns:\n 1) hayroll <compile_commands.json> <output_dir> [opts]\n 2) hayroll transpile <compile_commands.json> -o <output_dir> [opts]\n 3) hayroll [opts] watch <compile_commands.json> <output_dir>"
         };
         app.set_help_flag("-h,--help", "Show help");
 
@@ -55,6 +58,50 @@ int main(const int argc, const char* argv[])
         app.add_flag("-s,--keep-src-loc", keepSrcLoc,
             "Preserve c2rust::src_loc annotations in Rust refactoring stages")
             ->default_val(false);
+        app.add_flag("-c,--compact-tags", pipelineOptions.compactTags,
+            "Emit compact tag ids in seeded C code and keep tag payloads in a side-table")
+            ->default_val(false);
+        app.add_option("-t,--symex-check-threads", pipelineOptions.pioneer.checkThreads,
+            "Threads per translation unit for checking #if branch feasibility and refining the premise tree during symbolic execution (0 = serial)")
+            ->default_val(0);
+        app.add_option("--ite-merge-limit", pipelineOptions.pioneer.iteMergeLimit,
+            "Merge symbolic execution states whose tables differ in at most this many integer-valued macros (0 = off)")
+            ->default_val(0);
+        app.add_flag("--memoize-headers", pipelineOptions.pioneer.memoizeHeaders,
+            "Replay cached summaries of re-included headers during symbolic execution")
+            ->default_val(false);
+        app.add_flag("--reuse-pioneer", pipelineOptions.reusePioneer,
+            "Save Pioneer artifacts (.pioneer) into the output directory, and load the one a previous --reuse-pioneer run saved instead of symbolically executing, when no input file or relevant option changed")
+            ->default_val(false);
+        const std::map<std::string, SimplifyTier> simplifyTiers
+        {
+            {"syntactic", SimplifyTier::Syntactic},
+            {"adaptive", SimplifyTier::Adaptive},
+            {"full", SimplifyTier::Full}
+        };
+        app.add_option("--simplify-tier", pipelineOptions.pioneer.simplifyTier,
+            "Premise simplification effort: syntactic, adaptive (solver-based only for large premises) or full. "
+            "Tiers below full are faster but may emit larger premises")
+            ->transform(CLI::CheckedTransformer(simplifyTiers, CLI::ignore_case))
+            ->default_str("full");
+        const std::map<std::string, IntEncoding> intEncodings
+        {
+            {"int", IntEncoding::Int},
+            {"bv64", IntEncoding::BitVector64}
+        };
+        app.add_option("--int-encoding", pipelineOptions.pioneer.intEncoding,
+            "Encoding of #if integers: int (unbounded) or bv64 (64-bit vectors with intmax_t/uintmax_t semantics)")
+            ->transform(CLI::CheckedTransformer(intEncodings, CLI::ignore_case))
+            ->default_str("int");
+        const std::map<std::string, SplitPlanning> splitPlannings
+        {
+            {"greedy", SplitPlanning::Greedy},
+            {"cover", SplitPlanning::Cover}
+        };
+        app.add_option("--split-planning", pipelineOptions.splitPlanning,
+            "How DefineSets are chosen: greedy (one per uncovered premise tree node) or cover (weighted MaxSAT over the uncovered nodes, for fewer DefineSets)")
+            ->transform(CLI::CheckedTransformer(splitPlannings, CLI::ignore_case))
+            ->default_str("greedy");
         app.add_flag("-v,--verbose", verbose,
             "Increase verbosity (-v=debug, -vv=trace)")
             ->default_val(0);
@@ -79,6 +126,16 @@ int main(const int argc, const char* argv[])
             "Output directory")
             ->required();
 
+        // Subcommand: watch
+        std::filesystem::path watchCompileCommands;
+        std::filesystem::path watchOutputDir;
+        CLI::App * subWatch = app.add_subcommand("watch", "Stay resident and rerun the translation units affected by each change to the project");
+        subWatch->add_option("compile_commands", watchCompileCommands, "Path to compile_commands.json")
+            ->required()
+            ->check(CLI::ExistingFile);
+        subWatch->add_option("output_dir", watchOutputDir, "Output directory")
+            ->required();
+
         app.require_subcommand(0, 1);
 
         try
@@ -94,6 +151,11 @@ int main(const int argc, const char* argv[])
         {
             compileCommandsJsonPath = transpileCompileCommands;
         }
+        else if (subWatch->parsed())
+        {
+            compileCommandsJsonPath = watchCompileCommands;
+            outputDir = watchOutputDir;
+        }
         else
         {
             // Normal mode requires two positionals
@@ -151,6 +213,40 @@ int main(const int argc, const char* argv[])
             binaryTarget = binaryTargetName;
         }
 
+        if (subWatch->parsed())
+        {
+            // Reruns load Pioneer artifacts whenever their inputs allow it
+            WatchSession session
+            (
+                compileCommandsJsonPath,
+                outputDir,
+                projDir,
+                [&](const std::unordered_set<std::filesystem::path> * tasksToRun)
+                {
+                    PipelineOptions rerunOptions = pipelineOptions;
+                    rerunOptions.reusePioneer = true;
+                    rerunOptions.tasksToRun = tasksToRun;
+                    return Pipeline::run
+                    (
+                        compileCommandsJsonPath,
+                        outputDir,
+                        projDir,
+                        symbolicMacroWhitelist,
+                        enableInline,
+                        keepSrcLoc,
+                        jobs,
+                        binaryTarget,
+                        rerunOptions
+                    );
+                },
+                [&](const CompileCommand & command)
+                {
+                    return Pipeline::pioneerArtifactConfigHash(command, symbolicMacroWhitelist, pipelineOptions.pioneer);
+                }
+            );
+            session.run();
+        }
+
         return Pipeline::run
         (
             compileCommandsJsonPath,
@@ -160,7 +256,8 @@ int main(const int argc, const char* argv[])
             enableInline,
             keepSrcLoc,
             jobs,
-            binaryTarget
+            binaryTarget,
+            pipelineOptions
         );
     }
     catch (const std::exception & e)
@@ -1,14 +1,19 @@
 // Tree representation of the include hierarchy for a comilation unit.
+// All nodes of a compilation unit live in one IncludeTreeArena, addressed by 32-bit index and linked by plain pointers,
+// so handing them around (e.g. in ProgramPoints) costs no reference counting. The arena is kept alive by its roots.
 
 #ifndef HAYROLL_INCLUDETREE_HPP
 #define HAYROLL_INCLUDETREE_HPP
 
 #include <filesystem>
 #include <memory>
-#include <map>
+#include <deque>
+#include <vector>
+#include <algorithm>
 #include <string_view>
 #include <optional>
 #include <sstream>
+#include <cstdint>
 
 #include "Util.hpp"
 #include "TreeSitter.hpp"
@@ -17,45 +22,50 @@ namespace Hayroll
 {
 
 struct IncludeTree;
-using IncludeTreePtr = std::shared_ptr<IncludeTree>;
-using ConstIncludeTreePtr = std::shared_ptr<const IncludeTree>;
+class IncludeTreeArena;
+using IncludeTreePtr = IncludeTree *;
+using ConstIncludeTreePtr = const IncludeTree *;
+// A root that owns the arena of its whole tree
+using IncludeTreeRootPtr = std::shared_ptr<IncludeTree>;
 
 struct IncludeTree
-    : public std::enable_shared_from_this<IncludeTree>,
-      public std::ranges::view_interface<IncludeTree>
+    : public std::ranges::view_interface<IncludeTree>
 {
 public:
     TSNode includeNode; // The node in the parent file AST that includes this file
     std::filesystem::path path;
     bool isSystemInclude = false; // True if the include is a system include, i.e., concretely executed and not in the astBank
-    
-    std::map<TSNode, IncludeTreePtr> children; // Line number -> IncludeTreePtr
-    std::weak_ptr<IncludeTree> parent;
+    std::uint32_t index = 0; // Position in the arena
 
-    // Constructor
-    // An IncludeTree object shall only be managed by a shared_ptr
-    static IncludeTreePtr make
+    std::vector<IncludeTreePtr> children; // Ordered by includeNode
+    IncludeTreePtr parent = nullptr;
+
+    // Constructor of a root in a new arena
+    // The arena lives as long as any pointer to the root does
+    static IncludeTreeRootPtr make
     (
         const TSNode & includeNode,
         const std::filesystem::path & path,
-        IncludeTreePtr parent = nullptr,
         bool isSystemInclude = false
-    )
+    );
+
+    // Add a child IncludeTree object to the current one, replacing any child of the same include node
+    // Do not use canonicalized path, as the ".."s may be part of the include name in source code
+    IncludeTreePtr addChild(TSNode includeNode, const std::filesystem::path & path, bool isSystemInclude = false);
+
+    // Add another root to the arena of this tree, for sources outside the include hierarchy such as <built-in>
+    IncludeTreePtr addRoot(const std::filesystem::path & path, bool isSystemInclude = false);
+
+    IncludeTreeArena & getArena() const
     {
-        auto tree = std::make_shared<IncludeTree>();
-        tree->includeNode = includeNode;
-        tree->path = path;
-        tree->parent = parent;
-        tree->isSystemInclude = isSystemInclude;
-        return tree;
+        return *arena;
     }
 
-    // Add a child IncludeTree object to the current one
-    // Do not use canonicalized path, as the ".."s may be part of the include name in source code
-    IncludeTreePtr addChild(TSNode includeNode, const std::filesystem::path & path, bool isSystemInclude = false)
+    // The child included by the given node, or nullptr
+    IncludeTreePtr child(const TSNode & includeNode) const
     {
-        children[includeNode] = make(includeNode, path, shared_from_this(), isSystemInclude);
-        return children[includeNode];
+        auto it = std::ranges::lower_bound(children, includeNode, {}, &IncludeTree::includeNode);
+        return it != children.end() && (*it)->includeNode == includeNode ? *it : nullptr;
     }
 
     // Test if the given string path (spelt header name) is a suffix of the current path.
@@ -66,48 +76,36 @@ public:
         return path.string().ends_with(header);
     }
 
-    bool isAncestorOf(const ConstIncludeTreePtr & child) const
+    bool isAncestorOf(ConstIncludeTreePtr child) const
     {
-        // Check if the child is in the current tree
-        if (child == shared_from_this()) return true;
-        // Check if the child is in the parent tree
-        if (ConstIncludeTreePtr parent = child->parent.lock())
+        for (ConstIncludeTreePtr node = child; node; node = node->parent)
         {
-            return parent->isAncestorOf(shared_from_this());
+            if (node == this) return true;
         }
         return false;
     }
 
     bool isContainedBy(const TSNode & node) const
     {
-        for (TSNode ancestorNode = includeNode; ancestorNode; ancestorNode = ancestorNode.parent())
+        for (ConstIncludeTreePtr tree = this; tree; tree = tree->parent)
         {
-            if (ancestorNode == node)
+            for (TSNode ancestorNode = tree->includeNode; ancestorNode; ancestorNode = ancestorNode.parent())
             {
-                return true;
+                if (ancestorNode == node)
+                {
+                    return true;
+                }
             }
         }
-        if (ConstIncludeTreePtr parent = this->parent.lock())
-        {
-            return parent->isContainedBy(node);
-        }
         return false;
     }
 
-    // Get a vector of ancestor directories
+    // Get a vector of ancestor directories, this file's own first
     // This is useful for resolving user includes
-    std::vector<std::filesystem::path> getAncestorDirs() const
+    // Computed once when the node is created
+    const std::vector<std::filesystem::path> & getAncestorDirs() const
     {
-        // Peel off the filenames from the path
-        std::vector<std::filesystem::path> dirs;
-        auto node = shared_from_this();
-        while (node)
-        {
-            auto dir = node->path.parent_path();
-            dirs.push_back(dir);
-            node = node->parent.lock();
-        }
-        return dirs;
+        return ancestorDirs;
     }
 
     // Print the entire subtree
@@ -121,7 +119,7 @@ public:
         ss << " ";
 
         // parentPath:lineNumber -> path
-        if (auto parent = this->parent.lock())
+        if (parent)
         {
             ss << parent->path.string() << ":";
             if (includeNode)
@@ -141,7 +139,7 @@ public:
         }
         ss << path.string() << "\n";
 
-        for (const auto &[line, child] : children)
+        for (ConstIncludeTreePtr child : children)
         {
             ss << child->toString(depth + 1);
         }
@@ -153,7 +151,7 @@ public:
     {
         std::stringstream ss;
         TSNode prevIncludeNode = includeNode;
-        ConstIncludeTreePtr node = shared_from_this();
+        ConstIncludeTreePtr node = this;
         while (node)
         {
             ss << node->path.string() << ":";
@@ -166,7 +164,7 @@ public:
                 ss << "EOF";
             }
             prevIncludeNode = node->includeNode;
-            node = node->parent.lock();
+            node = node->parent;
             if (node)
             {
                 ss << "\n<- ";
@@ -175,6 +173,7 @@ public:
         return ss.str();
     }
 
+    // Pre-order traversal of the subtree
     struct Iterator
     {
     public:
@@ -182,41 +181,37 @@ public:
         using value_type = IncludeTreePtr;
         using iterator_concept = std::forward_iterator_tag;
 
-        Iterator() : currentNode(nullptr), atEnd(true) {}
+        Iterator() : currentNode(nullptr), subtreeRoot(nullptr) {}
 
-        explicit Iterator(IncludeTreePtr node, bool atEnd = false)
-            : currentNode(std::move(node)), atEnd(atEnd) {}
+        explicit Iterator(IncludeTreePtr node)
+            : currentNode(node), subtreeRoot(node) {}
 
         IncludeTreePtr operator*() const
         {
-            assert(!atEnd);
+            assert(currentNode);
             return currentNode;
         }
 
         Iterator & operator++()
         {
-            assert(!atEnd);
+            assert(currentNode);
             if (!currentNode->children.empty())
             {
-                currentNode = currentNode->children.begin()->second;
+                currentNode = currentNode->children.front();
+                return *this;
             }
-            else
+            while (currentNode != subtreeRoot)
             {
-                IncludeTreePtr parent = currentNode->parent.lock();
-                while (parent)
+                IncludeTreePtr parent = currentNode->parent;
+                const std::uint32_t next = currentNode->childIndex + 1;
+                if (next < parent->children.size())
                 {
-                    auto it = parent->children.find(currentNode->includeNode);
-                    ++it;
-                    if (it != parent->children.end())
-                    {
-                        currentNode = it->second;
-                        return *this;
-                    }
-                    currentNode = parent;
-                    parent = parent->parent.lock();
+                    currentNode = parent->children[next];
+                    return *this;
                 }
-                atEnd = true;
+                currentNode = parent;
             }
+            currentNode = nullptr;
             return *this;
         }
 
@@ -227,31 +222,119 @@ public:
             return copy;
         }
 
-        bool operator==(const Iterator &other) const
+        bool operator==(const Iterator & other) const
         {
-            if (atEnd && other.atEnd) return true;
-            if (atEnd != other.atEnd) return false;
             return currentNode == other.currentNode;
         }
 
     private:
-        IncludeTreePtr currentNode;
-        bool atEnd;
+        IncludeTreePtr currentNode; // nullptr at the end
+        IncludeTreePtr subtreeRoot;
     };
 
     Iterator begin()
     {
-        return Iterator(shared_from_this());
+        return Iterator(this);
     }
 
     Iterator end()
     {
-        return Iterator(nullptr, true);
+        return Iterator();
     }
+
+private:
+    friend class IncludeTreeArena;
+
+    IncludeTreeArena * arena = nullptr;
+    std::uint32_t childIndex = 0; // Position in the parent's children
+    std::vector<std::filesystem::path> ancestorDirs;
 };
 static_assert(std::forward_iterator<IncludeTree::Iterator>);
 static_assert(std::ranges::forward_range<IncludeTree>);
 
+// Owns the nodes of the include trees of one compilation unit. Nodes never move once created.
+class IncludeTreeArena
+{
+public:
+    IncludeTreeArena() = default;
+    IncludeTreeArena(const IncludeTreeArena &) = delete;
+    IncludeTreeArena & operator=(const IncludeTreeArena &) = delete;
+
+    IncludeTreePtr make
+    (
+        const TSNode & includeNode,
+        const std::filesystem::path & path,
+        IncludeTreePtr parent,
+        bool isSystemInclude
+    )
+    {
+        assert(nodes.size() < UINT32_MAX);
+        IncludeTree & tree = nodes.emplace_back();
+        tree.includeNode = includeNode;
+        tree.path = path;
+        tree.parent = parent;
+        tree.isSystemInclude = isSystemInclude;
+        tree.index = static_cast<std::uint32_t>(nodes.size() - 1);
+        tree.arena = this;
+        tree.ancestorDirs.reserve(parent ? parent->ancestorDirs.size() + 1 : 1);
+        tree.ancestorDirs.push_back(path.parent_path());
+        if (parent)
+        {
+            tree.ancestorDirs.insert(tree.ancestorDirs.end(), parent->ancestorDirs.begin(), parent->ancestorDirs.end());
+        }
+        return &tree;
+    }
+
+    IncludeTreePtr at(std::uint32_t index)
+    {
+        return &nodes.at(index);
+    }
+
+    std::size_t size() const
+    {
+        return nodes.size();
+    }
+
+private:
+    std::deque<IncludeTree> nodes;
+};
+
+inline IncludeTreeRootPtr IncludeTree::make
+(
+    const TSNode & includeNode,
+    const std::filesystem::path & path,
+    bool isSystemInclude
+)
+{
+    auto arena = std::make_shared<IncludeTreeArena>();
+    IncludeTreePtr root = arena->make(includeNode, path, nullptr, isSystemInclude);
+    return IncludeTreeRootPtr(std::move(arena), root);
+}
+
+inline IncludeTreePtr IncludeTree::addChild(TSNode includeNode, const std::filesystem::path & path, bool isSystemInclude)
+{
+    IncludeTreePtr tree = arena->make(includeNode, path, this, isSystemInclude);
+    auto it = std::ranges::lower_bound(children, includeNode, {}, &IncludeTree::includeNode);
+    if (it != children.end() && (*it)->includeNode == includeNode)
+    {
+        // The replaced child stays in the arena, so program points into it remain valid
+        tree->childIndex = (*it)->childIndex;
+        *it = tree;
+        return tree;
+    }
+    it = children.insert(it, tree);
+    for (; it != children.end(); ++it)
+    {
+        (*it)->childIndex = static_cast<std::uint32_t>(it - children.begin());
+    }
+    return tree;
+}
+
+inline IncludeTreePtr IncludeTree::addRoot(const std::filesystem::path & path, bool isSystemInclude)
+{
+    return arena->make(TSNode{}, path, nullptr, isSystemInclude);
+}
+
 } // namespace Hayroll::IncludeTree
 
 #endif // HAYROLL_INCLUDETREE_HPP
@@ -61,15 +61,8 @@ public:
         // Inverse mapping: line number in compilation unit file -> (IncludeTreePtr, line number in original source)
         std::vector<std::pair<IncludeTreePtr, int>> inverseLineMap(cuTotalLines + 1, {nullptr, 0});
 
-        std::vector<TSNode> linemarkers;
-        // Get all #line directives in the tree
-        for (TSNode node : root.iterateDescendants())
-        {
-            if (node.isSymbol(lang.preproc_line_s))
-            {
-                linemarkers.push_back(node);
-            }
-        }
+        // All #line directives in the tree, collected when the bank parsed it
+        std::vector<TSNode> linemarkers = astBank.index(root).linemarkers;
         linemarkers.push_back(TSNode{}); // Sentinel
 
         IncludeTreePtr lastIncludeTree = includeTree;
@@ -134,9 +127,9 @@ public:
                 // Jump into a new file
                 // last -> # 8 "libm/include/math.h"
                 // this -> # 1 "libm/include/config.h" 1
-                for (const auto & [includeNode, childIncludeTree] : lastIncludeTree->children)
+                for (IncludeTreePtr childIncludeTree : lastIncludeTree->children)
                 {
-                    if (includeNode.startPoint().row + 1 == lastSrcLine && childIncludeTree->path == thisCanonicalPath)
+                    if (childIncludeTree->includeNode.startPoint().row + 1 == lastSrcLine && childIncludeTree->path == thisCanonicalPath)
                     {
                         lastIncludeTree = childIncludeTree;
                         break;
@@ -151,7 +144,7 @@ public:
                 // Return to the previous file
                 // last -> # 18 "libm/include/config.h"
                 // this -> # 9 "libm/include/math.h" 2
-                IncludeTreePtr parentIncludeTree = lastIncludeTree->parent.lock();
+                IncludeTreePtr parentIncludeTree = lastIncludeTree->parent;
                 assert(parentIncludeTree);
                 if (parentIncludeTree->path == thisCanonicalPath)
                 {
@@ -25,9 +25,8 @@ public:
         TSNode rootNode = tree.rootNode();
 
         // Iterate over all linemarkers and replace them with spaces
-        for (const TSNode & node : rootNode.iterateDescendants())
+        for (const TSNode & node : astBank.index(rootNode).linemarkers)
         {
-            if (!node.isSymbol(lang.preproc_line_s)) continue;
             std::size_t ln = node.startPoint().row + 1; // Convert to 1-based line number
             std::size_t col = node.startPoint().column + 1; // Convert to 1-based column number
             std::size_t length = node.length();
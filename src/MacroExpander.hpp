@@ -7,6 +7,7 @@
 #include <variant>
 #include <ranges>
 #include <map>
+#include <unordered_map>
 #include <algorithm>
 #include <cctype>
 #include <cstdint>
@@ -22,26 +23,108 @@
 #include "Util.hpp"
 #include "SymbolTable.hpp"
 #include "ProgramPoint.hpp"
+#include "PreprocToken.hpp"
 
 namespace Hayroll
 {
 
+// How #if integers are encoded in z3
+enum class IntEncoding
+{
+    Int, // Unbounded integers; bitwise operators and shifts convert through BIT_WIDTH-bit vectors
+    BitVector64 // 64-bit vectors with intmax_t/uintmax_t semantics picked by the usual arithmetic conversions
+};
+
+// Results computed from one macro definition under one symbol table.
+// Symbol tables are immutable, so an entry stays valid for as long as its table is alive;
+// the weak pointer tells the table apart from a newer one allocated at the same address.
+// Definitions are keyed by name as well, since a run of #defines shares one ProgramPoint.
+template <typename T>
+class DefinitionMemo
+{
+public:
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+
+    const T * find(const ProgramPoint & def, std::string_view name, const ConstSymbolTablePtr & symbolTable)
+    {
+        auto it = entries.find(Key{def, name, symbolTable.get()});
+        if (it == entries.end() || it->second.symbolTable.expired())
+        {
+            ++misses;
+            return nullptr;
+        }
+        ++hits;
+        return &it->second.value;
+    }
+
+    const T & insert(const ProgramPoint & def, std::string_view name, const ConstSymbolTablePtr & symbolTable, T value)
+    {
+        if (entries.size() >= sweepThreshold) sweep();
+        auto [it, inserted] = entries.insert_or_assign(Key{def, name, symbolTable.get()}, Entry{symbolTable, std::move(value)});
+        return it->second.value;
+    }
+
+    double hitRatio() const
+    {
+        return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+    }
+
+private:
+    struct Key
+    {
+        ProgramPoint def;
+        std::string_view name;
+        const SymbolTable * symbolTable;
+
+        bool operator==(const Key & other) const = default;
+    };
+
+    struct KeyHasher
+    {
+        std::size_t operator()(const Key & key) const noexcept
+        {
+            std::size_t hash = ProgramPoint::Hasher{}(key.def);
+            hash = hashCombine(hash, std::hash<std::string_view>{}(key.name));
+            return hashCombine(hash, std::hash<const SymbolTable *>{}(key.symbolTable));
+        }
+    };
+
+    struct Entry
+    {
+        std::weak_ptr<const SymbolTable> symbolTable;
+        T value;
+    };
+
+    static constexpr std::size_t MinSweepThreshold = 4096;
+
+    std::unordered_map<Key, Entry, KeyHasher> entries;
+    std::size_t sweepThreshold = MinSweepThreshold;
+
+    // Drop entries of tables that are gone
+    void sweep()
+    {
+        std::erase_if(entries, [](const auto & entry) { return entry.second.symbolTable.expired(); });
+        sweepThreshold = std::max(MinSweepThreshold, 2 * entries.size());
+    }
+};
+
 class MacroExpander
 {
 public:
-    MacroExpander(const CPreproc & lang, z3::context * ctx)
-        : lang(lang), parser(lang), ctx(ctx), 
-          constExpr0(ctx->int_val(0)), constExpr1(ctx->int_val(1))
+    MacroExpander(const CPreproc & lang, z3::context * ctx, IntEncoding encoding = IntEncoding::Int)
+        : lang(lang), parser(lang), ctx(ctx), encoding(encoding),
+          constExpr0(encoding == IntEncoding::BitVector64 ? ctx->bv_val(0, 64) : ctx->int_val(0)),
+          constExpr1(encoding == IntEncoding::BitVector64 ? ctx->bv_val(1, 64) : ctx->int_val(1))
     {
         // Initialize constant tokens
         auto && [tree, tokens] = parseIntoPreprocTokens("0 1 ! defined");
         assert(tokens.isSymbol(lang.preproc_tokens_s));
-        tempTokensTree = std::move(tree);
-        std::vector<TSNode> tokenNodes = lang.tokensToTokenVector(tokens);
-        constToken0 = tokenNodes[0];
-        constToken1 = tokenNodes[1];
-        constTokenNot = tokenNodes[2];
-        constTokenDefined = tokenNodes[3];
+        std::vector<PreprocToken> interned = internTokens(lang.tokensToTokenVector(tokens));
+        constToken0 = interned[0];
+        constToken1 = interned[1];
+        constTokenNot = interned[2];
+        constTokenDefined = interned[3];
     }
 
     enum class Prepend
@@ -59,27 +142,42 @@ public:
         Prepend prepend = Prepend::None
     )
     {
-        std::vector<TSNode> tokensPrepended;
-        switch (prepend)
-        {
-            case Prepend::None:
-                break;
-            case Prepend::Defined:
-                tokensPrepended = tokens;
-                tokensPrepended.insert(tokensPrepended.begin(), constTokenDefined);
-                break;
-            case Prepend::NotDefined:
-                tokensPrepended = tokens;
-                tokensPrepended.insert(tokensPrepended.begin(), constTokenDefined);
-                tokensPrepended.insert(tokensPrepended.begin(), constTokenNot);
-                break;
-        }
-        std::vector<TSNode> expandedTokens = expandPreprocTokens(prepend == Prepend::None ? tokens : tokensPrepended, symbolTable);
+        return symbolizeExpandedToBoolExpr(expandWithPrepend(tokens, symbolTable, prepend), symbolTable);
+    }
 
+    // Expand the expression and evaluate it natively if no symbolic atom is left in it.
+    // Returns the truth value, or the expanded tokens to be passed to symbolizeExpandedToBoolExpr.
+    std::variant<bool, std::vector<PreprocToken>> evaluateOrExpand
+    (
+        const std::vector<TSNode> & tokens,
+        const ConstSymbolTablePtr & symbolTable = nullptr,
+        Prepend prepend = Prepend::None
+    )
+    {
+        std::vector<PreprocToken> expandedTokens = expandWithPrepend(tokens, symbolTable, prepend);
+        if (std::optional<bool> constant = evaluateConstant(expandedTokens)) return *constant;
+        return expandedTokens;
+    }
+
+    // Symbolize an already expanded expression
+    // The tokens are parsed directly; only what the token parser does not take goes through tree-sitter
+    z3::expr symbolizeExpandedToBoolExpr(const std::vector<PreprocToken> & expandedTokens, const ConstSymbolTablePtr & symbolTable = nullptr)
+    {
+        if (expandedTokens.empty()) return ctx->bool_val(false);
+        SymbolicSemantics semantics{*this, symbolTable};
+        TokenExpressionParser<SymbolicSemantics> tokenParser{expandedTokens, interner, semantics};
+        if (std::optional<Value> value = tokenParser.parseAll()) return int2bool(value->expr);
+        return symbolizeExpandedToBoolExprReparsed(expandedTokens, symbolTable);
+    }
+
+    // Symbolize an already expanded expression by printing it and parsing it again with tree-sitter
+    // Reports malformed expressions (unexpanded calls, char literals, ...) with exceptions
+    z3::expr symbolizeExpandedToBoolExprReparsed(const std::vector<PreprocToken> & expandedTokens, const ConstSymbolTablePtr & symbolTable = nullptr)
+    {
         StringBuilder expandedStrBuilder;
-        for (const TSNode & token : expandedTokens)
+        for (const PreprocToken & token : expandedTokens)
         {
-            expandedStrBuilder.append(token.textView());
+            expandedStrBuilder.append(tokenText(token));
             expandedStrBuilder.append(" ");
         }
         std::string expandedStr = expandedStrBuilder.str();
@@ -87,10 +185,104 @@ public:
         auto [exprTree, exprNode] = parseIntoExpression(expandedStr);
         if (!exprNode) return ctx->bool_val(false);
         // Symbolize the expression
-        return int2bool(symbolizeExpression(exprNode));
+        return int2bool(symbolizeExpression(exprNode, symbolTable));
+    }
+
+    // Evaluate an expanded expression with intmax_t/uintmax_t semantics, without z3.
+    // Returns nullopt if it has symbolic atoms (identifiers, leftover defined), or anything the
+    // evaluator does not decide on its own (malformed input, division by zero, out-of-range shifts);
+    // such expressions go through symbolization instead.
+    std::optional<bool> evaluateConstant(const std::vector<PreprocToken> & expandedTokens) const
+    {
+        // Same semantics as symbolizeExpression in the expander's encoding, so both paths decide alike
+        std::optional<ConstantValue> value;
+        if (encoding == IntEncoding::BitVector64)
+        {
+            BitVector64ConstantSemantics semantics;
+            value = TokenExpressionParser<BitVector64ConstantSemantics>{expandedTokens, interner, semantics}.parseAll();
+        }
+        else
+        {
+            IntConstantSemantics semantics{BIT_WIDTH};
+            value = TokenExpressionParser<IntConstantSemantics>{expandedTokens, interner, semantics}.parseAll();
+        }
+        if (!value) return std::nullopt;
+        return value->bits != 0;
     }
 
-    std::vector<TSNode> expandPreprocTokens(const std::vector<TSNode> & tokens, const ConstSymbolTablePtr & baseSymbolTable)
+    // Intern tree-sitter tokens for expansion
+    std::vector<PreprocToken> internTokens(const std::vector<TSNode> & tokens)
+    {
+        std::vector<PreprocToken> interned;
+        interned.reserve(tokens.size());
+        for (const TSNode & token : tokens)
+        {
+            interned.push_back(interner.token(lang, token));
+        }
+        return interned;
+    }
+
+    // Interned tokens of a macro body, computed once per body.
+    // In a function-like macro body, identifiers naming a parameter become Kind::Parameter tokens.
+    // SymbolicExecutor calls this when it executes the #define, so expansion finds bodies ready.
+    const std::vector<PreprocToken> & internBody(const TSNode & body, const std::vector<std::string> & params = {})
+    {
+        static const std::vector<PreprocToken> emptyBody;
+        if (!body) return emptyBody;
+        auto [it, inserted] = internedBodies.try_emplace(body);
+        std::vector<PreprocToken> & interned = it->second;
+        if (!inserted) return interned;
+        for (const TSNode & node : body.iterateChildren())
+        {
+            PreprocToken token = interner.token(lang, node);
+            if (token.kind == PreprocToken::Kind::Identifier)
+            {
+                auto param = std::ranges::find(params, node.textView());
+                if (param != params.end())
+                {
+                    token.kind = PreprocToken::Kind::Parameter;
+                    token.param = static_cast<std::uint16_t>(param - params.begin());
+                }
+            }
+            interned.push_back(token);
+        }
+        return interned;
+    }
+
+    std::string_view tokenText(const PreprocToken & token) const
+    {
+        return interner.text(token.id);
+    }
+
+    std::vector<PreprocToken> expandPreprocTokens(const std::vector<TSNode> & tokens, const ConstSymbolTablePtr & baseSymbolTable)
+    {
+        return expandPreprocTokens(internTokens(tokens), baseSymbolTable);
+    }
+
+    std::vector<PreprocToken> expandPreprocTokens(const std::vector<PreprocToken> & tokens, const ConstSymbolTablePtr & baseSymbolTable)
+    {
+        bool openEnded = false;
+        return expandTokens(tokens, baseSymbolTable, "", openEnded);
+    }
+
+    // Memos of object-like macro expansions and of collectNestedExpansionDefinitions
+    // An object-like expansion is memoized as nullopt if it cannot be used out of context
+    DefinitionMemo<std::optional<std::vector<PreprocToken>>> objectExpansionMemo;
+    DefinitionMemo<std::vector<ProgramPoint>> nestedDefinitionMemo;
+    // Whether expansion consults the memos above; turned off to check memoized results against plain ones
+    bool useMemos = true;
+
+private:
+    // Expand tokens as if they were the body of macro expandedName (none if empty).
+    // openEnded is set if the result could change with tokens that follow: it ends in a function-like
+    // macro name or a defined that ran out of tokens.
+    std::vector<PreprocToken> expandTokens
+    (
+        const std::vector<PreprocToken> & tokens,
+        const ConstSymbolTablePtr & baseSymbolTable,
+        std::string_view expandedName,
+        bool & openEnded
+    )
     {
         // We process the flat token stream using a stack
         // Tokens are pushed into the stack in reverse order, so tokens on the left are at the top of the stack
@@ -109,6 +301,7 @@ public:
         //         if not found any parenthesis: leave as is (according to the GCC manual)
         //         if parenthesis are not balanced: error
         //     if undefined: replace with 0
+        //     if guarded: leave as is, symbolizeExpression turns it into an ite over its alternatives
         //     if expanded: error
         //         In theory, this should just be left as is, but putting an unexpanded macro in an #if later will cause an error
         //         And, symbolizing it will be a mistake, because -D-ing it will not change its value
@@ -120,6 +313,7 @@ public:
         //         an identifier: look up in the symbol table
         //             if defined as ObjectSymbol: replace with 1
         //             if defined as FunctionSymbol: replace with 1
+        //             if guarded: replace with 1
         //             if undefined: replace with 0
         //             if expanded: replace with 1
         //             if unknown: leave as is, it will be turned into a symbolic value
@@ -129,16 +323,16 @@ public:
 
         // Core stack
         // (token, shouldPopUndefStackAfterThisToken)
-        std::vector<std::pair<TSNode, bool>> stack;
+        std::vector<std::pair<PreprocToken, bool>> stack;
 
         // Undef stack symbol table
         UndefStackSymbolTable symbolTable(baseSymbolTable);
 
         // Output buffer
-        std::vector<TSNode> buffer;
+        std::vector<PreprocToken> buffer;
 
         // Push the tokens into the stack in reverse order
-        auto pushTokensAndUndef = [this, &stack, &symbolTable](const std::vector<TSNode> & tokens, std::string_view name = "")
+        auto pushTokensAndUndef = [&stack, &symbolTable](const std::vector<PreprocToken> & tokens, std::string_view name = "")
         {
             bool undefBit = false;
             if (!name.empty())
@@ -153,38 +347,17 @@ public:
             }
         };
 
-        auto pushTokensNodeAndUndef = [this, &stack, &symbolTable](const TSNode & tokens, std::string_view name = "")
-        {
-            bool undefBit = false;
-            if (!name.empty())
-            {
-                symbolTable.pushExpanded(name);
-                undefBit = true;
-            }
-            for (const auto & token : tokens.iterateChildren() | std::views::reverse)
-            {
-                stack.emplace_back(token, undefBit);
-                undefBit = false;
-            }
-        };
-
         // Push the tokens into the stack
-        pushTokensAndUndef(tokens);
+        pushTokensAndUndef(tokens, expandedName);
 
         while (!stack.empty())
         {
-            std::string stackStr;
-            for (const auto & [token, shouldPopUndef] : stack | std::views::reverse)
-            {
-                stackStr += token.textView();
-                stackStr += " ";
-            }
             auto [token, shouldPopUndef] = stack.back();
             stack.pop_back();
 
-            if (token.isSymbol(lang.identifier_s))
+            if (token.kind == PreprocToken::Kind::Identifier)
             {
-                std::string_view name = token.textView();
+                std::string_view name = interner.text(token.id);
                 std::optional<Hayroll::Symbol> symbol = symbolTable.lookup(name);
 
                 if (symbol.has_value())
@@ -203,7 +376,16 @@ public:
                         // Object-like macro, push its tokens into the stack
                         const ObjectSymbol & objSymbol = std::get<ObjectSymbol>(sym);
                         const TSNode & body = objSymbol.body;
-                        if (body) pushTokensNodeAndUndef(body, name);
+                        if (body)
+                        {
+                            // Outside of other expansions, the body expands the same way every time under
+                            // this table, so a self-contained expansion is taken from the memo
+                            const std::optional<std::vector<PreprocToken>> * memoized = useMemos && symbolTable.depth() == 0
+                                ? &expandObjectLikeMemoized(objSymbol, name, baseSymbolTable)
+                                : nullptr;
+                            if (memoized && *memoized) buffer.insert(buffer.end(), (*memoized)->begin(), (*memoized)->end());
+                            else pushTokensAndUndef(internBody(body), name);
+                        }
                         // else do nothing, the macro is empty
                     }
                     else if (std::holds_alternative<FunctionSymbol>(sym))
@@ -216,12 +398,13 @@ public:
                         {
                             // Not expanded as a function-like macro, leave as is
                             buffer.push_back(token);
+                            openEnded = true;
                         }
                         else
                         {
                             auto && [token1Peek, shouldPopUndef1Peek] = stack.back();
                             // Just peek, don't pop
-                            if (token1Peek.textView() != "(")
+                            if (token1Peek.kind != PreprocToken::Kind::LeftParen)
                             {
                                 // Not expanded as a function-like macro, leave as is
                                 buffer.push_back(token);
@@ -229,7 +412,7 @@ public:
                             else
                             {
                                 // Find paring parenthesis and extract the arguments
-                                std::vector<std::vector<TSNode>> args;
+                                std::vector<std::vector<PreprocToken>> args;
                                 args.push_back({}); // Ready to push the first argument
                                 size_t parenDepth = 0;
                                 do
@@ -238,17 +421,17 @@ public:
                                     auto [token1, shouldPopUndef1] = stack.back();
                                     stack.pop_back();
                                     // We only care about: "(", ")" (always), and "," (only when parenDepth = 1)
-                                    if (token1.textView() == "(")
+                                    if (token1.kind == PreprocToken::Kind::LeftParen)
                                     {
                                         if (parenDepth != 0) args.back().push_back(token1);
                                         parenDepth++;
                                     }
-                                    else if (token1.textView() == ")")
+                                    else if (token1.kind == PreprocToken::Kind::RightParen)
                                     {
                                         parenDepth--;
                                         if (parenDepth != 0) args.back().push_back(token1);
                                     }
-                                    else if (parenDepth == 1 && token1.textView() == ",")
+                                    else if (parenDepth == 1 && token1.kind == PreprocToken::Kind::Comma)
                                     {
                                         // End of argument, start a new one
                                         args.push_back({});
@@ -278,7 +461,7 @@ public:
                                 // pushed into the stack and re-processed for further expansion possibilities.
                                 // We slacked the self-referencing check by just giving the baseSymbolTable
                                 // to expandFunctionLikeMacro
-                                std::vector<TSNode> expanded = expandFunctionLikeMacro(args, funcSymbol, baseSymbolTable);
+                                std::vector<PreprocToken> expanded = expandFunctionLikeMacro(args, funcSymbol, baseSymbolTable);
                                 
                                 // Push the expanded tokens into the stack
                                 pushTokensAndUndef(expanded, name);
@@ -290,6 +473,11 @@ public:
                         // Undefined macro, replace with 0
                         buffer.push_back(constToken0);
                     }
+                    else if (std::holds_alternative<GuardedSymbol>(sym))
+                    {
+                        // Path-dependent integer, leave as is for symbolizeExpression
+                        buffer.push_back(token);
+                    }
                     else if (std::holds_alternative<ExpandedSymbol>(sym))
                     {
                         if (shouldPopUndef) symbolTable.pop();
@@ -308,7 +496,7 @@ public:
                     buffer.push_back(token);
                 }
             }
-            else if (token.isSymbol(lang.preproc_defined_literal_s))
+            else if (token.kind == PreprocToken::Kind::Defined)
             {
                 // We will never need to lookup the preproc_defined_literal symbol
                 if (shouldPopUndef) symbolTable.pop();
@@ -316,6 +504,7 @@ public:
                 {
                     // Not expanded, leave as is
                     buffer.push_back(token);
+                    openEnded = true;
                 }
                 else
                 {
@@ -323,16 +512,16 @@ public:
                     stack.pop_back();
 
                     auto handleIdentifier = 
-                    [this, &buffer, &symbolTable, token = std::move(token)]
-                    (const TSNode & tokenX, bool shouldPopUndefX, const std::optional<const TSNode *> leftParenthesis = std::nullopt) -> bool
+                    [this, &buffer, &symbolTable, token]
+                    (const PreprocToken & tokenX, bool shouldPopUndefX, const std::optional<const PreprocToken *> leftParenthesis = std::nullopt) -> bool
                     {
                         bool replaced = false;
-                        std::string_view name = tokenX.textView();
+                        std::string_view name = interner.text(tokenX.id);
                         std::optional<Hayroll::Symbol> symbol = symbolTable.lookup(name);
                         if (symbol.has_value())
                         {
                             const Symbol & sym = *symbol;
-                            if (std::holds_alternative<ObjectSymbol>(sym) || std::holds_alternative<FunctionSymbol>(sym) || std::holds_alternative<ExpandedSymbol>(sym))
+                            if (std::holds_alternative<ObjectSymbol>(sym) || std::holds_alternative<FunctionSymbol>(sym) || std::holds_alternative<ExpandedSymbol>(sym) || std::holds_alternative<GuardedSymbol>(sym))
                             {
                                 buffer.push_back(constToken1);
                             }
@@ -359,11 +548,11 @@ public:
                         return replaced;
                     };
                     
-                    if (token1.isSymbol(lang.identifier_s))
+                    if (token1.kind == PreprocToken::Kind::Identifier)
                     {
                         handleIdentifier(token1, shouldPopUndef1);
                     }
-                    else if (token1.textView() == "(")
+                    else if (token1.kind == PreprocToken::Kind::LeftParen)
                     {
                         // We will never need to lookup a parenthesis symbol
                         if (shouldPopUndef1) symbolTable.pop();
@@ -371,13 +560,14 @@ public:
                         if (stack.empty())
                         {
                             // Not expanded, leave as is
+                            openEnded = true;
                         }
                         else
                         {
                             auto && [token2, shouldPopUndef2] = stack.back();
                             stack.pop_back();
                             bool replaced = false;
-                            if (token2.isSymbol(lang.identifier_s))
+                            if (token2.kind == PreprocToken::Kind::Identifier)
                             {
                                 replaced = handleIdentifier(token2, shouldPopUndef2, &token1);
                             }
@@ -395,7 +585,7 @@ public:
                             auto && [token3, shouldPopUndef3] = stack.back();
                             stack.pop_back();
                             
-                            if (token3.textView() != ")")
+                            if (token3.kind != PreprocToken::Kind::RightParen)
                             {
                                 throw std::runtime_error(std::format("Unbalanced parenthesis in preproc_defined_literal"));
                             }
@@ -422,25 +612,69 @@ public:
         return buffer;
     }
 
+    const std::optional<std::vector<PreprocToken>> & expandObjectLikeMemoized
+    (
+        const ObjectSymbol & symbol,
+        std::string_view name,
+        const ConstSymbolTablePtr & symbolTable
+    )
+    {
+        if (const auto * memoized = objectExpansionMemo.find(symbol.def, name, symbolTable)) return *memoized;
+        std::optional<std::vector<PreprocToken>> expansion;
+        try
+        {
+            bool openEnded = false;
+            std::vector<PreprocToken> tokens = expandTokens(internBody(symbol.body), symbolTable, name, openEnded);
+            if (!openEnded) expansion = std::move(tokens);
+        }
+        catch (const std::runtime_error &)
+        {
+            // Left to the in-place expansion, which reports the error in context
+        }
+        return objectExpansionMemo.insert(symbol.def, name, symbolTable, std::move(expansion));
+    }
+
+public:
+
     // Collect all definitons used for a nested expansion.
     // Used to make sure our premise collection for multi-defined macro expansion is correct.
+    // Memoized per (definition of the token, symbol table).
     std::vector<ProgramPoint> collectNestedExpansionDefinitions
     (
         const TSNode & token,
         const ConstSymbolTablePtr & symbolTable
     )
+    {
+        std::string_view name = token.textView();
+        std::optional<Hayroll::Symbol> symbol = symbolTable->lookup(name);
+        if (!useMemos || !symbol || !(std::holds_alternative<ObjectSymbol>(*symbol) || std::holds_alternative<FunctionSymbol>(*symbol)))
+        {
+            return collectNestedExpansionDefinitionsUncached(token, symbolTable);
+        }
+        const ProgramPoint & def = symbolProgramPoint(*symbol);
+        name = symbolName(*symbol); // Owned by the definition's tree, unlike the token's text
+        if (const auto * memoized = nestedDefinitionMemo.find(def, name, symbolTable)) return *memoized;
+        return nestedDefinitionMemo.insert(def, name, symbolTable, collectNestedExpansionDefinitionsUncached(token, symbolTable));
+    }
+
+    std::vector<ProgramPoint> collectNestedExpansionDefinitionsUncached
+    (
+        const TSNode & token,
+        const ConstSymbolTablePtr & symbolTable
+    )
     {
         std::vector<ProgramPoint> collection;
-        std::vector<TSNode> workList = {token};
+        std::vector<PreprocToken> workList = {interner.token(lang, token)};
 
         while (!workList.empty())
         {
-            TSNode current = workList.back();
+            PreprocToken current = workList.back();
             workList.pop_back();
 
-            if (!current.isSymbol(lang.identifier_s)) continue;
+            // Parameter names are looked up too, as if the body were not a function-like one
+            if (current.kind != PreprocToken::Kind::Identifier && current.kind != PreprocToken::Kind::Parameter) continue;
 
-            std::optional<Hayroll::Symbol> symbol = symbolTable->lookup(current.textView());
+            std::optional<Hayroll::Symbol> symbol = symbolTable->lookup(interner.text(current.id));
             if (symbol.has_value())
             {
                 const Symbol & sym = *symbol;
@@ -453,18 +687,14 @@ public:
                         continue;
                     }
                     collection.push_back(std::move(defProgramPoint));
-                    const TSNode & body = symbolBody(sym);
-                    if (body)
-                    {
-                        for (const TSNode & token : body.iterateChildren())
-                        {
-                            workList.push_back(token);
-                        }
-                    }
+                    const std::vector<PreprocToken> & body = std::holds_alternative<FunctionSymbol>(sym)
+                        ? internBody(std::get<FunctionSymbol>(sym).body, std::get<FunctionSymbol>(sym).params)
+                        : internBody(std::get<ObjectSymbol>(sym).body);
+                    workList.insert(workList.end(), body.begin(), body.end());
                 }
-                else if (std::holds_alternative<UndefinedSymbol>(sym))
+                else if (std::holds_alternative<UndefinedSymbol>(sym) || std::holds_alternative<GuardedSymbol>(sym))
                 {
-                    // Do nothing, undefined symbols do not have a body
+                    // Do nothing, undefined and guarded symbols do not have a body
                 }
                 else assert(false);
             }
@@ -473,9 +703,9 @@ public:
         return collection;
     }
 
-    std::vector<TSNode> expandFunctionLikeMacro
+    std::vector<PreprocToken> expandFunctionLikeMacro
     (
-        const std::vector<std::vector<TSNode>> & args,
+        const std::vector<std::vector<PreprocToken>> & args,
         const FunctionSymbol & funcSymbol,
         const ConstSymbolTablePtr symbolTable
     )
@@ -486,35 +716,24 @@ public:
             throw std::runtime_error(std::format("Function-like macro {} called with {} arguments, expected {}", funcSymbol.name, args.size(), funcSymbol.params.size()));
         }
 
-        // Expand the arguments w.r.t. the symbol table, and store them in a new symbol table
-        std::unordered_map<std::string, std::vector<TSNode>, TransparentStringHash, TransparentStringEqual> argTable;
-        for (size_t i = 0; i < args.size(); i++)
+        // Expand the arguments w.r.t. the symbol table
+        // The interned body refers to them by parameter index
+        std::vector<std::vector<PreprocToken>> expandedArgs;
+        expandedArgs.reserve(args.size());
+        for (const std::vector<PreprocToken> & arg : args)
         {
-            const std::vector<TSNode> & arg = args[i];
-            argTable[funcSymbol.params[i]] = expandPreprocTokens(arg, symbolTable);
+            expandedArgs.push_back(expandPreprocTokens(arg, symbolTable));
         }
-        // Make sure all arg names are unique
-        assert(argTable.size() == args.size());
 
-        std::vector<TSNode> buffer;
+        std::vector<PreprocToken> buffer;
         // Expand the function-like macro body
-        for (const TSNode & token : funcSymbol.body.iterateChildren())
+        for (const PreprocToken & token : internBody(funcSymbol.body, funcSymbol.params))
         {
-            if (token.isSymbol(lang.identifier_s))
+            if (token.kind == PreprocToken::Kind::Parameter)
             {
-                std::string_view name = token.textView();
-                auto it = argTable.find(name);
-                if (it != argTable.end())
-                {
-                    // Found an argument, push its tokens into the buffer
-                    const std::vector<TSNode> & arg = it->second;
-                    buffer.insert(buffer.end(), arg.begin(), arg.end());
-                }
-                else
-                {
-                    // Not an argument, just append the token
-                    buffer.push_back(token);
-                }
+                // Found an argument, push its tokens into the buffer
+                const std::vector<PreprocToken> & arg = expandedArgs[token.param];
+                buffer.insert(buffer.end(), arg.begin(), arg.end());
             }
             else
             {
@@ -526,9 +745,9 @@ public:
         // Print the expanded function-like macro for debugging
         #if DEBUG
             std::string expandedMacro;
-            for (const TSNode & token : buffer)
+            for (const PreprocToken & token : buffer)
             {
-                expandedMacro += token.text() + " ";
+                expandedMacro += std::string(tokenText(token)) + " ";
             }
         #endif
 
@@ -537,8 +756,241 @@ public:
 
     // Symbolize all identifiers in a preprocessor expression node
     // The expression must have been expanded and parsed with parseIntoExpression
-    // This function will not lookup the symbol table, it assumes that known symbols are already replaced
-    z3::expr symbolizeExpression(const TSNode & node)
+    // Known symbols are assumed to be already replaced; the symbol table is only consulted for
+    // GuardedSymbols, which become ite terms over their alternatives
+    z3::expr symbolizeExpression(const TSNode & node, const ConstSymbolTablePtr & symbolTable = nullptr)
+    {
+        return symbolizeNode(node, symbolTable).expr;
+    }
+
+    // A preprocessor value: its encoding in z3, and whether C gives it an unsigned type (uintmax_t)
+    // The flag is only tracked in the BitVector64 encoding
+    struct Value
+    {
+        z3::expr expr;
+        bool isUnsigned;
+    };
+
+    // The value of an integer literal in the current encoding
+    // A literal is unsigned if it has a u/U suffix or does not fit in intmax_t
+    Value symbolizeIntegerLiteral(std::string_view spelling)
+    {
+        std::string numberString = parseIntegerLiteralToDecimal(spelling);
+        if (encoding == IntEncoding::Int) return {ctx->int_val(numberString.c_str()), false};
+
+        const std::string_view int64Max = "9223372036854775807";
+        bool isUnsigned = spelling.find_first_of("uU") != std::string_view::npos;
+        if (!numberString.starts_with('-'))
+        {
+            isUnsigned = isUnsigned || numberString.size() > int64Max.size()
+                || (numberString.size() == int64Max.size() && std::string_view(numberString) > int64Max);
+            return {ctx->bv_val(numberString.c_str(), 64), isUnsigned};
+        }
+        return {-ctx->bv_val(numberString.substr(1).c_str(), 64), isUnsigned};
+    }
+
+    // | Symbolic Expr | Evaluation                  |
+    // | A             | defA? valA : 0              |
+    // | G (guarded)   | g1? v1 : g2? v2 : ... : vn  |
+    Value symbolizeIdentifier(std::string_view name, const ConstSymbolTablePtr & symbolTable)
+    {
+        if (symbolTable)
+        {
+            std::optional<Symbol> symbol = symbolTable->lookup(name);
+            if (symbol && std::holds_alternative<GuardedSymbol>(*symbol))
+            {
+                const std::vector<std::pair<z3::expr, z3::expr>> & alternatives = std::get<GuardedSymbol>(*symbol).alternatives;
+                assert(!alternatives.empty());
+                z3::expr guardedExpr = alternatives.back().second;
+                for (std::size_t i = alternatives.size() - 1; i-- > 0;)
+                {
+                    guardedExpr = z3::ite(alternatives[i].first, alternatives[i].second, guardedExpr);
+                }
+                return {guardedExpr, false};
+            }
+        }
+
+        // Any other symbol at this time will be treated as a symbolic value
+        std::string defName = std::format("def{}", name);
+        std::string valName = std::format("val{}", name);
+
+        z3::expr def = ctx->bool_const(defName.c_str());
+        z3::expr val = encoding == IntEncoding::BitVector64 ? ctx->bv_const(valName.c_str(), 64) : ctx->int_const(valName.c_str());
+        return {z3::ite(def, val, constExpr0), false};
+    }
+
+    // | Symbolic Expr | Evaluation     |
+    // | defined A     | defA? 1 : 0    |
+    Value symbolizeDefined(std::string_view name)
+    {
+        std::string defName = std::format("def{}", name);
+        return {bool2int(ctx->bool_const(defName.c_str())), false};
+    }
+
+    // Z(!, not)
+    // Z(~, bnot)
+    // Z(-, neg)
+    // Z(+, pos)
+    Value symbolizeUnary(std::string_view op, const Value & arg)
+    {
+        const z3::expr & a = arg.expr;
+        if (op == lang.unary_expression_s.not_o) return {bool2int(!int2bool(a)), false};
+        else if (op == lang.unary_expression_s.bnot_o)
+        {
+            if (encoding == IntEncoding::BitVector64) return {~a, arg.isUnsigned};
+            return {z3::bv2int(~z3::int2bv(BIT_WIDTH, a), true), false};
+        }
+        else if (op == lang.unary_expression_s.neg_o) return {-a, arg.isUnsigned};
+        else if (op == lang.unary_expression_s.pos_o) return arg;
+        else throw std::runtime_error(std::format("Unexpected unary operator {}", op));
+    }
+
+    // Z(+, add) Z(-, sub) Z(*, mul) Z(/, div) Z(%, mod)
+    // Z(||, or) Z(&&, and) Z(|, bor) Z(^, bxor) Z(&, band)
+    // Z(==, eq) Z(!=, neq) Z(>, gt) Z(>=, ge) Z(<=, le) Z(<, lt)
+    // Z(<<, lsh) Z(>>, rsh)
+    // In the Int encoding, bitwise operators and shifts go through BIT_WIDTH-bit vectors.
+    // In the BitVector64 encoding, the usual arithmetic conversions pick signed or unsigned operators,
+    // and shifts take the type of the left operand.
+    Value symbolizeBinary(std::string_view op, const Value & left, const Value & right)
+    {
+        const auto & ops = lang.binary_expression_s;
+        const z3::expr & l = left.expr;
+        const z3::expr & r = right.expr;
+
+        if (op == ops.or_o) return {bool2int(int2bool(l) || int2bool(r)), false};
+        if (op == ops.and_o) return {bool2int(int2bool(l) && int2bool(r)), false};
+        if (op == ops.eq_o) return {bool2int(l == r), false};
+        if (op == ops.neq_o) return {bool2int(l != r), false};
+
+        if (encoding == IntEncoding::Int)
+        {
+            auto bitwise = [](const z3::expr & bv) { return z3::bv2int(bv, true); };
+            if (op == ops.add_o) return {l + r, false};
+            else if (op == ops.sub_o) return {l - r, false};
+            else if (op == ops.mul_o) return {l * r, false};
+            else if (op == ops.div_o) return {l / r, false};
+            else if (op == ops.mod_o) return {l % r, false};
+            else if (op == ops.bor_o) return {bitwise(z3::int2bv(BIT_WIDTH, l) | z3::int2bv(BIT_WIDTH, r)), false};
+            else if (op == ops.bxor_o) return {bitwise(z3::int2bv(BIT_WIDTH, l) ^ z3::int2bv(BIT_WIDTH, r)), false};
+            else if (op == ops.band_o) return {bitwise(z3::int2bv(BIT_WIDTH, l) & z3::int2bv(BIT_WIDTH, r)), false};
+            else if (op == ops.gt_o) return {bool2int(l > r), false};
+            else if (op == ops.ge_o) return {bool2int(l >= r), false};
+            else if (op == ops.le_o) return {bool2int(l <= r), false};
+            else if (op == ops.lt_o) return {bool2int(l < r), false};
+            else if (op == ops.lsh_o) return {bitwise(z3::shl(z3::int2bv(BIT_WIDTH, l), z3::int2bv(BIT_WIDTH, r))), false};
+            else if (op == ops.rsh_o) return {bitwise(z3::ashr(z3::int2bv(BIT_WIDTH, l), z3::int2bv(BIT_WIDTH, r))), false};
+        }
+        else
+        {
+            // Usual arithmetic conversions: unsigned if either side is
+            const bool u = left.isUnsigned || right.isUnsigned;
+            if (op == ops.add_o) return {l + r, u};
+            else if (op == ops.sub_o) return {l - r, u};
+            else if (op == ops.mul_o) return {l * r, u};
+            else if (op == ops.div_o) return {u ? z3::udiv(l, r) : l / r, u};
+            else if (op == ops.mod_o) return {u ? z3::urem(l, r) : z3::srem(l, r), u};
+            else if (op == ops.bor_o) return {l | r, u};
+            else if (op == ops.bxor_o) return {l ^ r, u};
+            else if (op == ops.band_o) return {l & r, u};
+            else if (op == ops.gt_o) return {bool2int(u ? z3::ugt(l, r) : l > r), false};
+            else if (op == ops.ge_o) return {bool2int(u ? z3::uge(l, r) : l >= r), false};
+            else if (op == ops.le_o) return {bool2int(u ? z3::ule(l, r) : l <= r), false};
+            else if (op == ops.lt_o) return {bool2int(u ? z3::ult(l, r) : l < r), false};
+            else if (op == ops.lsh_o) return {z3::shl(l, r), left.isUnsigned};
+            else if (op == ops.rsh_o) return {left.isUnsigned ? z3::lshr(l, r) : z3::ashr(l, r), left.isUnsigned};
+        }
+        throw std::runtime_error(std::format("Unexpected binary operator {}", op));
+    }
+
+    Value symbolizeConditional(const Value & cond, const Value & trueValue, const Value & falseValue)
+    {
+        return {z3::ite(int2bool(cond.expr), trueValue.expr, falseValue.expr), trueValue.isUnsigned || falseValue.isUnsigned};
+    }
+
+    // The integer value of a macro body that is a single integer literal, e.g. the 64 in #define BUFSZ 64
+    // Returns nullopt for any other body
+    std::optional<z3::expr> symbolizeIntegerConstantBody(const TSNode & body)
+    {
+        if (!body || body.childCount() != 1) return std::nullopt;
+        TSNode token = body.child(0);
+        if (!token.isSymbol(lang.number_literal_s)) return std::nullopt;
+        try
+        {
+            return symbolizeIntegerLiteral(token.textView()).expr;
+        }
+        catch (const std::runtime_error &)
+        {
+            // Floating-point or malformed literal
+            return std::nullopt;
+        }
+    }
+
+    IntEncoding getEncoding() const
+    {
+        return encoding;
+    }
+
+    z3::expr int2bool(const z3::expr & expr)
+    {
+        assert(encoding == IntEncoding::BitVector64 ? expr.is_bv() : expr.is_int());
+        return z3::ite(expr != constExpr0, ctx->bool_val(true), ctx->bool_val(false));
+    }
+
+    z3::expr bool2int(const z3::expr & expr)
+    {
+        assert(expr.is_bool());
+        return z3::ite(expr, constExpr1, constExpr0);
+    }
+
+    // Parse a string into preprocessor tokens
+    // Returns (tree, tokens)
+    std::tuple<TSTree, TSNode> parseIntoPreprocTokens(std::string_view source)
+    {
+        if (source.empty()) return { TSTree(), TSNode() };
+        std::string ifSource = std::format("#if {}\n#endif\n", source);
+        TSTree tree = parser.parseString(std::move(ifSource));
+        TSNode root = tree.rootNode(); // translation_unit
+        TSNode tokens = root.firstChildForByte(0).childByFieldId(lang.preproc_if_s.condition_f);
+        assert(tokens.isSymbol(lang.preproc_tokens_s));
+        return { std::move(tree), std::move(tokens) };
+    }
+
+    // Parse a string into a preprocessor expression
+    // Returns (tree, expr)
+    std::tuple<TSTree, TSNode> parseIntoExpression(std::string_view source)
+    {
+        if (source.empty()) return { TSTree(), TSNode() };
+        std::string evalSource = std::format("#eval {}\n#endeval\n", source);
+        TSTree tree = parser.parseString(std::move(evalSource));
+        TSNode root = tree.rootNode(); // translation_unit
+        TSNode expr = root.firstChildForByte(0).childByFieldId(lang.preproc_eval_s.expr_f);
+        return { std::move(tree), std::move(expr) };
+    }
+
+private:
+    const CPreproc lang;
+    TSParser parser;
+
+    std::vector<PreprocToken> expandWithPrepend(const std::vector<TSNode> & tokens, const ConstSymbolTablePtr & symbolTable, Prepend prepend)
+    {
+        std::vector<PreprocToken> interned = internTokens(tokens);
+        switch (prepend)
+        {
+            case Prepend::None:
+                break;
+            case Prepend::Defined:
+                interned.insert(interned.begin(), constTokenDefined);
+                break;
+            case Prepend::NotDefined:
+                interned.insert(interned.begin(), {constTokenNot, constTokenDefined});
+                break;
+        }
+        return expandPreprocTokens(interned, symbolTable);
+    }
+
+    // Tree walker behind symbolizeExpression
+    Value symbolizeNode(const TSNode & node, const ConstSymbolTablePtr & symbolTable)
     {
         // All possible expression kinds
         //     identifier,
@@ -551,24 +1003,9 @@ public:
         //     parenthesized_expression
         //     conditional_expression
 
-        // | Symbolic Expr | Evaluation     |
-        // | defined A     | defA? 1 : 0    |
-        // | A             | defA? valA : 0 |
-
         if (node.isSymbol(lang.identifier_s))
         {
-            // Do not look up the symbol in the symbol table
-            // Any symbol at this time will be treated as a symbolic value
-            std::string_view name = node.textView();
-            std::string defName = std::format("def{}", name);
-            std::string valName = std::format("val{}", name);
-
-            z3::expr def = ctx->bool_const(defName.c_str());
-            z3::expr val = ctx->int_const(valName.c_str());
-
-            // Create the expression
-            z3::expr iteExpr = z3::ite(def, val, constExpr0);
-            return iteExpr;
+            return symbolizeIdentifier(node.textView(), symbolTable);
         }
         else if (node.isSymbol(lang.call_expression_s))
         {
@@ -577,10 +1014,7 @@ public:
         }
         else if (node.isSymbol(lang.number_literal_s))
         {
-            std::string spelling = node.text();
-            std::string numberString = parseIntegerLiteralToDecimal(spelling);
-            z3::expr val = ctx->int_val(numberString.c_str());
-            return val;
+            return symbolizeIntegerLiteral(node.textView());
         }
         else if (node.isSymbol(lang.char_literal_s))
         {
@@ -588,245 +1022,430 @@ public:
         }
         else if (node.isSymbol(lang.preproc_defined_s))
         {
-            // | Symbolic Expr | Evaluation     |
-            // | defined A     | defA? 1 : 0    |
-
             TSNode idNode = node.childByFieldId(lang.preproc_defined_s.name_f);
             assert(idNode.isSymbol(lang.identifier_s));
-            std::string_view name = idNode.textView();
-            std::string defName = std::format("def{}", name);
-
-            z3::expr def = ctx->bool_const(defName.c_str());
-            z3::expr defExpr = bool2int(def);
-            return defExpr;
+            return symbolizeDefined(idNode.textView());
         }
         else if (node.isSymbol(lang.unary_expression_s))
         {
-            // Z(!, not)
-            // Z(~, bnot)
-            // Z(-, neg)
-            // Z(+, pos)
-
             TSNode opNode = node.childByFieldId(lang.unary_expression_s.operator_f);
             TSNode argNode = node.childByFieldId(lang.unary_expression_s.argument_f);
-            z3::expr arg = symbolizeExpression(argNode);
-            if (opNode.textView() == lang.unary_expression_s.not_o)
-            {
-                z3::expr notExpr = bool2int(!int2bool(arg));
-                return notExpr;
-            }
-            else if (opNode.textView() == lang.unary_expression_s.bnot_o)
-            {
-                // bitwise not
-                z3::expr bnotExpr = z3::bv2int(~z3::int2bv(BIT_WIDTH, arg), true);
-                return bnotExpr;
-            }
-            else if (opNode.textView() == lang.unary_expression_s.neg_o)
-            {
-                z3::expr negExpr = -arg;
-                return negExpr;
-            }
-            else if (opNode.textView() == lang.unary_expression_s.pos_o)
-            {
-                return arg;
-            }
-            else assert(false);
+            return symbolizeUnary(opNode.textView(), symbolizeNode(argNode, symbolTable));
         }
         else if (node.isSymbol(lang.binary_expression_s))
         {
-            // Z(+, add)
-            // Z(-, sub)
-            // Z(*, mul)
-            // Z(/, div)
-            // Z(%, mod)
-            // Z(||, or)
-            // Z(&&, and)
-            // Z(|, bor)
-            // Z(^, bxor)
-            // Z(&, band)
-            // Z(==, eq)
-            // Z(!=, neq)
-            // Z(>, gt)
-            // Z(>=, ge)
-            // Z(<=, le)
-            // Z(<, lt)
-            // Z(<<, lsh)
-            // Z(>>, rsh)
-
             TSNode opNode = node.childByFieldId(lang.binary_expression_s.operator_f);
-            TSNode leftNode = node.childByFieldId(lang.binary_expression_s.left_f);
-            TSNode rightNode = node.childByFieldId(lang.binary_expression_s.right_f);
+            Value left = symbolizeNode(node.childByFieldId(lang.binary_expression_s.left_f), symbolTable);
+            Value right = symbolizeNode(node.childByFieldId(lang.binary_expression_s.right_f), symbolTable);
+            return symbolizeBinary(opNode.textView(), left, right);
+        }
+        else if (node.isSymbol(lang.parenthesized_expression_s))
+        {
+            // Parenthesized expression, just return the inner expression
+            return symbolizeNode(node.childByFieldId(lang.parenthesized_expression_s.expr_f), symbolTable);
+        }
+        else if (node.isSymbol(lang.conditional_expression_s))
+        {
+            Value cond = symbolizeNode(node.childByFieldId(lang.conditional_expression_s.condition_f), symbolTable);
+            Value trueValue = symbolizeNode(node.childByFieldId(lang.conditional_expression_s.consequence_f), symbolTable);
+            Value falseValue = symbolizeNode(node.childByFieldId(lang.conditional_expression_s.alternative_f), symbolTable);
+            return symbolizeConditional(cond, trueValue, falseValue);
+        }
+        else throw std::runtime_error(std::format("Unexpected node {} while symbolizing expression {}", node.type(), node.textView()));
+    }
 
-            z3::expr left = symbolizeExpression(leftNode);
-            z3::expr right = symbolizeExpression(rightNode);
+    // A concrete preprocessor value: its 64 bits, and whether it is uintmax_t rather than intmax_t
+    struct ConstantValue
+    {
+        std::uint64_t bits;
+        bool isUnsigned;
+    };
 
-            if (opNode.textView() == lang.binary_expression_s.add_o)
-            {
-                z3::expr addExpr = left + right;
-                return addExpr;
-            }
-            else if (opNode.textView() == lang.binary_expression_s.sub_o)
+    // Pratt parser over the texts of expanded tokens, with C's #if operator precedence.
+    // What a value is comes from Semantics, which provides literal, identifier, defined, unary, binary
+    // and conditional, each returning std::optional<Semantics::Result>.
+    // Any nullopt from Semantics, and any malformed input, yields nullopt for the whole expression.
+    template <typename Semantics>
+    struct TokenExpressionParser
+    {
+        using Result = typename Semantics::Result;
+
+        const std::vector<PreprocToken> & tokens;
+        const TokenInterner & interner;
+        Semantics & semantics;
+        std::size_t pos = 0;
+
+        // Parse the whole token stream as one expression
+        std::optional<Result> parseAll()
+        {
+            std::optional<Result> result = parse(0);
+            if (!result || pos != tokens.size()) return std::nullopt;
+            return result;
+        }
+
+        std::string_view peek() const
+        {
+            return pos < tokens.size() ? interner.text(tokens[pos].id) : std::string_view{};
+        }
+
+        // Binding power of a binary operator, 0 if the token is not one
+        static int precedence(std::string_view op)
+        {
+            if (op == "*" || op == "/" || op == "%") return 10;
+            if (op == "+" || op == "-") return 9;
+            if (op == "<<" || op == ">>") return 8;
+            if (op == "<" || op == "<=" || op == ">" || op == ">=") return 7;
+            if (op == "==" || op == "!=") return 6;
+            if (op == "&") return 5;
+            if (op == "^") return 4;
+            if (op == "|") return 3;
+            if (op == "&&") return 2;
+            if (op == "||") return 1;
+            return 0;
+        }
+
+        static bool isIdentifierStart(char c)
+        {
+            return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+        }
+
+        std::optional<Result> parse(int minPrecedence)
+        {
+            std::optional<Result> left = parseUnary();
+            if (!left) return std::nullopt;
+            while (true)
             {
-                z3::expr subExpr = left - right;
-                return subExpr;
+                std::string_view op = peek();
+                // ?: binds loosest and is right-associative
+                if (op == "?" && minPrecedence == 0)
+                {
+                    ++pos;
+                    std::optional<Result> trueValue = parse(0);
+                    if (!trueValue || peek() != ":") return std::nullopt;
+                    ++pos;
+                    std::optional<Result> falseValue = parse(0);
+                    if (!falseValue) return std::nullopt;
+                    left = semantics.conditional(*left, *trueValue, *falseValue);
+                    if (!left) return std::nullopt;
+                    continue;
+                }
+                int prec = precedence(op);
+                if (prec == 0 || prec < minPrecedence) break;
+                ++pos;
+                std::optional<Result> right = parse(prec + 1);
+                if (!right) return std::nullopt;
+                left = semantics.binary(op, *left, *right);
+                if (!left) return std::nullopt;
             }
-            else if (opNode.textView() == lang.binary_expression_s.mul_o)
+            return left;
+        }
+
+        std::optional<Result> parseUnary()
+        {
+            std::string_view tok = peek();
+            if (tok.empty()) return std::nullopt;
+            if (tok == "!" || tok == "~" || tok == "-" || tok == "+")
             {
-                z3::expr mulExpr = left * right;
-                return mulExpr;
+                ++pos;
+                std::optional<Result> arg = parseUnary();
+                if (!arg) return std::nullopt;
+                return semantics.unary(tok, *arg);
             }
-            else if (opNode.textView() == lang.binary_expression_s.div_o)
+            if (tok == "(")
             {
-                z3::expr divExpr = left / right;
-                return divExpr;
+                ++pos;
+                std::optional<Result> inner = parse(0);
+                if (!inner || peek() != ")") return std::nullopt;
+                ++pos;
+                return inner;
             }
-            else if (opNode.textView() == lang.binary_expression_s.mod_o)
+            if (tok == "defined")
             {
-                z3::expr modExpr = left % right;
-                return modExpr;
+                // defined X or defined ( X )
+                ++pos;
+                const bool parenthesized = peek() == "(";
+                if (parenthesized) ++pos;
+                std::string_view name = peek();
+                if (name.empty() || !isIdentifierStart(name.front())) return std::nullopt;
+                ++pos;
+                if (parenthesized)
+                {
+                    if (peek() != ")") return std::nullopt;
+                    ++pos;
+                }
+                return semantics.defined(name);
             }
-            else if (opNode.textView() == lang.binary_expression_s.or_o)
+            if (std::isdigit(static_cast<unsigned char>(tok.front())))
             {
-                z3::expr orExpr = bool2int(int2bool(left) || int2bool(right));
-                return orExpr;
+                ++pos;
+                return semantics.literal(tok);
             }
-            else if (opNode.textView() == lang.binary_expression_s.and_o)
+            if (isIdentifierStart(tok.front()))
             {
-                z3::expr andExpr = bool2int(int2bool(left) && int2bool(right));
-                return andExpr;
+                ++pos;
+                if (peek() == "(") return std::nullopt; // A call that was not expanded
+                return semantics.identifier(tok);
             }
-            else if (opNode.textView() == lang.binary_expression_s.bor_o)
+            return std::nullopt; // Char literals, stray punctuation, ...
+        }
+    };
+
+    // Values are concrete numbers with the BitVector64 encoding's semantics; symbolic atoms fail the parse
+    struct BitVector64ConstantSemantics
+    {
+        using Result = ConstantValue;
+
+        std::optional<ConstantValue> literal(std::string_view spelling) const
+        {
+            try
             {
-                z3::expr borExpr = z3::bv2int(z3::int2bv(BIT_WIDTH, left) | z3::int2bv(BIT_WIDTH, right), true);
-                return borExpr;
+                std::string numberString = parseIntegerLiteralToDecimal(spelling);
+                if (numberString.starts_with('-')) return std::nullopt;
+                std::uint64_t bits = std::stoull(numberString);
+                bool isUnsigned = spelling.find_first_of("uU") != std::string_view::npos
+                    || bits > static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max());
+                return ConstantValue{bits, isUnsigned};
             }
-            else if (opNode.textView() == lang.binary_expression_s.bxor_o)
+            catch (const std::exception &)
             {
-                z3::expr bxorExpr = z3::bv2int(z3::int2bv(BIT_WIDTH, left) ^ z3::int2bv(BIT_WIDTH, right), true);
-                return bxorExpr;
+                return std::nullopt;
             }
-            else if (opNode.textView() == lang.binary_expression_s.band_o)
+        }
+
+        std::optional<ConstantValue> identifier(std::string_view) const
+        {
+            return std::nullopt;
+        }
+
+        std::optional<ConstantValue> defined(std::string_view) const
+        {
+            return std::nullopt;
+        }
+
+        std::optional<ConstantValue> unary(std::string_view op, ConstantValue arg) const
+        {
+            if (op == "!") return ConstantValue{arg.bits == 0, false};
+            if (op == "~") return ConstantValue{~arg.bits, arg.isUnsigned};
+            if (op == "-") return ConstantValue{0 - arg.bits, arg.isUnsigned};
+            return arg;
+        }
+
+        std::optional<ConstantValue> binary(std::string_view op, ConstantValue l, ConstantValue r) const
+        {
+            const bool u = l.isUnsigned || r.isUnsigned;
+            const std::int64_t sl = static_cast<std::int64_t>(l.bits);
+            const std::int64_t sr = static_cast<std::int64_t>(r.bits);
+            auto boolean = [](bool b) { return ConstantValue{b ? 1u : 0u, false}; };
+
+            if (op == "+") return ConstantValue{l.bits + r.bits, u};
+            if (op == "-") return ConstantValue{l.bits - r.bits, u};
+            if (op == "*") return ConstantValue{l.bits * r.bits, u};
+            if (op == "/" || op == "%")
             {
-                z3::expr bandExpr = z3::bv2int(z3::int2bv(BIT_WIDTH, left) & z3::int2bv(BIT_WIDTH, right), true);
-                return bandExpr;
+                if (r.bits == 0) return std::nullopt;
+                if (u) return ConstantValue{op == "/" ? l.bits / r.bits : l.bits % r.bits, true};
+                if (sl == std::numeric_limits<std::int64_t>::min() && sr == -1) return std::nullopt;
+                return ConstantValue{static_cast<std::uint64_t>(op == "/" ? sl / sr : sl % sr), false};
             }
-            else if (opNode.textView() == lang.binary_expression_s.eq_o)
+            if (op == "<<" || op == ">>")
             {
-                z3::expr eqExpr = bool2int(left == right);
-                return eqExpr;
+                if (r.bits >= 64) return std::nullopt; // Also catches negative counts
+                if (op == "<<") return ConstantValue{l.bits << r.bits, l.isUnsigned};
+                if (l.isUnsigned) return ConstantValue{l.bits >> r.bits, true};
+                return ConstantValue{static_cast<std::uint64_t>(sl >> r.bits), false};
             }
-            else if (opNode.textView() == lang.binary_expression_s.neq_o)
+            if (op == "<") return boolean(u ? l.bits < r.bits : sl < sr);
+            if (op == "<=") return boolean(u ? l.bits <= r.bits : sl <= sr);
+            if (op == ">") return boolean(u ? l.bits > r.bits : sl > sr);
+            if (op == ">=") return boolean(u ? l.bits >= r.bits : sl >= sr);
+            if (op == "==") return boolean(l.bits == r.bits);
+            if (op == "!=") return boolean(l.bits != r.bits);
+            if (op == "&") return ConstantValue{l.bits & r.bits, u};
+            if (op == "^") return ConstantValue{l.bits ^ r.bits, u};
+            if (op == "|") return ConstantValue{l.bits | r.bits, u};
+            if (op == "&&") return boolean(l.bits != 0 && r.bits != 0);
+            if (op == "||") return boolean(l.bits != 0 || r.bits != 0);
+            return std::nullopt;
+        }
+
+        std::optional<ConstantValue> conditional(ConstantValue cond, ConstantValue trueValue, ConstantValue falseValue) const
+        {
+            return ConstantValue{cond.bits != 0 ? trueValue.bits : falseValue.bits, trueValue.isUnsigned || falseValue.isUnsigned};
+        }
+    };
+
+    // Values are concrete numbers with the Int encoding's semantics: mathematical integers, here held as
+    // int64_t bits, with z3's div and mod, and bitwise operators and shifts on bitWidth-bit vectors read back
+    // as signed. There is no unsigned type. Anything that leaves int64_t fails the parse and goes to z3.
+    struct IntConstantSemantics
+    {
+        using Result = ConstantValue;
+
+        int bitWidth;
+
+        static ConstantValue make(std::int64_t value)
+        {
+            return ConstantValue{static_cast<std::uint64_t>(value), false};
+        }
+
+        static std::int64_t valueOf(ConstantValue value)
+        {
+            return static_cast<std::int64_t>(value.bits);
+        }
+
+        // Like z3::int2bv followed by a signed z3::bv2int
+        std::int64_t wrap(std::uint64_t bits) const
+        {
+            const std::uint64_t mask = (std::uint64_t{1} << bitWidth) - 1;
+            const std::uint64_t signBit = std::uint64_t{1} << (bitWidth - 1);
+            bits &= mask;
+            return static_cast<std::int64_t>(bits & signBit ? bits | ~mask : bits);
+        }
+
+        std::optional<ConstantValue> literal(std::string_view spelling) const
+        {
+            try
             {
-                z3::expr neqExpr = bool2int(left != right);
-                return neqExpr;
+                return make(std::stoll(parseIntegerLiteralToDecimal(spelling)));
             }
-            else if (opNode.textView() == lang.binary_expression_s.gt_o)
+            catch (const std::exception &)
             {
-                z3::expr gtExpr = bool2int(left > right);
-                return gtExpr;
+                return std::nullopt; // Out of range among others
             }
-            else if (opNode.textView() == lang.binary_expression_s.ge_o)
+        }
+
+        std::optional<ConstantValue> identifier(std::string_view) const
+        {
+            return std::nullopt;
+        }
+
+        std::optional<ConstantValue> defined(std::string_view) const
+        {
+            return std::nullopt;
+        }
+
+        std::optional<ConstantValue> unary(std::string_view op, ConstantValue arg) const
+        {
+            const std::int64_t a = valueOf(arg);
+            if (op == "!") return make(a == 0);
+            if (op == "~") return make(wrap(~arg.bits));
+            if (op == "-")
             {
-                z3::expr geExpr = bool2int(left >= right);
-                return geExpr;
+                if (a == std::numeric_limits<std::int64_t>::min()) return std::nullopt;
+                return make(-a);
             }
-            else if (opNode.textView() == lang.binary_expression_s.le_o)
+            return arg;
+        }
+
+        std::optional<ConstantValue> binary(std::string_view op, ConstantValue left, ConstantValue right) const
+        {
+            const std::int64_t l = valueOf(left);
+            const std::int64_t r = valueOf(right);
+            std::int64_t result;
+
+            if (op == "+") return __builtin_add_overflow(l, r, &result) ? std::nullopt : std::optional(make(result));
+            if (op == "-") return __builtin_sub_overflow(l, r, &result) ? std::nullopt : std::optional(make(result));
+            if (op == "*") return __builtin_mul_overflow(l, r, &result) ? std::nullopt : std::optional(make(result));
+            if (op == "/" || op == "%")
             {
-                z3::expr leExpr = bool2int(left <= right);
-                return leExpr;
+                // z3 leaves division by zero unspecified
+                if (r == 0 || (l == std::numeric_limits<std::int64_t>::min() && r == -1)) return std::nullopt;
+                // Euclidean: the remainder is never negative
+                std::int64_t remainder = l % r;
+                if (remainder < 0) remainder += r < 0 ? -r : r;
+                if (op == "%") return make(remainder);
+                return make((l - remainder) / r);
             }
-            else if (opNode.textView() == lang.binary_expression_s.lt_o)
+            if (op == "<<" || op == ">>")
             {
-                z3::expr ltExpr = bool2int(left < right);
-                return ltExpr;
+                const std::uint64_t lBits = left.bits & ((std::uint64_t{1} << bitWidth) - 1);
+                const std::uint64_t count = right.bits & ((std::uint64_t{1} << bitWidth) - 1);
+                if (op == "<<") return make(count >= static_cast<std::uint64_t>(bitWidth) ? 0 : wrap(lBits << count));
+                const std::int64_t signedLeft = wrap(lBits);
+                if (count >= static_cast<std::uint64_t>(bitWidth)) return make(signedLeft < 0 ? -1 : 0);
+                return make(signedLeft >> count);
             }
-            else if (opNode.textView() == lang.binary_expression_s.lsh_o)
+            if (op == "<") return make(l < r);
+            if (op == "<=") return make(l <= r);
+            if (op == ">") return make(l > r);
+            if (op == ">=") return make(l >= r);
+            if (op == "==") return make(l == r);
+            if (op == "!=") return make(l != r);
+            if (op == "&") return make(wrap(left.bits & right.bits));
+            if (op == "^") return make(wrap(left.bits ^ right.bits));
+            if (op == "|") return make(wrap(left.bits | right.bits));
+            if (op == "&&") return make(l != 0 && r != 0);
+            if (op == "||") return make(l != 0 || r != 0);
+            return std::nullopt;
+        }
+
+        std::optional<ConstantValue> conditional(ConstantValue cond, ConstantValue trueValue, ConstantValue falseValue) const
+        {
+            return cond.bits != 0 ? trueValue : falseValue;
+        }
+    };
+
+    // Values are z3 terms in the expander's encoding, built with the same helpers as symbolizeExpression
+    struct SymbolicSemantics
+    {
+        using Result = Value;
+
+        MacroExpander & expander;
+        const ConstSymbolTablePtr & symbolTable;
+
+        std::optional<Value> literal(std::string_view spelling)
+        {
+            try
             {
-                z3::expr lshExpr = z3::bv2int(z3::shl(z3::int2bv(BIT_WIDTH, left), z3::int2bv(BIT_WIDTH, right)), true);
-                return lshExpr;
+                return expander.symbolizeIntegerLiteral(spelling);
             }
-            else if (opNode.textView() == lang.binary_expression_s.rsh_o)
+            catch (const std::exception &)
             {
-                z3::expr rshExpr = z3::bv2int(z3::ashr(z3::int2bv(BIT_WIDTH, left), z3::int2bv(BIT_WIDTH, right)), true);
-                return rshExpr;
+                // Let the tree-sitter path report it
+                return std::nullopt;
             }
-            else assert(false);
         }
-        else if (node.isSymbol(lang.parenthesized_expression_s))
+
+        std::optional<Value> identifier(std::string_view name)
         {
-            // Parenthesized expression, just return the inner expression
-            TSNode innerNode = node.childByFieldId(lang.parenthesized_expression_s.expr_f);
-            z3::expr innerExpr = symbolizeExpression(innerNode);
-            return innerExpr;
+            return expander.symbolizeIdentifier(name, symbolTable);
         }
-        else if (node.isSymbol(lang.conditional_expression_s))
-        {
-            TSNode condNode = node.childByFieldId(lang.conditional_expression_s.condition_f);
-            TSNode trueNode = node.childByFieldId(lang.conditional_expression_s.consequence_f);
-            TSNode falseNode = node.childByFieldId(lang.conditional_expression_s.alternative_f);
 
-            z3::expr condExpr = symbolizeExpression(condNode);
-            z3::expr trueExpr = symbolizeExpression(trueNode);
-            z3::expr falseExpr = symbolizeExpression(falseNode);
-
-            z3::expr condIteExpr = z3::ite(int2bool(condExpr), trueExpr, falseExpr);
-            return condIteExpr;
+        std::optional<Value> defined(std::string_view name)
+        {
+            return expander.symbolizeDefined(name);
         }
-        else assert(false);
-    }
-
-    z3::expr int2bool(const z3::expr & expr)
-    {
-        assert(expr.is_int());
-        return z3::ite(expr != 0, ctx->bool_val(true), ctx->bool_val(false));
-    }
-
-    z3::expr bool2int(const z3::expr & expr)
-    {
-        assert(expr.is_bool());
-        return z3::ite(expr, constExpr1, constExpr0);
-    }
 
-    // Parse a string into preprocessor tokens
-    // Returns (tree, tokens)
-    std::tuple<TSTree, TSNode> parseIntoPreprocTokens(std::string_view source)
-    {
-        if (source.empty()) return { TSTree(), TSNode() };
-        std::string ifSource = std::format("#if {}\n#endif\n", source);
-        TSTree tree = parser.parseString(std::move(ifSource));
-        TSNode root = tree.rootNode(); // translation_unit
-        TSNode tokens = root.firstChildForByte(0).childByFieldId(lang.preproc_if_s.condition_f);
-        assert(tokens.isSymbol(lang.preproc_tokens_s));
-        return { std::move(tree), std::move(tokens) };
-    }
+        std::optional<Value> unary(std::string_view op, const Value & arg)
+        {
+            return expander.symbolizeUnary(op, arg);
+        }
 
-    // Parse a string into a preprocessor expression
-    // Returns (tree, expr)
-    std::tuple<TSTree, TSNode> parseIntoExpression(std::string_view source)
-    {
-        if (source.empty()) return { TSTree(), TSNode() };
-        std::string evalSource = std::format("#eval {}\n#endeval\n", source);
-        TSTree tree = parser.parseString(std::move(evalSource));
-        TSNode root = tree.rootNode(); // translation_unit
-        TSNode expr = root.firstChildForByte(0).childByFieldId(lang.preproc_eval_s.expr_f);
-        return { std::move(tree), std::move(expr) };
-    }
+        std::optional<Value> binary(std::string_view op, const Value & left, const Value & right)
+        {
+            return expander.symbolizeBinary(op, left, right);
+        }
 
-private:
-    const CPreproc lang;
-    TSParser parser;
+        std::optional<Value> conditional(const Value & cond, const Value & trueValue, const Value & falseValue)
+        {
+            return expander.symbolizeConditional(cond, trueValue, falseValue);
+        }
+    };
 
     z3::context * ctx;
 
-    // Cache for the ownership of temporarily parsed trees
-    TSTree tempTokensTree;
-    TSNode constToken0;
-    TSNode constToken1;
-    TSNode constTokenNot;
-    TSNode constTokenDefined;
+    TokenInterner interner;
+    // Interned macro bodies, see internBody
+    std::unordered_map<TSNode, std::vector<PreprocToken>, TSNode::Hasher> internedBodies;
+
+    PreprocToken constToken0;
+    PreprocToken constToken1;
+    PreprocToken constTokenNot;
+    PreprocToken constTokenDefined;
 
     // The bit width of the symbolic values
     const int BIT_WIDTH = 32;
+    IntEncoding encoding;
     z3::expr constExpr0;
     z3::expr constExpr1;
 
@@ -0,0 +1,486 @@
+// Binary serialization of Pioneer output: the include tree, the premise tree and its premises.
+// An artifact is keyed by the content hash of every file in the include tree plus a hash of the
+// options that affect symbolic execution, so a rerun can load it instead of running SymbolicExecutor.
+// Program points are stored as (include tree index, byte range, node symbol) and resolved against
+// freshly parsed files on load, optionally moved past edits that leave the directives alone.
+// Premises are stored once each, as one SMT-LIB2 benchmark.
+
+#ifndef HAYROLL_PIONEERARTIFACT_HPP
+#define HAYROLL_PIONEERARTIFACT_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <memory>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#include <z3++.h>
+
+#include <spdlog/spdlog.h>
+
+#include "Util.hpp"
+#include "TreeSitter.hpp"
+#include "TreeSitterCPreproc.hpp"
+#include "IncludeTree.hpp"
+#include "ProgramPoint.hpp"
+#include "ASTBank.hpp"
+#include "PremiseTree.hpp"
+
+namespace Hayroll
+{
+
+struct PioneerArtifact
+{
+    static constexpr std::string_view Magic = "HAYPIONR";
+    static constexpr std::uint32_t Version = 1;
+
+    // Declared first so the premises die before their context.
+    std::unique_ptr<z3::context> ctx;
+    std::unique_ptr<ASTBank> astBank;
+    IncludeTreeRootPtr includeTree;
+    PremiseTreePtr premiseTree;
+
+    // Stable 64-bit FNV-1a, so keys survive across builds and runs.
+    static std::uint64_t fnv1a(std::string_view data, std::uint64_t hash = 0xcbf29ce484222325ULL)
+    {
+        for (unsigned char c : data)
+        {
+            hash ^= c;
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    // Hash of the options that affect symbolic execution and refinement, in the order given.
+    static std::uint64_t configHash(const std::vector<std::string> & options)
+    {
+        std::uint64_t hash = fnv1a(Magic);
+        for (const std::string & option : options)
+        {
+            hash = fnv1a(option, hash);
+            hash = fnv1a(std::string_view("\0", 1), hash);
+        }
+        return hash;
+    }
+
+    static std::string serialize
+    (
+        const IncludeTreePtr & includeTree,
+        const PremiseTree & premiseTree,
+        std::uint64_t configHash
+    )
+    {
+        Writer writer;
+        writer.bytes(Magic);
+        writer.u32(Version);
+        writer.u64(configHash);
+
+        // Number the include trees in pre-order. Program points may also live in other roots,
+        // such as the <built-in> source of predefined macros; those are added as they are met.
+        std::vector<IncludeTreePtr> trees;
+        std::unordered_map<const IncludeTree *, std::uint32_t> treeIndices;
+        std::unordered_map<const IncludeTree *, const std::string *> inlineSources;
+        auto addRoot = [&](const IncludeTreePtr & root)
+        {
+            for (IncludeTreePtr tree : *root)
+            {
+                treeIndices.emplace(tree, static_cast<std::uint32_t>(trees.size()));
+                trees.push_back(tree);
+            }
+        };
+        addRoot(includeTree);
+        for (const PremiseTree * node : premiseTree.getDescendantsPreOrder())
+        {
+            auto visit = [&](const ProgramPoint & programPoint)
+            {
+                if (treeIndices.contains(programPoint.includeTree)) return;
+                IncludeTreePtr root = programPoint.includeTree;
+                while (root->parent) root = root->parent;
+                if (!programPoint.node)
+                {
+                    throw std::runtime_error(std::format("Cannot serialize program point without a node: {}", programPoint.toString()));
+                }
+                inlineSources.emplace(root, &programPoint.node.getSource());
+                addRoot(root);
+            };
+            visit(node->programPoint);
+            for (const auto & [macroProgramPoint, macroPremise] : node->macroPremises) visit(macroProgramPoint);
+        }
+
+        // Content hashes of every file on disk that took part
+        std::vector<std::pair<std::string, std::uint64_t>> files;
+        std::unordered_map<std::string, std::size_t> fileIndices;
+        for (const IncludeTreePtr & tree : trees)
+        {
+            if (inlineSources.contains(tree)) continue;
+            std::string path = tree->path.string();
+            if (fileIndices.contains(path) || !std::filesystem::is_regular_file(tree->path)) continue;
+            fileIndices.emplace(path, files.size());
+            files.emplace_back(path, fnv1a(loadFileToString(tree->path)));
+        }
+        writer.u32(static_cast<std::uint32_t>(files.size()));
+        for (const auto & [path, hash] : files)
+        {
+            writer.str(path);
+            writer.u64(hash);
+        }
+
+        writer.u32(static_cast<std::uint32_t>(trees.size()));
+        for (const IncludeTreePtr & tree : trees)
+        {
+            IncludeTreePtr parent = tree->parent;
+            writer.u32(parent ? treeIndices.at(parent) : NoIndex);
+            writer.str(tree->path.string());
+            writer.u8(tree->isSystemInclude);
+            writer.node(tree->includeNode);
+            auto it = inlineSources.find(tree);
+            writer.u8(it != inlineSources.end());
+            if (it != inlineSources.end()) writer.str(*it->second);
+        }
+
+        // Each distinct premise once, as the asserts of one benchmark
+        std::vector<z3::expr> premises;
+        std::unordered_map<unsigned, std::uint32_t> premiseIndices;
+        auto premiseIndex = [&](const z3::expr & premise)
+        {
+            auto [it, inserted] = premiseIndices.try_emplace(premise.id(), static_cast<std::uint32_t>(premises.size()));
+            if (inserted) premises.push_back(premise);
+            return it->second;
+        };
+
+        Writer treeWriter;
+        std::function<void(const PremiseTree &)> writeNode = [&](const PremiseTree & node)
+        {
+            treeWriter.programPoint(node.programPoint, treeIndices);
+            treeWriter.u32(premiseIndex(node.premise));
+            treeWriter.u32(static_cast<std::uint32_t>(node.macroPremises.size()));
+            for (const auto & [macroProgramPoint, macroPremise] : node.macroPremises)
+            {
+                treeWriter.programPoint(macroProgramPoint, treeIndices);
+                treeWriter.u32(premiseIndex(macroPremise));
+            }
+            treeWriter.u32(static_cast<std::uint32_t>(node.children.size()));
+            for (const PremiseTreePtr & child : node.children) writeNode(*child);
+        };
+        writeNode(premiseTree);
+
+        z3::context & ctx = premiseTree.premise.ctx();
+        // The benchmark needs a formula besides the assumptions; a trailing true is dropped on load.
+        std::vector<Z3_ast> assumptions(premises.begin(), premises.end());
+        const z3::expr trailer = ctx.bool_val(true);
+        std::string smtlib = Z3_benchmark_to_smtlib_string
+        (
+            ctx, "", "", "unknown", "",
+            static_cast<unsigned>(assumptions.size()), assumptions.data(), trailer
+        );
+        writer.u32(static_cast<std::uint32_t>(premises.size()));
+        writer.str(smtlib);
+        writer.bytes(treeWriter.data);
+
+        return std::move(writer.data);
+    }
+
+    // An edit of a file since the artifact was written that leaves its directives alone,
+    // e.g. as found by SharedASTStore::update. Program points in the file are moved past the edit.
+    struct FileEdit
+    {
+        std::uint64_t oldHash; // Content hash before the edit, as the artifact recorded it
+        std::uint64_t newHash; // Content hash after the edit, as the file is now
+        std::uint32_t startByte;
+        std::uint32_t oldEndByte;
+        std::uint32_t newEndByte;
+    };
+    using FileEdits = std::unordered_map<std::string, FileEdit>; // By canonical path
+
+    // Rebuild the Pioneer output from an artifact.
+    // Returns nullopt if the artifact was written under other options or any file it depends on changed,
+    // other than by the given edits. Throws if the artifact is malformed, or a program point overlaps an edit.
+    static std::optional<PioneerArtifact> deserialize(std::string_view data, std::uint64_t configHash, const FileEdits & edits = {})
+    {
+        Reader reader{data};
+        if (reader.bytes(Magic.size()) != Magic || reader.u32() != Version)
+        {
+            throw std::runtime_error("Not a Pioneer artifact of this version");
+        }
+        if (reader.u64() != configHash)
+        {
+            SPDLOG_DEBUG("Pioneer artifact was written under different options");
+            return std::nullopt;
+        }
+
+        const std::uint32_t fileCount = reader.u32();
+        for (std::uint32_t i = 0; i < fileCount; ++i)
+        {
+            std::filesystem::path path = reader.str();
+            const std::uint64_t hash = reader.u64();
+            std::uint64_t expectedHash = hash;
+            if (const FileEdit * edit = findEdit(edits, path))
+            {
+                if (edit->oldHash != hash)
+                {
+                    SPDLOG_DEBUG("Pioneer artifact is stale: {} changed before the edit", path.string());
+                    return std::nullopt;
+                }
+                expectedHash = edit->newHash;
+            }
+            if (!std::filesystem::is_regular_file(path) || fnv1a(loadFileToString(path)) != expectedHash)
+            {
+                SPDLOG_DEBUG("Pioneer artifact is stale: {} changed", path.string());
+                return std::nullopt;
+            }
+        }
+
+        PioneerArtifact artifact;
+        artifact.ctx = std::make_unique<z3::context>();
+        const CPreproc lang = CPreproc();
+        artifact.astBank = std::make_unique<ASTBank>(lang);
+
+        // Include trees, each with the root node of its file
+        std::vector<IncludeTreePtr> trees;
+        std::vector<TSNode> roots;
+        std::vector<const FileEdit *> treeEdits;
+        const std::uint32_t treeCount = reader.u32();
+        for (std::uint32_t i = 0; i < treeCount; ++i)
+        {
+            const std::uint32_t parentIndex = reader.u32();
+            std::filesystem::path path = reader.str();
+            const bool isSystemInclude = reader.u8();
+            const NodeRef includeNodeRef = reader.node();
+            std::optional<std::string> inlineSource;
+            if (reader.u8()) inlineSource = std::string(reader.str());
+
+            IncludeTreePtr tree;
+            if (parentIndex == NoIndex && !artifact.includeTree)
+            {
+                artifact.includeTree = IncludeTree::make(TSNode{}, path, isSystemInclude);
+                tree = artifact.includeTree.get();
+            }
+            else if (parentIndex == NoIndex)
+            {
+                // Other roots share the arena of the first
+                tree = artifact.includeTree->addRoot(path, isSystemInclude);
+            }
+            else
+            {
+                if (parentIndex >= i) throw std::runtime_error("Malformed Pioneer artifact: include tree out of order");
+                TSNode includeNode = resolve(roots[parentIndex], rebase(includeNodeRef, treeEdits[parentIndex], trees[parentIndex]->path));
+                tree = trees[parentIndex]->addChild(includeNode, path, isSystemInclude);
+            }
+
+            TSNode root;
+            if (inlineSource) root = artifact.astBank->addAnonymousSource(std::move(*inlineSource)).rootNode();
+            else if (!isSystemInclude) root = artifact.astBank->addFileOrFind(path).rootNode();
+            trees.push_back(tree);
+            roots.push_back(root);
+            treeEdits.push_back(inlineSource ? nullptr : findEdit(edits, path));
+        }
+        if (trees.empty()) throw std::runtime_error("Malformed Pioneer artifact: no include tree");
+
+        const std::uint32_t premiseCount = reader.u32();
+        const std::string smtlib(reader.str());
+        z3::expr_vector parsed = artifact.ctx->parse_string(smtlib.c_str());
+        if (parsed.size() != premiseCount + 1) throw std::runtime_error("Malformed Pioneer artifact: premise count mismatch");
+
+        auto readProgramPoint = [&]() -> ProgramPoint
+        {
+            const std::uint32_t treeIndex = reader.u32();
+            const NodeRef nodeRef = reader.node();
+            if (treeIndex >= trees.size()) throw std::runtime_error("Malformed Pioneer artifact: include tree index out of range");
+            return ProgramPoint{trees[treeIndex], resolve(roots[treeIndex], rebase(nodeRef, treeEdits[treeIndex], trees[treeIndex]->path))};
+        };
+        auto readPremise = [&]() -> z3::expr
+        {
+            const std::uint32_t premiseIndex = reader.u32();
+            if (premiseIndex >= premiseCount) throw std::runtime_error("Malformed Pioneer artifact: premise index out of range");
+            return parsed[premiseIndex];
+        };
+        std::function<void(PremiseTree &)> readBody = [&](PremiseTree & node)
+        {
+            const std::uint32_t macroCount = reader.u32();
+            for (std::uint32_t i = 0; i < macroCount; ++i)
+            {
+                ProgramPoint macroProgramPoint = readProgramPoint();
+                node.macroPremises.emplace(macroProgramPoint, readPremise());
+            }
+            const std::uint32_t childCount = reader.u32();
+            for (std::uint32_t i = 0; i < childCount; ++i)
+            {
+                ProgramPoint programPoint = readProgramPoint();
+                PremiseTree * child = node.addChild(programPoint, readPremise());
+                readBody(*child);
+            }
+        };
+        ProgramPoint rootProgramPoint = readProgramPoint();
+        artifact.premiseTree = PremiseTree::make(rootProgramPoint, readPremise());
+        readBody(*artifact.premiseTree);
+        if (!reader.atEnd()) throw std::runtime_error("Malformed Pioneer artifact: trailing data");
+
+        return artifact;
+    }
+
+private:
+    static constexpr std::uint32_t NoIndex = UINT32_MAX;
+
+    // A node by position and kind; null nodes (EOF program points) have present == false.
+    struct NodeRef
+    {
+        bool present;
+        std::uint32_t startByte;
+        std::uint32_t endByte;
+        TSSymbol symbol;
+    };
+
+    static const FileEdit * findEdit(const FileEdits & edits, const std::filesystem::path & path)
+    {
+        if (edits.empty()) return nullptr;
+        auto it = edits.find(std::filesystem::weakly_canonical(path).string());
+        return it != edits.end() ? &it->second : nullptr;
+    }
+
+    // Move a node past an edit of its file. Nodes before the edit stay, nodes after it shift,
+    // and nodes around it grow or shrink with it; a node cut by the edit cannot be moved.
+    static NodeRef rebase(NodeRef ref, const FileEdit * fileEdit, const std::filesystem::path & path)
+    {
+        if (!ref.present || !fileEdit) return ref;
+        const FileEdit & edit = *fileEdit;
+        if (ref.endByte <= edit.startByte) return ref;
+        if (ref.startByte >= edit.oldEndByte)
+        {
+            ref.startByte = ref.startByte - edit.oldEndByte + edit.newEndByte;
+            ref.endByte = ref.endByte - edit.oldEndByte + edit.newEndByte;
+            return ref;
+        }
+        if (ref.startByte <= edit.startByte && ref.endByte >= edit.oldEndByte)
+        {
+            ref.endByte = ref.endByte - edit.oldEndByte + edit.newEndByte;
+            return ref;
+        }
+        throw std::runtime_error(std::format("Pioneer artifact node {}~{} overlaps an edit of {}", ref.startByte, ref.endByte, path.string()));
+    }
+
+    // Find the node again in a fresh parse of the same file.
+    static TSNode resolve(const TSNode & root, const NodeRef & ref)
+    {
+        if (!ref.present) return TSNode{};
+        if (!root) throw std::runtime_error("Malformed Pioneer artifact: node in a file that was not parsed");
+        // The smallest node spanning the range; ancestors may span exactly the same bytes.
+        TSNode node = root.descendantForByteRange(ref.startByte, ref.endByte);
+        while (node && node.startByte() == ref.startByte && node.endByte() == ref.endByte)
+        {
+            if (node.symbol() == ref.symbol) return node;
+            node = node.parent();
+        }
+        // Empty nodes are not found by range; look for them one by one.
+        for (const TSNode & descendant : root.iterateDescendants())
+        {
+            if (descendant.startByte() == ref.startByte && descendant.endByte() == ref.endByte && descendant.symbol() == ref.symbol)
+            {
+                return descendant;
+            }
+        }
+        throw std::runtime_error(std::format("Pioneer artifact node {}~{} not found", ref.startByte, ref.endByte));
+    }
+
+    struct Writer
+    {
+        std::string data;
+
+        void bytes(std::string_view bytes)
+        {
+            data.append(bytes);
+        }
+
+        template <typename T>
+        void scalar(T value)
+        {
+            char buffer[sizeof(T)];
+            std::memcpy(buffer, &value, sizeof(T));
+            data.append(buffer, sizeof(T));
+        }
+
+        void u8(std::uint8_t value) { scalar(value); }
+        void u32(std::uint32_t value) { scalar(value); }
+        void u64(std::uint64_t value) { scalar(value); }
+
+        void str(std::string_view value)
+        {
+            u64(value.size());
+            bytes(value);
+        }
+
+        void node(const TSNode & node)
+        {
+            u8(static_cast<bool>(node));
+            if (!node) return;
+            u32(node.startByte());
+            u32(node.endByte());
+            scalar<TSSymbol>(node.symbol());
+        }
+
+        void programPoint
+        (
+            const ProgramPoint & programPoint,
+            const std::unordered_map<const IncludeTree *, std::uint32_t> & treeIndices
+        )
+        {
+            u32(treeIndices.at(programPoint.includeTree));
+            node(programPoint.node);
+        }
+    };
+
+    struct Reader
+    {
+        std::string_view data;
+        std::size_t pos = 0;
+
+        std::string_view bytes(std::size_t size)
+        {
+            if (size > data.size() - pos) throw std::runtime_error("Malformed Pioneer artifact: truncated");
+            std::string_view result = data.substr(pos, size);
+            pos += size;
+            return result;
+        }
+
+        template <typename T>
+        T scalar()
+        {
+            T value;
+            std::memcpy(&value, bytes(sizeof(T)).data(), sizeof(T));
+            return value;
+        }
+
+        std::uint8_t u8() { return scalar<std::uint8_t>(); }
+        std::uint32_t u32() { return scalar<std::uint32_t>(); }
+        std::uint64_t u64() { return scalar<std::uint64_t>(); }
+
+        std::string_view str()
+        {
+            return bytes(u64());
+        }
+
+        NodeRef node()
+        {
+            NodeRef ref{};
+            ref.present = u8();
+            if (!ref.present) return ref;
+            ref.startByte = u32();
+            ref.endByte = u32();
+            ref.symbol = scalar<TSSymbol>();
+            return ref;
+        }
+
+        bool atEnd() const
+        {
+            return pos == data.size();
+        }
+    };
+};
+
+} // namespace Hayroll
+
+#endif // HAYROLL_PIONEERARTIFACT_HPP
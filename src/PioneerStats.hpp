@@ -0,0 +1,217 @@
+// Instrumentation of one SymbolicExecutor: state counts, solver calls, symbol table activity,
+// includes and time per directive kind. Owned by the executor, so concurrent executors do not share it.
+
+#ifndef HAYROLL_PIONEERSTATS_HPP
+#define HAYROLL_PIONEERSTATS_HPP
+
+#include <string_view>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+
+#include "json.hpp"
+
+#include "SymbolTable.hpp"
+
+namespace Hayroll
+{
+
+struct PioneerStats
+{
+    using clock = std::chrono::steady_clock;
+
+    // Calls and accumulated time of one kind of event
+    struct Timed
+    {
+        std::size_t count = 0;
+        std::chrono::nanoseconds time{0};
+
+        void add(std::size_t n, std::chrono::nanoseconds elapsed)
+        {
+            count += n;
+            time += elapsed;
+        }
+    };
+
+    // States split off at #if, removed by merging at joins, and dropped as infeasible
+    std::size_t statesCreated = 0;
+    std::size_t statesSplit = 0;
+    std::size_t statesMerged = 0;
+    std::size_t statesDropped = 0;
+    std::size_t joins = 0;
+    std::size_t liveStates = 0;
+    std::size_t peakLiveStates = 0;
+
+    // Solver queries by call site; a batch of n queries counts n
+    std::map<std::string_view, Timed> solverCalls;
+    // Depth of the symbol table chain of every state leaving a join
+    std::map<std::size_t, std::size_t> symbolChainDepths;
+    SymbolTableCounters symbolTables;
+
+    std::size_t symbolicIncludes = 0;
+    std::size_t concreteIncludes = 0;
+    std::size_t guardedIncludesSkipped = 0;
+
+    // Exclusive time per directive kind, i.e. without the directives nested in it
+    std::map<std::string_view, Timed> directives;
+
+    void resetStates(std::size_t live)
+    {
+        liveStates = live;
+        peakLiveStates = std::max(peakLiveStates, liveStates);
+    }
+
+    void statesAdded(std::size_t n)
+    {
+        statesCreated += n;
+        liveStates += n;
+        peakLiveStates = std::max(peakLiveStates, liveStates);
+    }
+
+    void statesMergedAway(std::size_t n)
+    {
+        statesMerged += n;
+        liveStates -= std::min(n, liveStates);
+    }
+
+    void statesDroppedAway(std::size_t n)
+    {
+        statesDropped += n;
+        liveStates -= std::min(n, liveStates);
+    }
+
+    // Times a solver call site.
+    class SolverScope
+    {
+    public:
+        SolverScope(PioneerStats & stats, std::string_view site, std::size_t queries)
+            : stats(stats), site(site), queries(queries), begin(clock::now())
+        {
+        }
+
+        SolverScope(const SolverScope &) = delete;
+        SolverScope & operator=(const SolverScope &) = delete;
+
+        ~SolverScope()
+        {
+            stats.solverCalls[site].add(queries, clock::now() - begin);
+        }
+
+    private:
+        PioneerStats & stats;
+        std::string_view site;
+        std::size_t queries;
+        clock::time_point begin;
+    };
+
+    // Times one directive. Nested scopes are subtracted from the enclosing one.
+    class DirectiveScope
+    {
+    public:
+        DirectiveScope(PioneerStats & stats, std::string_view kind)
+            : stats(stats), kind(kind), begin(clock::now())
+        {
+            stats.nestedTimes.push_back(std::chrono::nanoseconds{0});
+        }
+
+        DirectiveScope(const DirectiveScope &) = delete;
+        DirectiveScope & operator=(const DirectiveScope &) = delete;
+
+        ~DirectiveScope()
+        {
+            const std::chrono::nanoseconds elapsed = clock::now() - begin;
+            const std::chrono::nanoseconds nested = stats.nestedTimes.back();
+            stats.nestedTimes.pop_back();
+            stats.directives[kind].add(1, elapsed - nested);
+            if (!stats.nestedTimes.empty()) stats.nestedTimes.back() += elapsed;
+        }
+
+    private:
+        PioneerStats & stats;
+        std::string_view kind;
+        clock::time_point begin;
+    };
+
+    // Points this thread's symbol table counters at these stats until destroyed.
+    class SymbolTableScope
+    {
+    public:
+        explicit SymbolTableScope(PioneerStats & stats)
+            : previous(SymbolTableCounters::current())
+        {
+            SymbolTableCounters::current() = &stats.symbolTables;
+        }
+
+        SymbolTableScope(const SymbolTableScope &) = delete;
+        SymbolTableScope & operator=(const SymbolTableScope &) = delete;
+
+        ~SymbolTableScope()
+        {
+            SymbolTableCounters::current() = previous;
+        }
+
+    private:
+        SymbolTableCounters * previous;
+    };
+
+    nlohmann::ordered_json toJson() const
+    {
+        using nlohmann::ordered_json;
+        auto timedJson = [](const std::map<std::string_view, Timed> & timed)
+        {
+            ordered_json result = ordered_json::object();
+            for (const auto & [name, entry] : timed)
+            {
+                ordered_json entryJson = ordered_json::object();
+                entryJson["count"] = entry.count;
+                entryJson["ms"] = std::chrono::duration<double, std::milli>(entry.time).count();
+                result[std::string(name)] = entryJson;
+            }
+            return result;
+        };
+
+        ordered_json states = ordered_json::object();
+        states["created"] = statesCreated;
+        states["split"] = statesSplit;
+        states["merged"] = statesMerged;
+        states["dropped"] = statesDropped;
+        states["joins"] = joins;
+        states["peak_live"] = peakLiveStates;
+
+        ordered_json depths = ordered_json::object();
+        for (const auto & [depth, count] : symbolChainDepths)
+        {
+            depths[std::to_string(depth)] = count;
+        }
+
+        ordered_json tables = ordered_json::object();
+        tables["segments"] = symbolTables.segments;
+        tables["symbols"] = symbolTables.symbols;
+        tables["tables"] = symbolTables.tables;
+        tables["flattens"] = symbolTables.flattens;
+        tables["chain_depths"] = depths;
+
+        ordered_json includes = ordered_json::object();
+        includes["symbolic"] = symbolicIncludes;
+        includes["concrete"] = concreteIncludes;
+        includes["guarded_skipped"] = guardedIncludesSkipped;
+
+        ordered_json result = ordered_json::object();
+        result["states"] = states;
+        result["solver_calls"] = timedJson(solverCalls);
+        result["symbol_tables"] = tables;
+        result["includes"] = includes;
+        result["directives"] = timedJson(directives);
+        return result;
+    }
+
+private:
+    // Time spent in nested directive scopes, one entry per open scope
+    std::vector<std::chrono::nanoseconds> nestedTimes;
+};
+
+} // namespace Hayroll
+
+#endif // HAYROLL_PIONEERSTATS_HPP
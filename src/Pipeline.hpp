@@ -31,6 +31,7 @@
 #include "MakiSummary.hpp"
 #include "RewriteIncludesWrapper.hpp"
 #include "SymbolicExecutor.hpp"
+#include "PioneerArtifact.hpp"
 #include "Splitter.hpp"
 #include "LineMatcher.hpp"
 #include "Seeder.hpp"
@@ -40,6 +41,20 @@
 namespace Hayroll
 {
 
+// Options of Pipeline::run besides its inputs and outputs. The defaults give a plain full run.
+struct PipelineOptions
+{
+    // Seed tags as ids into a side-table instead of inline JSON literals
+    bool compactTags = false;
+    // Pioneer settings. Premise trees are also refined on pioneer.checkThreads threads.
+    SymbolicExecutorOptions pioneer;
+    // Save each task's Pioneer artifact, and load the one a previous run saved if its config hash still matches
+    bool reusePioneer = false;
+    SplitPlanning splitPlanning = SplitPlanning::Greedy;
+    // Run only these tasks; the others contribute their last task record. Null runs every task.
+    const std::unordered_set<std::filesystem::path> * tasksToRun = nullptr;
+};
+
 class Pipeline
 {
     using json = nlohmann::json;
@@ -134,6 +149,11 @@ private:
             result["stages"] = stagesJson;
             result["total_ms"] = toMillis(total);
             result["loc_count"] = locCount;
+            ordered_json solverCacheJson = ordered_json::object();
+            solverCacheJson["hits"] = solverCacheHits;
+            solverCacheJson["misses"] = solverCacheMisses;
+            result["solver_query_cache"] = solverCacheJson;
+            if (!pioneerStats.is_null()) result["pioneer"] = pioneerStats;
             return result;
         }
 
@@ -142,6 +162,17 @@ private:
             locCount = count;
         }
 
+        void setSolverCacheStats(std::size_t hits, std::size_t misses)
+        {
+            solverCacheHits = hits;
+            solverCacheMisses = misses;
+        }
+
+        void setPioneerStats(ordered_json stats)
+        {
+            pioneerStats = std::move(stats);
+        }
+
         static double toMillis(std::chrono::nanoseconds ns)
         {
             return std::chrono::duration<double, std::milli>(ns).count();
@@ -181,6 +212,26 @@ private:
         std::unordered_map<std::string, std::chrono::nanoseconds> elapsedDurations;
         std::chrono::nanoseconds total{0};
         int locCount{0};
+        std::size_t solverCacheHits{0};
+        std::size_t solverCacheMisses{0};
+        ordered_json pioneerStats;
+    };
+
+    // What a completed task contributes to the project-wide outputs, so a partial run can fill in the tasks it skips
+    struct TaskRecord
+    {
+        std::vector<std::string> cargoTomls;
+        std::set<std::string> rustFeatureAtoms;
+        std::set<std::string> c2RustInnerAttrs;
+        std::vector<Seeder::SeedingReport> seedingReports;
+        std::size_t successfulSplits;
+        int locCount;
+
+        NLOHMANN_DEFINE_TYPE_INTRUSIVE
+        (
+            TaskRecord,
+            cargoTomls, rustFeatureAtoms, c2RustInnerAttrs, seedingReports, successfulSplits, locCount
+        );
     };
 
 public:
@@ -293,6 +344,35 @@ public:
         return std::make_optional(std::make_pair(std::string(query), relativePath));
     }
 
+    // Everything besides file contents that decides the Pioneer output of a translation unit.
+    // Options that only change how fast it is computed, such as thread counts, are left out.
+    static std::uint64_t pioneerArtifactConfigHash
+    (
+        const CompileCommand & command,
+        const std::optional<std::vector<std::string>> & symbolicMacroWhitelist,
+        const SymbolicExecutorOptions & pioneerOptions
+    )
+    {
+        std::vector<std::string> options;
+        options.push_back(ClangExe.string()); // Supplies the predefined macros
+        options.push_back(command.file.string());
+        for (const std::filesystem::path & includePath : command.getIncludePaths())
+        {
+            options.push_back(includePath.string());
+        }
+        options.push_back(std::format("whitelist={}", symbolicMacroWhitelist.has_value()));
+        if (symbolicMacroWhitelist)
+        {
+            options.insert(options.end(), symbolicMacroWhitelist->begin(), symbolicMacroWhitelist->end());
+        }
+        options.push_back(std::format("iteMergeLimit={}", pioneerOptions.iteMergeLimit));
+        // Summaries are replayed, not re-executed, so they are kept apart even though they should agree
+        options.push_back(std::format("memoizeHeaders={}", pioneerOptions.memoizeHeaders));
+        options.push_back(std::format("simplifyTier={}", static_cast<int>(pioneerOptions.simplifyTier)));
+        options.push_back(std::format("intEncoding={}", static_cast<int>(pioneerOptions.intEncoding)));
+        return PioneerArtifact::configHash(options);
+    }
+
     static int run
     (
         const std::filesystem::path & compileCommandsJsonPath,
@@ -302,7 +382,8 @@ public:
         const bool enableInline,
         const bool keepSrcLoc,
         std::size_t jobs,
-        std::optional<std::string> binaryTargetName
+        std::optional<std::string> binaryTargetName,
+        const PipelineOptions & options = {}
     )
     {
         // Load compile_commands.json
@@ -360,6 +441,9 @@ public:
 
         std::atomic<std::size_t> nextIdx{0};
         std::atomic<std::size_t> totalSuccessfulSplits{0};
+        // Cover planning only: DefineSets generated, and those greedy planning would have generated
+        std::atomic<std::size_t> totalPlannedSplits{0};
+        std::atomic<std::size_t> totalGreedySplits{0};
         std::atomic<std::size_t> completedTasks{0};
 
         auto worker = [&]()
@@ -372,6 +456,37 @@ public:
                 std::filesystem::path srcPath = command.file;
                 StageTimer stageTimer;
                 std::size_t taskSuccessfulSplits = 0;
+                const std::filesystem::path taskRecordPath = command.withSanitizedPaths(projDir)
+                    .withUpdatedFilePathPrefix(outputDir / "src", projDir)
+                    .withUpdatedFileExtension(".task.json")
+                    .file;
+
+                // Tasks left out of a partial run contribute what their last run recorded
+                if (options.tasksToRun && !options.tasksToRun->contains(command.file) && std::filesystem::exists(taskRecordPath))
+                {
+                    try
+                    {
+                        const TaskRecord record = json::parse(loadFileToString(taskRecordPath)).get<TaskRecord>();
+                        {
+                            std::lock_guard<std::mutex> lk(collectionMutex);
+                            allCargoTomls.insert(allCargoTomls.end(), record.cargoTomls.begin(), record.cargoTomls.end());
+                            allRustFeatureAtoms.insert(record.rustFeatureAtoms.begin(), record.rustFeatureAtoms.end());
+                            allC2RustInnerAttrs.insert(record.c2RustInnerAttrs.begin(), record.c2RustInnerAttrs.end());
+                            allSeedingReports.insert(allSeedingReports.end(), record.seedingReports.begin(), record.seedingReports.end());
+                        }
+                        totalSuccessfulSplits += record.successfulSplits;
+                        completedTasks++;
+                        totalLocCount += record.locCount;
+                        SPDLOG_INFO("Task {}/{} {} unchanged", taskIdx + 1, numTasks, command.file.string());
+                        continue;
+                    }
+                    catch (const std::exception & e)
+                    {
+                        SPDLOG_WARN("Rerunning task {}: unreadable task record: {}", command.file.string(), e.what());
+                    }
+                }
+                // A task that fails this time must not be replayed from its last success
+                std::filesystem::remove(taskRecordPath);
 
                 try
                 {
@@ -392,11 +507,48 @@ public:
 
                     // Hayroll Pioneer symbolic execution
                     // compileCommands + cpp2cStr --SymbolicExecutor-> includeTree + premiseTree
-                    SymbolicExecutor executor(srcPath, projDir, command.getIncludePaths(), symbolicMacroWhitelist, false);
+                    SymbolicExecutor executor(srcPath, projDir, command.getIncludePaths(), symbolicMacroWhitelist, false, options.pioneer);
+                    // Pioneer output, owned by the executor or by an artifact saved by a previous run
+                    std::optional<PioneerArtifact> pioneerArtifact;
+                    IncludeTreePtr includeTree = executor.includeTree.get();
+                    const ASTBank * astBank = &executor.astBank;
                     PremiseTree * premiseTree = nullptr;
+                    const std::uint64_t pioneerConfigHash = pioneerArtifactConfigHash
+                    (
+                        command,
+                        symbolicMacroWhitelist,
+                        options.pioneer
+                    );
+                    {
+                        StageTimer::Scope stage(stageTimer, StageNames::Pioneer);
+                        const std::filesystem::path pioneerArtifactPath = command.withSanitizedPaths(projDir)
+                            .withUpdatedFilePathPrefix(outputDir / "src", projDir)
+                            .withUpdatedFileExtension(".pioneer")
+                            .file;
+                        if (options.reusePioneer && std::filesystem::exists(pioneerArtifactPath))
+                        {
+                            try
+                            {
+                                pioneerArtifact = PioneerArtifact::deserialize(loadFileToString(pioneerArtifactPath), pioneerConfigHash);
+                            }
+                            catch (const std::exception & e)
+                            {
+                                SPDLOG_WARN("Ignoring unreadable Pioneer artifact {}: {}", pioneerArtifactPath.string(), e.what());
+                            }
+                        }
+                    }
+                    if (pioneerArtifact)
+                    {
+                        SPDLOG_INFO("Reusing Pioneer artifact for {}", command.file.string());
+                        includeTree = pioneerArtifact->includeTree.get();
+                        astBank = pioneerArtifact->astBank.get();
+                        premiseTree = pioneerArtifact->premiseTree.get();
+                    }
+                    else
                     {
                         StageTimer::Scope stage(stageTimer, StageNames::Pioneer);
                         executor.run();
+                        stageTimer.setPioneerStats(executor.statsJson());
                         premiseTree = executor.scribe.borrowTree();
                         saveOutput
                         (
@@ -409,7 +561,7 @@ public:
                             command.file.string(),
                             std::nullopt
                         );
-                        premiseTree->refine();
+                        premiseTree->refine(options.pioneer.checkThreads);
                         saveOutput
                         (
                             command,
@@ -421,6 +573,21 @@ public:
                             command.file.string(),
                             std::nullopt
                         );
+                        // Only runs that may load it again pay for writing it (--reuse-pioneer, watch mode)
+                        if (options.reusePioneer)
+                        {
+                            saveOutput
+                            (
+                                command,
+                                outputDir,
+                                projDir,
+                                PioneerArtifact::serialize(includeTree, *premiseTree, pioneerConfigHash),
+                                ".pioneer",
+                                "Pioneer artifact",
+                                command.file.string(),
+                                std::nullopt
+                            );
+                        }
                     }
 
                     // Splitter two-phase: gather Maki successes, then run downstream with complemented ranges
@@ -438,7 +605,7 @@ public:
                     };
 
                     std::vector<MakiCandidate> makiCandidates;
-                    Splitter splitter(premiseTree, command);
+                    Splitter splitter(premiseTree, command, options.splitPlanning);
                     Splitter::Feedback feedback = Splitter::Feedback::initial();
 
                     auto runMaki = [&](const DefineSet & defineSet) -> bool
@@ -453,11 +620,11 @@ public:
                             const auto lineMapResults = LineMatcher::run
                             (
                                 cuStr,
-                                executor.includeTree,
+                                includeTree,
                                 command.getIncludePaths()
                             );
                             auto [codeRangeAnalysisTasks, atoms]
-                                = premiseTree->getCodeRangeAnalysisTasksAndRustFeatureAtoms(lineMapResults.first);
+                                = premiseTree->getCodeRangeAnalysisTasksAndRustFeatureAtoms(lineMapResults.first, *astBank);
 
                             std::string cpp2cStr = MakiWrapper::runCpp2cOnCu(commandWithDefineSet, codeRangeAnalysisTasks);
                             auto [invocations, ranges] = parseCpp2cSummary(cpp2cStr);
@@ -516,6 +683,25 @@ public:
                         runMaki(*defineSetOpt);
                     }
 
+                    if (options.splitPlanning == SplitPlanning::Cover)
+                    {
+                        // Greedy planning, assuming every DefineSet succeeds, for comparison
+                        std::size_t greedySplits = 0;
+                        {
+                            StageTimer::Scope stage(stageTimer, StageNames::Splitter);
+                            greedySplits = Splitter::countSplits(premiseTree, command, SplitPlanning::Greedy);
+                        }
+                        SPDLOG_INFO
+                        (
+                            "Splitter planned {} DefineSet(s) for {} ({} with greedy planning)",
+                            splitter.generated(),
+                            command.file.string(),
+                            greedySplits
+                        );
+                        totalPlannedSplits += splitter.generated();
+                        totalGreedySplits += greedySplits;
+                    }
+
                     if (makiCandidates.empty())
                     {
                         SPDLOG_WARN("No Maki-successful DefineSet; falling back to empty DefineSet.");
@@ -540,6 +726,18 @@ public:
                         inverseLineMapList
                     );
 
+                    // Compact tags: one side-table per TU, shared by all splits so that ids stay unique across merges
+                    // Salted with the code of all splits, which then cannot contain a string literal that reads as a tag
+                    std::size_t tagSalt = 0;
+                    for (const MakiCandidate & candidate : makiCandidates)
+                    {
+                        tagSalt = hashCombine(tagSalt, std::hash<std::string>{}(candidate.cuStr));
+                    }
+                    Seeder::TagTable tagTable(tagSalt);
+                    TempDir tagTableDir;
+                    std::optional<std::filesystem::path> tagTablePath;
+                    if (options.compactTags) tagTablePath = tagTableDir.getPath() / "tags.jsonl";
+
                     std::vector<DefineSet> successfulDefineSets;
                     std::vector<std::string> cargoTomls;
                     std::vector<std::string> reapedStrs;
@@ -573,10 +771,12 @@ public:
                                     cpp2cRangesCompleted,
                                     candidate.cuStr,
                                     candidate.lineMap,
-                                    candidate.inverseLineMap
+                                    candidate.inverseLineMap,
+                                    options.compactTags ? &tagTable : nullptr
                                 );
                                 cuSeededStr = std::move(std::get<0>(seederResult));
                                 seedingReportEntries = std::move(std::get<1>(seederResult));
+                                if (tagTablePath) saveStringToFile(tagTable.toJsonLines(), *tagTablePath);
                             }
 
                             {
@@ -591,7 +791,7 @@ public:
                             {
                                 failedStage = StageNames::Reaper;
                                 StageTimer::Scope stage(stageTimer, StageNames::Reaper);
-                                reapedStr = RustRefactorWrapper::runReaper(c2rustStr, keepSrcLoc);
+                                reapedStr = RustRefactorWrapper::runReaper(c2rustStr, keepSrcLoc, tagTablePath);
                             }
 
                             if (enableInline)
@@ -772,6 +972,20 @@ public:
                         command.file.string(),
                         std::nullopt
                     );
+                    if (options.compactTags)
+                    {
+                        saveOutput
+                        (
+                            command,
+                            outputDir,
+                            projDir,
+                            tagTable.toJsonLines(),
+                            ".tags.jsonl",
+                            "Hayroll tag side-table",
+                            command.file.string(),
+                            std::nullopt
+                        );
+                    }
                     std::vector<std::string> mergedRustStrs;
                     mergedRustStrs.reserve(reapedStrs.size());
                     mergedRustStrs.push_back(reapedStrs[0]);
@@ -779,7 +993,7 @@ public:
                         StageTimer::Scope stage(stageTimer, StageNames::Merger);
                         for (std::size_t i = 1; i < reapedStrs.size(); ++i)
                         {
-                            std::string merged = RustRefactorWrapper::runMerger(mergedRustStrs[i - 1], reapedStrs[i], keepSrcLoc);
+                            std::string merged = RustRefactorWrapper::runMerger(mergedRustStrs[i - 1], reapedStrs[i], keepSrcLoc, tagTablePath);
                             saveOutput
                             (
                                 command,
@@ -797,7 +1011,7 @@ public:
 
                         // Cleaner shares merger's stage timer
 
-                        finalRustStr = RustRefactorWrapper::runCleaner(finalRustStr, keepSrcLoc);
+                        finalRustStr = RustRefactorWrapper::runCleaner(finalRustStr, keepSrcLoc, tagTablePath);
                         saveOutput
                         (
                             command,
@@ -827,11 +1041,34 @@ public:
                         allSeedingReports.insert(allSeedingReports.end(), seedingReports.begin(), seedingReports.end());
                     }
 
+                    stageTimer.setSolverCacheStats(executor.queryCache->hits, executor.queryCache->misses);
+
                     totalSuccessfulSplits += taskSuccessfulSplits;
                     completedTasks++;
                     int avgLocCount = successfulDefineSets.empty() ? 0 : taskLocCount / static_cast<int>(successfulDefineSets.size());
                     totalLocCount += avgLocCount;
 
+                    const TaskRecord record
+                    {
+                        cargoTomls,
+                        rustFeatureAtoms,
+                        c2RustInnerAttrs,
+                        seedingReports,
+                        taskSuccessfulSplits,
+                        avgLocCount
+                    };
+                    saveOutput
+                    (
+                        command,
+                        outputDir,
+                        projDir,
+                        json(record).dump(),
+                        ".task.json",
+                        "Task record",
+                        command.file.string(),
+                        std::nullopt
+                    );
+
                     SPDLOG_INFO("Task {}/{} {} completed", taskIdx + 1, numTasks, command.file.string());
                 }
                 catch (const std::exception & e)
@@ -991,6 +1228,14 @@ public:
             averageSplitsPerTask,
             completedTaskCount
         );
+        if (options.splitPlanning == SplitPlanning::Cover)
+        {
+            SPDLOG_INFO(
+                "Planned DefineSets: {} with cover planning; {} with greedy planning",
+                totalPlannedSplits.load(std::memory_order_relaxed),
+                totalGreedySplits.load(std::memory_order_relaxed)
+            );
+        }
 
         // Print final results
         if (!failedTasks.empty())
@@ -0,0 +1,283 @@
+// Hash-consed reduced ordered BDDs for premises over boolean atoms only (defXXX).
+// Such premises are decided and simplified here without calling into z3 tactics or the solver;
+// anything involving valXXX arithmetic is rejected and left to z3.
+
+#ifndef HAYROLL_PREMISEBDD_HPP
+#define HAYROLL_PREMISEBDD_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <initializer_list>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include <z3++.h>
+
+namespace Hayroll
+{
+
+class PremiseBdd
+{
+public:
+    // Handle of a node, only meaningful within the PremiseBdd that made it.
+    using Ref = std::uint32_t;
+    static constexpr Ref False = 0;
+    static constexpr Ref True = 1;
+    // Building gives up, leaving the premise to z3, once this many nodes exist.
+    static constexpr std::size_t DefaultNodeBudget = 1 << 16;
+
+    // A manager scoped to one query. Variables are the atoms of the given expressions ordered by name,
+    // so a result depends only on these expressions and not on what was built before.
+    explicit PremiseBdd(std::initializer_list<z3::expr> exprs, std::size_t nodeBudget = DefaultNodeBudget)
+        : nodeBudget(nodeBudget)
+    {
+        nodes.assign({Node{TerminalVar, False, False}, Node{TerminalVar, True, True}});
+        std::unordered_set<unsigned> visited;
+        for (const z3::expr & expr : exprs) collectAtoms(expr, visited);
+        std::ranges::sort(atomOfVar);
+        atomOfVar.erase(std::unique(atomOfVar.begin(), atomOfVar.end()), atomOfVar.end());
+        for (std::uint32_t var = 0; var < atomOfVar.size(); ++var) varOfAtom.emplace(atomOfVar[var], var);
+    }
+
+    std::size_t size() const
+    {
+        return nodes.size();
+    }
+
+    // Build the BDD of a premise given at construction, or nullopt if it contains anything
+    // but boolean connectives and boolean constants, or if building it exceeds the node budget.
+    std::optional<Ref> fromExpr(const z3::expr & expr)
+    {
+        std::unordered_map<unsigned, Ref> memo;
+        try
+        {
+            return build(expr, memo);
+        }
+        catch (const NodeBudgetExceeded &)
+        {
+            return std::nullopt;
+        }
+    }
+
+    // Lower a BDD back to a z3 expression by Shannon expansion, sharing lowered subgraphs.
+    z3::expr toExpr(Ref f, z3::context & ctx) const
+    {
+        std::unordered_map<Ref, z3::expr> memo;
+        return lower(f, ctx, memo);
+    }
+
+    Ref ite(Ref f, Ref g, Ref h)
+    {
+        if (f == True) return g;
+        if (f == False) return h;
+        if (g == h) return g;
+        if (g == True && h == False) return f;
+
+        const IteKey key{f, g, h};
+        if (auto it = iteCache.find(key); it != iteCache.end()) return it->second;
+
+        const std::uint32_t var = std::min({topVar(f), topVar(g), topVar(h)});
+        const Ref hi = ite(cofactor(f, var, true), cofactor(g, var, true), cofactor(h, var, true));
+        const Ref lo = ite(cofactor(f, var, false), cofactor(g, var, false), cofactor(h, var, false));
+        const Ref result = makeNode(var, lo, hi);
+        iteCache.emplace(key, result);
+        return result;
+    }
+
+    Ref bddNot(Ref f)
+    {
+        return ite(f, False, True);
+    }
+
+    Ref bddAnd(Ref f, Ref g)
+    {
+        return ite(f, g, False);
+    }
+
+    Ref bddOr(Ref f, Ref g)
+    {
+        return ite(f, True, g);
+    }
+
+    Ref bddXor(Ref f, Ref g)
+    {
+        return ite(f, bddNot(g), g);
+    }
+
+private:
+    static constexpr std::uint32_t TerminalVar = UINT32_MAX;
+
+    // Thrown out of the recursion in build() and caught in fromExpr().
+    struct NodeBudgetExceeded {};
+
+    struct Node
+    {
+        std::uint32_t var;
+        Ref lo;
+        Ref hi;
+    };
+
+    struct IteKey
+    {
+        Ref f, g, h;
+        bool operator==(const IteKey &) const = default;
+    };
+
+    struct IteKeyHash
+    {
+        std::size_t operator()(const IteKey & key) const noexcept
+        {
+            std::uint64_t h = key.f;
+            h = h * 0x9e3779b97f4a7c15ULL + key.g;
+            h = h * 0x9e3779b97f4a7c15ULL + key.h;
+            return static_cast<std::size_t>(h ^ (h >> 29));
+        }
+    };
+
+    std::size_t nodeBudget;
+    std::vector<Node> nodes;
+    // (var, lo, hi) -> node, so structurally equal nodes are the same Ref
+    std::unordered_map<IteKey, Ref, IteKeyHash> uniqueTable;
+    std::unordered_map<IteKey, Ref, IteKeyHash> iteCache;
+    // Variable order is the name order of the atoms.
+    std::unordered_map<std::string, std::uint32_t> varOfAtom;
+    std::vector<std::string> atomOfVar;
+
+    std::uint32_t topVar(Ref f) const
+    {
+        return nodes[f].var;
+    }
+
+    Ref cofactor(Ref f, std::uint32_t var, bool value) const
+    {
+        const Node & node = nodes[f];
+        if (node.var != var) return f;
+        return value ? node.hi : node.lo;
+    }
+
+    Ref makeNode(std::uint32_t var, Ref lo, Ref hi)
+    {
+        if (lo == hi) return lo;
+        const IteKey key{var, lo, hi};
+        if (auto it = uniqueTable.find(key); it != uniqueTable.end()) return it->second;
+        if (nodes.size() >= nodeBudget) throw NodeBudgetExceeded{};
+        const Ref ref = static_cast<Ref>(nodes.size());
+        nodes.push_back(Node{var, lo, hi});
+        uniqueTable.emplace(key, ref);
+        return ref;
+    }
+
+    void collectAtoms(const z3::expr & expr, std::unordered_set<unsigned> & visited)
+    {
+        if (!expr.is_app() || !visited.insert(expr.id()).second) return;
+        if (expr.is_bool() && expr.num_args() == 0 && expr.decl().decl_kind() == Z3_OP_UNINTERPRETED)
+        {
+            atomOfVar.push_back(expr.decl().name().str());
+            return;
+        }
+        for (unsigned i = 0; i < expr.num_args(); ++i) collectAtoms(expr.arg(i), visited);
+    }
+
+    std::optional<Ref> atom(const std::string & name)
+    {
+        auto it = varOfAtom.find(name);
+        // Not among the expressions given at construction
+        if (it == varOfAtom.end()) return std::nullopt;
+        return makeNode(it->second, False, True);
+    }
+
+    std::optional<Ref> build(const z3::expr & expr, std::unordered_map<unsigned, Ref> & memo)
+    {
+        if (!expr.is_app() || !expr.is_bool()) return std::nullopt;
+        if (auto it = memo.find(expr.id()); it != memo.end()) return it->second;
+
+        std::vector<Ref> args;
+        args.reserve(expr.num_args());
+        for (unsigned i = 0; i < expr.num_args(); ++i)
+        {
+            std::optional<Ref> arg = build(expr.arg(i), memo);
+            if (!arg) return std::nullopt;
+            args.push_back(*arg);
+        }
+
+        Ref result;
+        switch (expr.decl().decl_kind())
+        {
+            case Z3_OP_TRUE:
+                result = True;
+                break;
+            case Z3_OP_FALSE:
+                result = False;
+                break;
+            case Z3_OP_UNINTERPRETED:
+            {
+                if (!args.empty()) return std::nullopt;
+                std::optional<Ref> var = atom(expr.decl().name().str());
+                if (!var) return std::nullopt;
+                result = *var;
+                break;
+            }
+            case Z3_OP_NOT:
+                result = bddNot(args[0]);
+                break;
+            case Z3_OP_AND:
+                result = True;
+                for (Ref arg : args) result = bddAnd(result, arg);
+                break;
+            case Z3_OP_OR:
+                result = False;
+                for (Ref arg : args) result = bddOr(result, arg);
+                break;
+            case Z3_OP_IMPLIES:
+                result = bddOr(bddNot(args[0]), args[1]);
+                break;
+            case Z3_OP_XOR:
+                result = bddXor(args[0], args[1]);
+                break;
+            case Z3_OP_IFF:
+            case Z3_OP_EQ:
+                // Operands are known to be boolean, since build() succeeded on them.
+                result = bddNot(bddXor(args[0], args[1]));
+                break;
+            case Z3_OP_DISTINCT:
+                if (args.size() != 2) return std::nullopt;
+                result = bddXor(args[0], args[1]);
+                break;
+            case Z3_OP_ITE:
+                result = ite(args[0], args[1], args[2]);
+                break;
+            default:
+                return std::nullopt;
+        }
+        memo.emplace(expr.id(), result);
+        return result;
+    }
+
+    z3::expr lower(Ref f, z3::context & ctx, std::unordered_map<Ref, z3::expr> & memo) const
+    {
+        if (f == True) return ctx.bool_val(true);
+        if (f == False) return ctx.bool_val(false);
+        if (auto it = memo.find(f); it != memo.end()) return it->second;
+
+        const Node & node = nodes[f];
+        const z3::expr v = ctx.bool_const(atomOfVar[node.var].c_str());
+        z3::expr result(ctx);
+        if (node.lo == False && node.hi == True) result = v;
+        else if (node.lo == True && node.hi == False) result = !v;
+        else if (node.lo == False) result = v && lower(node.hi, ctx, memo);
+        else if (node.hi == False) result = !v && lower(node.lo, ctx, memo);
+        else if (node.lo == True) result = !v || lower(node.hi, ctx, memo);
+        else if (node.hi == True) result = v || lower(node.lo, ctx, memo);
+        else result = (v && lower(node.hi, ctx, memo)) || (!v && lower(node.lo, ctx, memo));
+        memo.emplace(f, result);
+        return result;
+    }
+};
+
+} // namespace Hayroll
+
+#endif // HAYROLL_PREMISEBDD_HPP
@@ -11,6 +11,9 @@
 #include <string>
 #include <set>
 #include <tuple>
+#include <thread>
+#include <exception>
+#include <optional>
 
 #include <z3++.h>
 
@@ -18,8 +21,10 @@
 
 #include "Util.hpp"
 #include "IncludeTree.hpp"
+#include "ProgramPoint.hpp"
 #include "TreeSitter.hpp"
 #include "TreeSitterCPreproc.hpp"
+#include "ASTBank.hpp"
 #include "MakiWrapper.hpp"
 #include "DefineSet.hpp"
 
@@ -192,51 +197,76 @@ struct PremiseTree
     }
 
     // Simplify premises of all descendants.
-    void refine()
+    // With threads > 1, the subtrees of the children are refined on that many threads, each with a
+    // private z3 context. Premises are translated there and back on the calling thread.
+    // Without a PremiseSimplifier serving the context, e.g. once the executor is gone,
+    // one with the default tier is kept for the duration of the call.
+    void refine(std::size_t threads = 1)
     {
-        premise = simplifyOrOfAnd(premise);
-        std::unordered_map<ProgramPoint, z3::expr, ProgramPoint::Hasher> newMacroPremises;
-        for (auto & [macroProgramPoint, macroPremise] : macroPremises)
+        z3::context & ctx = premise.ctx();
+        std::optional<PremiseSimplifier> scopedSimplifier;
+        if (!ContextRegistry<PremiseSimplifier>::find(ctx)) scopedSimplifier.emplace(ctx);
+        std::vector<z3::expr> path;
+        if (threads <= 1 || children.size() < 2)
         {
-            if (z3CheckTautology(z3::implies(getCompletePremise(), macroPremise)))
-            {
-                SPDLOG_TRACE("Eliminating macro premise: {}", macroPremise.to_string());
-                continue;
-            }
-            macroPremise = simplifyOrOfAnd(macroPremise);
-            newMacroPremises.emplace(macroProgramPoint, macroPremise);
+            refineUnder(ctx.bool_val(true), path);
+            return;
         }
-        macroPremises = std::move(newMacroPremises);
 
-        std::vector<PremiseTreePtr> newChildren;
-        for (PremiseTreePtr & child : children)
-        {
-            child->refine();
-            
-            // If the child is always false, we can remove the child node.
-            if (!child->isMacroExpansion() && z3CheckContradiction(child->getCompletePremise()))
-            {
-                SPDLOG_TRACE("Eliminating constant-false child node: {}", child->toString());
-                continue;
-            }
+        const z3::expr completePremise = refineSelf(ctx.bool_val(true), path);
 
-            // If the current node's premise implies the child's premise,
-            // we can remove it and promote its children.
-            if (!child->isMacroExpansion() && z3CheckTautology(z3::implies(getCompletePremise(), child->premise)))
-            {
-                SPDLOG_TRACE("Eliminating implied child node: {}", child->toString());
-                for (PremiseTreePtr & grandchild : child->children)
+        // Workers simplify with the same settings as this context
+        const PremiseSimplifier * simplifier = ContextRegistry<PremiseSimplifier>::find(ctx);
+        const SimplifyTier tier = simplifier ? simplifier->getTier() : PremiseSimplifier::DefaultTier;
+        const std::size_t sizeThreshold = simplifier ? simplifier->getSizeThreshold() : PremiseSimplifier::DefaultSizeThreshold;
+        const unsigned timeoutMs = simplifier ? simplifier->getTimeoutMs() : PremiseSimplifier::DefaultTimeoutMs;
+
+        // Fork: deal the children round-robin. Workers have not started, so their contexts are ours to touch.
+        std::vector<std::unique_ptr<RefineWorker>> workers;
+        for (std::size_t i = 0; i < std::min(threads, children.size()); ++i)
+        {
+            workers.push_back(std::make_unique<RefineWorker>());
+        }
+        for (std::size_t i = 0; i < children.size(); ++i)
+        {
+            RefineWorker & worker = *workers[i % workers.size()];
+            children[i]->translateTo(worker.ctx);
+            worker.subtrees.push_back(children[i].get());
+        }
+        for (std::unique_ptr<RefineWorker> & worker : workers)
+        {
+            worker->completePremise.emplace(translate(completePremise, worker->ctx));
+            for (const z3::expr & expr : path) worker->path.push_back(translate(expr, worker->ctx));
+            worker->thread = std::thread
+            (
+                [w = worker.get(), tier, sizeThreshold, timeoutMs]()
                 {
-                    grandchild->parent = this;
-                    newChildren.push_back(std::move(grandchild));
+                    try
+                    {
+                        Z3QueryCache queryCache(w->ctx);
+                        PremiseSimplifier workerSimplifier(w->ctx, tier, sizeThreshold, timeoutMs);
+                        for (PremiseTree * subtree : w->subtrees)
+                        {
+                            subtree->refineUnder(*w->completePremise, w->path);
+                        }
+                    }
+                    catch (...)
+                    {
+                        w->error = std::current_exception();
+                    }
                 }
-            }
-            else
-            {
-                newChildren.push_back(std::move(child));
-            }
+            );
         }
-        children = std::move(newChildren);
+
+        // Join, then bring the premises back before anything else reads them
+        for (std::unique_ptr<RefineWorker> & worker : workers) worker->thread.join();
+        for (PremiseTreePtr & child : children) child->translateTo(ctx);
+        for (std::unique_ptr<RefineWorker> & worker : workers)
+        {
+            if (worker->error) std::rethrow_exception(worker->error);
+        }
+
+        pruneChildren(completePremise, path);
     }
 
     std::list<const PremiseTree *> getDescendantsPreOrder() const
@@ -286,9 +316,11 @@ struct PremiseTree
     // Generates code range analysis tasks for each descendant node.
     // The row and column number in the return value is that in the compilation unit file, i.e. line-mapped.
     // Also returns the set of atoms (defXXX) it contains for the complete premise of each node.
+    // Token spans and enclosing #if nodes come from the directive indices of astBank, which parsed the files.
     std::tuple<std::vector<CodeRangeAnalysisTask>, std::set<std::string>> getCodeRangeAnalysisTasksAndRustFeatureAtoms
     (
-        const std::unordered_map<Hayroll::IncludeTreePtr, std::vector<int>> & lineMap
+        const std::unordered_map<Hayroll::IncludeTreePtr, std::vector<int>> & lineMap,
+        const ASTBank & astBank
     ) const
     {
         CPreproc lang = CPreproc();
@@ -318,22 +350,11 @@ struct PremiseTree
             const std::vector<int> & lineNumbers = lineMap.at(includeTree);
 
             // This tsNode must be a block_items node
-            // Find in all its descendants the c_token nodes (whose parent is c_tokens)
+            // Use the beginLoc of the first c_token descendant and the endLoc of the last c_token descendant that is not a comment.
             // If it does not have any c_tokens descendants, skip it.
-            // Otherwise, use the beginLoc of the first c_token descendant and the endLoc of the last c_token descendant that is not a comment.
             assert(tsNode.isSymbol(lang.block_items_s));
-            auto cTokenView =
-                std::views::all(tsNode.iterateDescendants())
-                | std::views::filter([&lang](const TSNode & node)
-                    {
-                        if (!node.parent()) return false;
-                        if (!node.parent().isSymbol(lang.c_tokens_s)) return false;
-                        if (node.isSymbol(lang.comment_s)) return false;
-                        return true;
-                    });
-            std::vector<TSNode> cTokenNodes;
-            std::ranges::copy(cTokenView, std::back_inserter(cTokenNodes));
-            if (cTokenNodes.empty())
+            const DirectiveIndex::Block & block = astBank.index(tsNode).blocks.at(tsNode);
+            if (!block.firstCToken)
             {
                 SPDLOG_TRACE
                 (
@@ -343,24 +364,16 @@ struct PremiseTree
                 );
                 continue;
             }
-            const TSNode & firstCToken = cTokenNodes.front();
-            const TSNode & lastCToken = cTokenNodes.back();
+            const TSNode & firstCToken = block.firstCToken;
+            const TSNode & lastCToken = block.lastCToken;
             int beginLine = lineNumbers.at(firstCToken.startPoint().row + 1);
             int beginCol = static_cast<int>(firstCToken.startPoint().column) + 1;
             int endLine = lineNumbers.at(lastCToken.endPoint().row + 1);
             int endCol = static_cast<int>(lastCToken.endPoint().column) + 1;
 
-            // Find the nearest ancestor node that is a preproc_if/preproc_ifdef/preproc_ifndef node
-            TSNode ifNode = tsNode;
-            while 
-            (
-                !ifNode.isSymbol(lang.preproc_if_s) &&
-                !ifNode.isSymbol(lang.preproc_ifdef_s) &&
-                !ifNode.isSymbol(lang.preproc_ifndef_s)
-            )
-            {
-                ifNode = ifNode.parent();
-            }
+            // The nearest ancestor node that is a preproc_if/preproc_ifdef/preproc_ifndef node
+            const TSNode & ifNode = block.conditional;
+            assert(ifNode);
             int ifBeginLine = lineNumbers.at(ifNode.startPoint().row + 1);
             int ifBeginCol = static_cast<int>(ifNode.startPoint().column) + 1;
             int ifEndLine = lineNumbers.at(ifNode.endPoint().row + 1);
@@ -517,6 +530,124 @@ struct PremiseTree
         }
         return {cfg, std::move(atoms)};
     }
+
+private:
+    struct RefineWorker
+    {
+        z3::context ctx;
+        // Declared after ctx so the translated expressions die before their context.
+        std::optional<z3::expr> completePremise;
+        std::vector<z3::expr> path;
+        std::vector<PremiseTree *> subtrees;
+        std::exception_ptr error;
+        std::thread thread;
+    };
+
+    static z3::expr translate(const z3::expr & expr, z3::context & ctx)
+    {
+        return z3::expr(ctx, Z3_translate(expr.ctx(), expr, ctx));
+    }
+
+    // Move every premise of the subtree into ctx
+    void translateTo(z3::context & ctx)
+    {
+        premise = translate(premise, ctx);
+        for (auto & [macroProgramPoint, macroPremise] : macroPremises)
+        {
+            macroPremise = translate(macroPremise, ctx);
+        }
+        for (PremiseTreePtr & child : children)
+        {
+            child->translateTo(ctx);
+        }
+    }
+
+    // Whether expr follows from the premises on the path from the root without asking the solver:
+    // it is true, one of them, or a conjunct of one of them.
+    static bool impliedByPath(const z3::expr & expr, const std::vector<z3::expr> & path)
+    {
+        if (expr.is_true()) return true;
+        for (const z3::expr & pathPremise : path)
+        {
+            if (z3::eq(pathPremise, expr)) return true;
+            if (!pathPremise.is_and()) continue;
+            for (unsigned i = 0; i < pathPremise.num_args(); ++i)
+            {
+                if (z3::eq(pathPremise.arg(i), expr)) return true;
+            }
+        }
+        return false;
+    }
+
+    // Simplify this node's own premises, given the conjunction of its ancestors' premises.
+    // Pushes the simplified premise onto path and returns this node's complete premise.
+    z3::expr refineSelf(const z3::expr & ancestorsPremise, std::vector<z3::expr> & path)
+    {
+        premise = simplifyOrOfAnd(premise);
+        path.push_back(premise);
+        const z3::expr completePremise = premise && ancestorsPremise;
+
+        std::unordered_map<ProgramPoint, z3::expr, ProgramPoint::Hasher> newMacroPremises;
+        for (auto & [macroProgramPoint, macroPremise] : macroPremises)
+        {
+            if (impliedByPath(macroPremise, path) || z3CheckTautology(z3::implies(completePremise, macroPremise)))
+            {
+                SPDLOG_TRACE("Eliminating macro premise: {}", macroPremise.to_string());
+                continue;
+            }
+            macroPremise = simplifyOrOfAnd(macroPremise);
+            newMacroPremises.emplace(macroProgramPoint, macroPremise);
+        }
+        macroPremises = std::move(newMacroPremises);
+        return completePremise;
+    }
+
+    void refineUnder(const z3::expr & ancestorsPremise, std::vector<z3::expr> & path)
+    {
+        const z3::expr completePremise = refineSelf(ancestorsPremise, path);
+        for (PremiseTreePtr & child : children)
+        {
+            child->refineUnder(completePremise, path);
+        }
+        pruneChildren(completePremise, path);
+        path.pop_back();
+    }
+
+    // Drop refined children that are always false, and promote the children of those this node implies.
+    void pruneChildren(const z3::expr & completePremise, const std::vector<z3::expr> & path)
+    {
+        std::vector<PremiseTreePtr> newChildren;
+        for (PremiseTreePtr & child : children)
+        {
+            // If the child is always false, we can remove the child node.
+            if (!child->isMacroExpansion() && z3CheckContradiction(child->premise && completePremise))
+            {
+                SPDLOG_TRACE("Eliminating constant-false child node: {}", child->toString());
+                continue;
+            }
+
+            // If the current node's premise implies the child's premise,
+            // we can remove it and promote its children.
+            if
+            (
+                !child->isMacroExpansion()
+                && (impliedByPath(child->premise, path) || z3CheckTautology(z3::implies(completePremise, child->premise)))
+            )
+            {
+                SPDLOG_TRACE("Eliminating implied child node: {}", child->toString());
+                for (PremiseTreePtr & grandchild : child->children)
+                {
+                    grandchild->parent = this;
+                    newChildren.push_back(std::move(grandchild));
+                }
+            }
+            else
+            {
+                newChildren.push_back(std::move(child));
+            }
+        }
+        children = std::move(newChildren);
+    }
 };
 
 // A helper class that takes down info during symbolic execution to build the premise tree.
@@ -0,0 +1,82 @@
+// Interned preprocessor tokens for macro expansion.
+// A token is the id of its text plus a kind, so expansion copies and compares small integers
+// instead of tree-sitter nodes and strings.
+
+#ifndef HAYROLL_PREPROCTOKEN_HPP
+#define HAYROLL_PREPROCTOKEN_HPP
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+
+#include "TreeSitter.hpp"
+#include "TreeSitterCPreproc.hpp"
+
+namespace Hayroll
+{
+
+struct PreprocToken
+{
+    enum class Kind : std::uint8_t
+    {
+        Identifier,
+        Defined, // preproc_defined_literal
+        LeftParen,
+        RightParen,
+        Comma,
+        Parameter, // Identifier naming a parameter, only in interned function-like macro bodies
+        Other
+    };
+
+    std::uint32_t id; // Id of the text in the TokenInterner
+    std::uint16_t param; // Parameter index, only meaningful for Kind::Parameter
+    Kind kind;
+
+    bool operator==(const PreprocToken & other) const = default;
+};
+
+// Maps token texts to dense ids and back. Texts are copied, so ids outlive the trees they came from.
+class TokenInterner
+{
+public:
+    std::uint32_t intern(std::string_view text)
+    {
+        if (auto it = ids.find(text); it != ids.end()) return it->second;
+        const std::uint32_t id = static_cast<std::uint32_t>(texts.size());
+        const std::string & stored = texts.emplace_back(text);
+        ids.emplace(stored, id);
+        return id;
+    }
+
+    std::string_view text(std::uint32_t id) const
+    {
+        return texts[id];
+    }
+
+    PreprocToken token(const CPreproc & lang, const TSNode & node)
+    {
+        std::string_view text = node.textView();
+        PreprocToken::Kind kind = PreprocToken::Kind::Other;
+        if (node.isSymbol(lang.identifier_s)) kind = PreprocToken::Kind::Identifier;
+        else if (node.isSymbol(lang.preproc_defined_literal_s)) kind = PreprocToken::Kind::Defined;
+        else if (text == "(") kind = PreprocToken::Kind::LeftParen;
+        else if (text == ")") kind = PreprocToken::Kind::RightParen;
+        else if (text == ",") kind = PreprocToken::Kind::Comma;
+        return PreprocToken{intern(text), 0, kind};
+    }
+
+    std::size_t size() const
+    {
+        return texts.size();
+    }
+
+private:
+    std::deque<std::string> texts; // Stable addresses for the keys of ids
+    std::unordered_map<std::string_view, std::uint32_t> ids;
+};
+
+} // namespace Hayroll
+
+#endif // HAYROLL_PREPROCTOKEN_HPP
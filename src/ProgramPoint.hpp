@@ -3,6 +3,7 @@
 
 #include <string>
 #include <optional>
+#include <type_traits>
 
 #include "Util.hpp"
 
@@ -15,6 +16,7 @@ namespace Hayroll
 // A macro program point in the include tree. 
 // In cases where a file is included multiple times,
 // different inclusion instances contain different macro program points.
+// Trivially copyable: the include tree is a plain pointer into its arena.
 struct ProgramPoint
 {
     IncludeTreePtr includeTree;
@@ -47,7 +49,7 @@ struct ProgramPoint
             return ProgramPoint{includeTree, parentNode};
         }
         // In a different file, we need to find the parent include tree.
-        IncludeTreePtr parentIncludeTree = includeTree->parent.lock();
+        IncludeTreePtr parentIncludeTree = includeTree->parent;
         assert(parentIncludeTree);
         assert(includeTree->includeNode);
         // If we have a node in the parent file, we can use it to find the parent include tree.
@@ -92,13 +94,15 @@ struct ProgramPoint
     {
         std::size_t operator()(const ProgramPoint & programPoint) const noexcept
         {
-            std::size_t h1 = std::hash<decltype(programPoint.includeTree)>()(programPoint.includeTree);
+            std::size_t h1 = programPoint.includeTree ? programPoint.includeTree->index : 0;
             std::size_t h2 = TSNode::Hasher{}(programPoint.node);
-            return h1 ^ (h2 << 1);
+            return h2 ^ (h1 * 0x9e3779b97f4a7c15ULL);
         }
     };
 };
 
+static_assert(std::is_trivially_copyable_v<ProgramPoint>);
+
 } // namespace Hayroll
 
 #endif // HAYROLL_PROGRAMPOINT_HPP
@@ -4,6 +4,7 @@
 #include <filesystem>
 #include <functional>
 #include <initializer_list>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -42,33 +43,47 @@ name = "test"
 path = "src/main.rs"
 )";
 
-    static std::string runReaper(std::string_view seededRustStr, bool keepSrcLoc = false)
+    // tagTablePath: side-table of compact tag payloads written by Seeder, if compact tags are enabled
+    static std::string runReaper
+    (
+        std::string_view seededRustStr,
+        bool keepSrcLoc = false,
+        const std::optional<std::filesystem::path> & tagTablePath = std::nullopt
+    )
     {
         ToolConfig config;
         config.toolName = "Reaper";
         config.executable = HayrollReaperExe;
         config.workingDirIndex = 0;
         config.outputDirIndex = 0;
-        config.buildArgs = [keepSrcLoc](const std::vector<std::filesystem::path> & paths)
+        config.buildArgs = [keepSrcLoc, &tagTablePath](const std::vector<std::filesystem::path> & paths)
         {
             std::vector<std::string> args{paths[0].string()};
             if (keepSrcLoc) args.push_back("--keep-src-loc");
+            appendTagTableArgs(args, tagTablePath);
             return args;
         };
         return runTool(config, {seededRustStr});
     }
 
-    static std::string runMerger(std::string_view reapedRustStrBase, std::string_view reapedRustStrPatch, bool keepSrcLoc = false)
+    static std::string runMerger
+    (
+        std::string_view reapedRustStrBase,
+        std::string_view reapedRustStrPatch,
+        bool keepSrcLoc = false,
+        const std::optional<std::filesystem::path> & tagTablePath = std::nullopt
+    )
     {
         ToolConfig config;
         config.toolName = "Merger";
         config.executable = HayrollMergerExe;
         config.workingDirIndex = 0;
         config.outputDirIndex = 0;
-        config.buildArgs = [keepSrcLoc](const std::vector<std::filesystem::path> & paths)
+        config.buildArgs = [keepSrcLoc, &tagTablePath](const std::vector<std::filesystem::path> & paths)
         {
             std::vector<std::string> args{paths[0].string(), paths[1].string()};
             if (keepSrcLoc) args.push_back("--keep-src-loc");
+            appendTagTableArgs(args, tagTablePath);
             return args;
         };
         return runTool(config, {reapedRustStrBase, reapedRustStrPatch});
@@ -88,23 +103,36 @@ path = "src/main.rs"
         return runTool(config, {rustStr});
     }
 
-    static std::string runCleaner(std::string_view rustStr, bool keepSrcLoc = false)
+    static std::string runCleaner
+    (
+        std::string_view rustStr,
+        bool keepSrcLoc = false,
+        const std::optional<std::filesystem::path> & tagTablePath = std::nullopt
+    )
     {
         ToolConfig config;
         config.toolName = "Cleaner";
         config.executable = HayrollCleanerExe;
         config.workingDirIndex = 0;
         config.outputDirIndex = 0;
-        config.buildArgs = [keepSrcLoc](const std::vector<std::filesystem::path> & paths)
+        config.buildArgs = [keepSrcLoc, &tagTablePath](const std::vector<std::filesystem::path> & paths)
         {
             std::vector<std::string> args{paths[0].string()};
             if (keepSrcLoc) args.push_back("--keep-src-loc");
+            appendTagTableArgs(args, tagTablePath);
             return args;
         };
         return runTool(config, {rustStr});
     }
 
 private:
+    static void appendTagTableArgs(std::vector<std::string> & args, const std::optional<std::filesystem::path> & tagTablePath)
+    {
+        if (!tagTablePath) return;
+        args.push_back("--tag-table");
+        args.push_back(std::filesystem::absolute(*tagTablePath).string());
+    }
+
     static std::string runTool(const ToolConfig & config, std::initializer_list<std::string_view> inputs)
     {
         if (inputs.size() == 0)
@@ -16,6 +16,7 @@
 #include <optional>
 #include <utility>
 #include <set>
+#include <unordered_map>
 #include <cstdint>
 
 #include <spdlog/spdlog.h>
@@ -72,16 +73,68 @@ public:
         }
     };
 
+    // Side-table for compact tags: the C code only carries "<prefix><id>", and the JSON payloads live here.
+    // The prefix is "HR#<salt>#"; salting it with a hash of the code the tags are seeded into keeps
+    // string literals of that code from spelling a tag. Identical payloads share one id.
+    // Written as JSON lines: {"prefix": <prefix>}, then {"id": <id>, "tag": <payload>} per payload.
+    class TagTable
+    {
+    public:
+        explicit TagTable(std::size_t salt = 0)
+            : prefix(std::format("HR#{:016x}#", salt))
+        {
+        }
+
+        const std::string & getPrefix() const
+        {
+            return prefix;
+        }
+
+        // Returns the id of the payload, registering it if new
+        std::size_t intern(std::string && payload)
+        {
+            auto [it, inserted] = ids.try_emplace(payload, payloads.size());
+            if (inserted) payloads.push_back(std::move(payload));
+            return it->second;
+        }
+
+        std::size_t size() const
+        {
+            return payloads.size();
+        }
+
+        std::string toJsonLines() const
+        {
+            std::string result = std::format("{{\"prefix\":\"{}\"}}\n", prefix);
+            for (std::size_t id = 0; id < payloads.size(); ++id)
+            {
+                result += std::format("{{\"id\":{},\"tag\":{}}}\n", id, payloads[id]);
+            }
+            return result;
+        }
+
+    private:
+        std::string prefix;
+        std::vector<std::string> payloads;
+        std::unordered_map<std::string, std::size_t> ids;
+    };
+
     // CRTP mixin that provides stringLiteral() for any type that can be serialized by nlohmann::json
     // Requirement: Derived must have an ADL-visible to_json(json&, const Derived&) (provided by NLOHMANN_* macros)
     template <typename Derived>
     struct JsonStringLiteralMixin
     {
         // Escape the JSON string to make it a valid C string that embeds into C code
-        std::string stringLiteral() const
+        // With a tagTable, only a compact "<prefix><id>" reference is embedded
+        std::string stringLiteral(TagTable * tagTable = nullptr) const
         {
             const Derived & self = static_cast<const Derived &>(*this);
             json j = self; // triggers ADL to_json for Derived
+            if (tagTable)
+            {
+                std::size_t id = tagTable->intern(j.dump());
+                return std::format("\"{}{}\"", tagTable->getPrefix(), id);
+            }
             return "\"" + escapeString(j.dump()) + "\"";
         }
     };
@@ -323,7 +376,8 @@ public:
         std::string_view spelling,
         std::string_view premise,
         bool canBeFn,
-        const std::vector<std::pair<IncludeTreePtr, int>> & inverseLineMap
+        const std::vector<std::pair<IncludeTreePtr, int>> & inverseLineMap,
+        TagTable * tagTable = nullptr
     )
     {
         auto [pathBegin, lineBegin, colBegin] = parseLocation(locBegin);
@@ -377,8 +431,8 @@ public:
             lineEnd,
             colEnd,
             false, // Do not erase original for body instrumentation
-            tagBegin.stringLiteral(),
-            (astKind == "Stmt" || astKind == "Stmts") ? std::optional(tagEnd.stringLiteral()) : std::nullopt,
+            tagBegin.stringLiteral(tagTable),
+            (astKind == "Stmt" || astKind == "Stmts") ? std::optional(tagEnd.stringLiteral(tagTable)) : std::nullopt,
             spelling,
             1 // priorityLeft: prefer inside
         );
@@ -388,7 +442,8 @@ public:
     static std::list<InstrumentationTask> genArgInstrumentationTasks
     (
         const MakiArgSummary & arg,
-        const std::vector<std::pair<IncludeTreePtr, int>> & inverseLineMap
+        const std::vector<std::pair<IncludeTreePtr, int>> & inverseLineMap,
+        TagTable * tagTable = nullptr
     )
     {
         return genBodyInstrumentationTasks
@@ -405,7 +460,8 @@ public:
             arg.Spelling,
             "", // premise
             false, // canBeFn
-            inverseLineMap
+            inverseLineMap,
+            tagTable
         );
     }
 
@@ -461,13 +517,14 @@ public:
     static std::list<InstrumentationTask> genInvocationInstrumentationTasks
     (
         const MakiInvocationSummary & inv,
-        const std::vector<std::pair<IncludeTreePtr, int>> & inverseLineMap
+        const std::vector<std::pair<IncludeTreePtr, int>> & inverseLineMap,
+        TagTable * tagTable = nullptr
     )
     {
         std::list<InstrumentationTask> tasks;
         for (const MakiArgSummary & arg : inv.Args)
         {
-            std::list<InstrumentationTask> argTasks = genArgInstrumentationTasks(arg, inverseLineMap);
+            std::list<InstrumentationTask> argTasks = genArgInstrumentationTasks(arg, inverseLineMap, tagTable);
             tasks.splice(tasks.end(), argTasks);
         }
 
@@ -491,7 +548,8 @@ public:
             inv.Spelling,
             inv.Premise,
             canBeRustFn(inv),
-            inverseLineMap
+            inverseLineMap,
+            tagTable
         );
         tasks.splice(tasks.end(), invocationTasks);
         
@@ -502,7 +560,8 @@ public:
     (
         const MakiRangeSummary & range,
         bool createScope,
-        const std::vector<std::pair<IncludeTreePtr, int>> & inverseLineMap
+        const std::vector<std::pair<IncludeTreePtr, int>> & inverseLineMap,
+        TagTable * tagTable = nullptr
     )
     {
         auto [pathBegin, lineBegin, colBegin] = parseLocation(range.Location);
@@ -543,8 +602,8 @@ public:
             range.IsPlaceholder ? ifGroupLnEnd : lineEnd,
             range.IsPlaceholder ? ifGroupColEnd : colEnd,
             range.IsPlaceholder, // Erase original when it's a placeholder, to avoid the tag being excluded from compilation
-            tagBegin.stringLiteral(),
-            (range.ASTKind == "Stmt" || range.ASTKind == "Stmts") ? std::optional(tagEnd.stringLiteral()) : std::nullopt,
+            tagBegin.stringLiteral(tagTable),
+            (range.ASTKind == "Stmt" || range.ASTKind == "Stmts") ? std::optional(tagEnd.stringLiteral(tagTable)) : std::nullopt,
             range.Spelling,
             -ifGroupLnEnd // priorityLeft: prefer outside, and give higher priority to outer #if groups
         );
@@ -862,6 +921,7 @@ public:
     // 1. invocations: the MakiInvocationSummary vector
     // 2. ranges: the MakiRangeSummary vector
     // Also requires the lineMap ((includeTree, line) <-> line in compilation unit file) and inverseLineMap.
+    // When tagTable is given, tags are emitted in compact form and their payloads are registered in it.
     // Returns the modified (CU) source code and a seeding report.
     static std::tuple<std::string, std::vector<SeedingReport>> run
     (
@@ -869,7 +929,8 @@ public:
         std::vector<Hayroll::MakiRangeSummary> ranges,
         std::string_view srcStr,
         const std::unordered_map<Hayroll::IncludeTreePtr, std::vector<int>> & lineMap,
-        const std::vector<std::pair<IncludeTreePtr, int>> & inverseLineMap
+        const std::vector<std::pair<IncludeTreePtr, int>> & inverseLineMap,
+        TagTable * tagTable = nullptr
     )
     {
         std::vector<SeedingReport> seedingReport;
@@ -946,12 +1007,12 @@ public:
         std::list<InstrumentationTask> tasks;
         for (const MakiInvocationSummary & invocation : invocations)
         {
-            std::list<InstrumentationTask> invocationTasks = genInvocationInstrumentationTasks(invocation, inverseLineMap);
+            std::list<InstrumentationTask> invocationTasks = genInvocationInstrumentationTasks(invocation, inverseLineMap, tagTable);
             tasks.splice(tasks.end(), invocationTasks);
         }
         for (const MakiRangeSummary & range : ranges)
         {
-            std::list<InstrumentationTask> rangeTasks = genConditionalInstrumentationTasks(range, !range.IsInStatementBlock, inverseLineMap);
+            std::list<InstrumentationTask> rangeTasks = genConditionalInstrumentationTasks(range, !range.IsInStatementBlock, inverseLineMap, tagTable);
             tasks.splice(tasks.end(), rangeTasks);
         }
 
@@ -2,9 +2,12 @@
 #define HAYROLL_SPLITTER_HPP
 
 #include <format>
-#include <list>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
 #include <optional>
 #include <string>
+#include <cstdint>
 
 #include <z3++.h>
 
@@ -18,6 +21,13 @@
 namespace Hayroll
 {
 
+// How Splitter chooses the DefineSet for the next worklist node
+enum class SplitPlanning
+{
+    Greedy, // Any model of the node's premise
+    Cover // The model of the node's premise that also satisfies the most code of the rest of the worklist
+};
+
 class Splitter
 {
 public:
@@ -50,15 +60,50 @@ public:
         }
     };
 
+    // Time limit of one weighted MaxSAT query in Cover planning
+    static constexpr unsigned CoverTimeoutMs = 2000;
+
     Splitter
     (
         const PremiseTree * premiseTree,
-        const CompileCommand & compileCommand
+        const CompileCommand & compileCommand,
+        SplitPlanning planning = SplitPlanning::Greedy
     )
-        : premiseTree(premiseTree), compileCommand(compileCommand)
+        : premiseTree(premiseTree), compileCommand(compileCommand), planning(planning)
     {
         if (!premiseTree) return;
-        worklist = premiseTree->getDescendantsLevelOrder();
+        // Level order visits parents first, so each complete premise extends its parent's
+        std::unordered_map<const PremiseTree *, std::size_t> entryIndices;
+        for (const PremiseTree * node : premiseTree->getDescendantsLevelOrder())
+        {
+            auto parentIt = node->parent ? entryIndices.find(node->parent) : entryIndices.end();
+            z3::expr completePremise = parentIt != entryIndices.end()
+                ? node->premise && worklist[parentIt->second].completePremise
+                : node->getCompletePremise();
+            entryIndices.emplace(node, worklist.size());
+            DefineSet::collectMacroConstants(completePremise, macroConstants);
+            worklist.push_back(Entry{node, std::move(completePremise), codeWeight(node)});
+        }
+    }
+
+    // Number of DefineSets a planning generates for the premise tree if every one of them succeeds
+    static std::size_t countSplits
+    (
+        const PremiseTree * premiseTree,
+        const CompileCommand & compileCommand,
+        SplitPlanning planning
+    )
+    {
+        Splitter splitter(premiseTree, compileCommand, planning);
+        std::size_t count = 0;
+        for (Feedback feedback = Feedback::initial(); splitter.next(feedback); feedback = Feedback::success()) ++count;
+        return count;
+    }
+
+    // Number of DefineSets generated so far
+    std::size_t generated() const
+    {
+        return generatedCount;
     }
 
     std::optional<DefineSet> next(const Feedback & feedback)
@@ -69,16 +114,19 @@ public:
 
         if (!worklist.empty())
         {
-            const PremiseTree * node = worklist.back();
+            lastNode = std::move(worklist.back());
             worklist.pop_back();
-            z3::expr premise = node->getCompletePremise();
-            lastNode = node;
-            lastDefineSet = node->getDefineSet();
+            std::optional<DefineSet> cover = planning == SplitPlanning::Cover && !lastNode->coverFailed
+                ? planCover(*lastNode)
+                : std::nullopt;
+            lastPlannedByCover = cover.has_value();
+            lastDefineSet = cover ? std::move(*cover) : lastNode->node->getDefineSet();
+            ++generatedCount;
             SPDLOG_TRACE
             (
                 "Splitter generated DefineSet {} for {}",
                 lastDefineSet->toString(),
-                premise.to_string()
+                lastNode->completePremise.to_string()
             );
             return lastDefineSet;
         }
@@ -88,6 +136,16 @@ public:
     }
 
 private:
+    // A premise tree node with its complete premise, computed once
+    struct Entry
+    {
+        const PremiseTree * node;
+        z3::expr completePremise;
+        unsigned weight; // See codeWeight
+        // A Cover DefineSet planned for it failed; it is retried with its own model only
+        bool coverFailed = false;
+    };
+
     void applyFeedback(const Feedback & feedback)
     {
         if (feedback.kind == Initial)
@@ -109,34 +167,83 @@ private:
                 stageStr,
                 reasonStr
             );
-            uncovered.push_back(lastNode);
+            if (lastPlannedByCover)
+            {
+                // The failure may come from the other premises the cover satisfied, so the pivot gets another
+                // chance with the DefineSet Greedy planning would have tried
+                lastNode->coverFailed = true;
+                worklist.push_back(std::move(*lastNode));
+            }
+            else
+            {
+                uncovered.push_back(std::move(*lastNode));
+            }
         }
 
         lastDefineSet.reset();
-        lastNode = nullptr;
+        lastNode.reset();
     }
 
-    void removeSatisfiedNodes(const DefineSet & defineSet)
+    // A model of the pivot's premise that maximizes the code weight of the worklist premises it satisfies too,
+    // found by weighted MaxSAT. Nullopt when there is nothing else to cover or the optimizer gives up,
+    // in which case any model of the pivot's premise is used, as in Greedy planning.
+    std::optional<DefineSet> planCover(const Entry & pivot) const
+    {
+        if (worklist.empty()) return std::nullopt;
+        z3::context & ctx = pivot.completePremise.ctx();
+        z3::optimize optimizer(ctx);
+        z3::params params(ctx);
+        params.set("timeout", CoverTimeoutMs);
+        optimizer.set(params);
+        optimizer.add(pivot.completePremise);
+        for (const Entry & entry : worklist)
+        {
+            optimizer.add_soft(entry.completePremise, entry.weight);
+        }
+        if (optimizer.check() != z3::sat)
+        {
+            SPDLOG_DEBUG("Splitter Cover planning gave up on {}, using any model of it.", pivot.node->toString());
+            return std::nullopt;
+        }
+        return DefineSet(optimizer.get_model());
+    }
+
+    // Bytes of code a node guards, without those of its children in the same file.
+    // Nodes without a syntax node (e.g. at EOF) weigh 1.
+    static unsigned codeWeight(const PremiseTree * node)
     {
-        for (auto it = worklist.begin(); it != worklist.end(); )
+        const ProgramPoint & point = node->programPoint;
+        if (!point.node) return 1;
+        std::size_t bytes = point.node.endByte() - point.node.startByte();
+        for (const PremiseTreePtr & child : node->children)
         {
-            const PremiseTree * otherNode = *it;
-            z3::expr otherPremise = otherNode->getCompletePremise();
-            if (defineSet.satisfies(otherPremise))
+            const ProgramPoint & childPoint = child->programPoint;
+            if (childPoint.includeTree != point.includeTree || !childPoint.node) continue;
+            bytes -= std::min<std::size_t>(bytes, childPoint.node.endByte() - childPoint.node.startByte());
+        }
+        return static_cast<unsigned>(std::clamp<std::size_t>(bytes, 1, UINT32_MAX));
+    }
+
+    // A DefineSet is a concrete assignment, so each premise is decided by evaluating it under one model.
+    void removeSatisfiedNodes(const DefineSet & defineSet)
+    {
+        if (worklist.empty()) return;
+        const z3::model model = defineSet.toModel(worklist.front().completePremise.ctx(), macroConstants);
+        std::erase_if
+        (
+            worklist,
+            [&](const Entry & entry)
             {
+                if (!defineSet.satisfies(entry.completePremise, model)) return false;
                 SPDLOG_TRACE
                 (
                     "DefineSet {} satisfies premise tree node {}, removing it from worklist.",
                     defineSet.toString(),
-                    otherNode->toString()
+                    entry.node->toString()
                 );
-                it = worklist.erase(it);
+                return true;
             }
-            else
-            {
-                ++it;
-            }
-        }
+        );
     }
 
     void reportUncovered() const
@@ -145,20 +252,25 @@ private:
 
         SPDLOG_DEBUG("Splitter reached end of worklist for {}.", compileCommand.file.string());
         SPDLOG_DEBUG("The following premise tree nodes could not be covered by any successful DefineSet:");
-        for (const PremiseTree * node : uncovered)
+        for (const Entry & entry : uncovered)
         {
-            SPDLOG_DEBUG(" - Node: {}", node->toString());
-            SPDLOG_DEBUG("   Premise: {}", node->getCompletePremise().to_string());
+            SPDLOG_DEBUG(" - Node: {}", entry.node->toString());
+            SPDLOG_DEBUG("   Premise: {}", entry.completePremise.to_string());
         }
         reportedUncovered = true;
     }
 
     const PremiseTree * premiseTree;
     CompileCommand compileCommand;
-    std::list<const PremiseTree *> worklist;
-    std::list<const PremiseTree *> uncovered;
+    SplitPlanning planning;
+    std::vector<Entry> worklist; // Taken from the back
+    std::vector<Entry> uncovered;
+    // The def/val constants of all complete premises
+    std::unordered_map<unsigned, z3::expr> macroConstants;
     std::optional<DefineSet> lastDefineSet;
-    const PremiseTree * lastNode{nullptr};
+    std::optional<Entry> lastNode;
+    bool lastPlannedByCover = false;
+    std::size_t generatedCount = 0;
     mutable bool reportedUncovered{false};
 };
 
@@ -10,6 +10,9 @@
 #include <variant>
 #include <optional>
 #include <sstream>
+#include <unordered_set>
+#include <algorithm>
+#include <ranges>
 
 #include <spdlog/spdlog.h>
 
@@ -60,7 +63,18 @@ public:
     std::string_view name;
 };
 
-using Symbol = std::variant<ObjectSymbol, FunctionSymbol, UndefinedSymbol, ExpandedSymbol>;
+// Object-like macro with a path-dependent integer value, e.g. BUFSZ after
+// #ifdef A / #define BUFSZ 64 / #else / #define BUFSZ 128 / #endif
+// Produced by ITE-merging states; each alternative is (guard, value), and the guards
+// are disjoint premises of the states that were merged.
+class GuardedSymbol
+{
+public:
+    std::string_view name;
+    std::vector<std::pair<z3::expr, z3::expr>> alternatives;
+};
+
+using Symbol = std::variant<ObjectSymbol, FunctionSymbol, UndefinedSymbol, ExpandedSymbol, GuardedSymbol>;
 
 std::string_view symbolName(const Symbol & symbol)
 {
@@ -93,6 +107,99 @@ const TSNode & symbolBody(const Symbol & symbol)
     else assert(false);
 }
 
+// Structural hash of a symbol: kind, name, parameters and body tokens.
+// The definition site is left out, so the same #define written in two branches hashes the same.
+std::size_t symbolContentHash(const Symbol & symbol)
+{
+    std::size_t hash = hashCombine(symbol.index(), std::hash<std::string_view>{}(symbolName(symbol)));
+    std::visit
+    (
+        overloaded
+        {
+            [&hash](const ObjectSymbol & s) { hash = hashCombine(hash, hashIgnoringWhitespaceRuns(s.body.textView())); },
+            [&hash](const FunctionSymbol & s)
+            {
+                hash = hashCombine(hash, s.params.size());
+                for (const std::string & param : s.params)
+                {
+                    hash = hashCombine(hash, std::hash<std::string>{}(param));
+                }
+                hash = hashCombine(hash, hashIgnoringWhitespaceRuns(s.body.textView()));
+            },
+            [](const UndefinedSymbol &) {},
+            [](const ExpandedSymbol &) {},
+            [&hash](const GuardedSymbol & s)
+            {
+                for (const auto & [guard, value] : s.alternatives)
+                {
+                    hash = hashCombine(hash, guard.hash());
+                    hash = hashCombine(hash, value.hash());
+                }
+            }
+        },
+        symbol
+    );
+    return hash;
+}
+
+// Structural equality of symbols, in the sense of symbolContentHash: equal symbols hash equal.
+bool symbolsEqual(const Symbol & lhs, const Symbol & rhs)
+{
+    if (lhs.index() != rhs.index() || symbolName(lhs) != symbolName(rhs)) return false;
+    return std::visit
+    (
+        overloaded
+        {
+            [&rhs](const ObjectSymbol & s)
+            {
+                return equalIgnoringWhitespaceRuns(s.body.textView(), std::get<ObjectSymbol>(rhs).body.textView());
+            },
+            [&rhs](const FunctionSymbol & s)
+            {
+                const FunctionSymbol & other = std::get<FunctionSymbol>(rhs);
+                return s.params == other.params && equalIgnoringWhitespaceRuns(s.body.textView(), other.body.textView());
+            },
+            [](const UndefinedSymbol &) { return true; },
+            [](const ExpandedSymbol &) { return true; },
+            [&rhs](const GuardedSymbol & s)
+            {
+                const GuardedSymbol & other = std::get<GuardedSymbol>(rhs);
+                return std::ranges::equal
+                (
+                    s.alternatives,
+                    other.alternatives,
+                    [](const auto & a, const auto & b) { return z3::eq(a.first, b.first) && z3::eq(a.second, b.second); }
+                );
+            }
+        },
+        lhs
+    );
+}
+
+bool symbolsEqual(const std::optional<Symbol> & lhs, const std::optional<Symbol> & rhs)
+{
+    if (!lhs || !rhs) return !lhs && !rhs;
+    return symbolsEqual(*lhs, *rhs);
+}
+
+// Symbol table activity. Counted into whatever set the current thread points at,
+// which a SymbolicExecutor sets to its own stats while it runs.
+struct SymbolTableCounters
+{
+    std::size_t segments = 0;
+    std::size_t symbols = 0;
+    std::size_t tables = 0;
+    std::size_t flattens = 0;
+
+    // The set this thread counts into; a thread-local scratch set unless claimed.
+    static SymbolTableCounters *& current()
+    {
+        thread_local SymbolTableCounters scratch;
+        thread_local SymbolTableCounters * counters = &scratch;
+        return counters;
+    }
+};
+
 class SymbolSegment;
 using SymbolSegmentPtr = std::shared_ptr<SymbolSegment>;
 using ConstSymbolSegmentPtr = std::shared_ptr<const SymbolSegment>;
@@ -107,20 +214,31 @@ public:
     // A SymbolSegment object shall only be managed by a shared_ptr.
     static SymbolSegmentPtr make()
     {
-        totalSymbolSegments++;
-        
+        SymbolTableCounters::current()->segments++;
+
         return std::make_shared<SymbolSegment>();
     }
 
     // Define a symbol in the segment.
     void define(Symbol && symbol)
     {
-        totalSymbols++;
+        SymbolTableCounters::current()->symbols++;
 
         std::string_view name = std::visit([](const auto & s) { return s.name; }, symbol);
+        // Keep the order-independent content hash up to date: a sum over the live symbols
+        if (auto it = symbols.find(name); it != symbols.end())
+        {
+            contentHash -= symbolContentHash(it->second);
+        }
+        contentHash += symbolContentHash(symbol);
         symbols.insert_or_assign(name, std::move(symbol));
     }
 
+    std::size_t getContentHash() const
+    {
+        return contentHash;
+    }
+
     // Lookup a symbol in the segment.
     std::optional<const Symbol *> lookup(std::string_view name) const
     {
@@ -132,6 +250,23 @@ public:
         return std::nullopt;
     }
 
+    // Define a copy of every symbol of this segment in target.
+    void copyInto(SymbolSegment & target) const
+    {
+        for (const auto & [name, symbol] : symbols)
+        {
+            target.define(Symbol(symbol));
+        }
+    }
+
+    void appendNames(std::vector<std::string_view> & names) const
+    {
+        for (const auto & [name, symbol] : symbols)
+        {
+            names.push_back(name);
+        }
+    }
+
     std::string toString(int maxEntries = 10) const
     {
         std::stringstream ss;
@@ -155,7 +290,15 @@ public:
                         ss << ") -> " << s.body.text();
                     },
                     [&ss](const UndefinedSymbol & s) { ss << s.name << " -> <UNDEFINED>"; },
-                    [&ss](const ExpandedSymbol & s) { ss << s.name << " -> <EXPANDED>"; }
+                    [&ss](const ExpandedSymbol & s) { ss << s.name << " -> <EXPANDED>"; },
+                    [&ss](const GuardedSymbol & s)
+                    {
+                        ss << s.name << " -> <GUARDED>";
+                        for (const auto & [guard, value] : s.alternatives)
+                        {
+                            ss << " " << value.to_string();
+                        }
+                    }
                 },
                 symbol
             );
@@ -170,18 +313,14 @@ public:
         return ss.str();
     }
 
-    static int totalSymbolSegments;
-    static int totalSymbols;
-
 private:
     std::unordered_map<std::string_view, Symbol, TransparentStringHash, TransparentStringEqual> symbols;
+    std::size_t contentHash = 0;
 };
 
-int SymbolSegment::totalSymbolSegments = 0;
-int SymbolSegment::totalSymbols = 0;
-
 // Chained hashmap symbol table that holds macro definitions.
 // Shares parents as an immutable data structure.
+// Chains deeper than FlattenDepth are flattened, so a lookup touches a bounded number of segments.
 class SymbolTable
     : public std::enable_shared_from_this<SymbolTable>
 {
@@ -195,19 +334,30 @@ public:
         std::optional<std::vector<std::string>> whitelist = std::nullopt
     )
     {
-        totalSymbolTables++;
+        SymbolTableCounters::current()->tables++;
 
         auto table = std::make_shared<SymbolTable>();
         table->symbols = symbols;
         table->parent = parent;
         table->whitelist = whitelist;
+        table->depth = parent ? parent->depth + 1 : 0;
+        // Merkle-style: chain the parent's hash with this segment's.
+        // The root segment is not hashed, because it is shared by every table derived from it
+        // and still receives forceDefine()s after children exist.
+        table->contentHash = parent ? hashCombine(parent->contentHash, symbols->getContentHash()) : 0;
+        if (table->depth > FlattenDepth)
+        {
+            // Keeps lookups bounded by FlattenDepth segments. The hash above is kept,
+            // so a flattened table still structurally equals its unflattened twin.
+            table->flatten();
+        }
         return table;
     }
 
     // Create a child that binds to the provied SymbolSegmentPtr
     SymbolTablePtr define(SymbolSegmentPtr segment)
     {
-        totalSymbolTables++;
+        // Counted by make()
         return makeChild(segment);
     }
 
@@ -243,6 +393,87 @@ public:
         return std::nullopt;
     }
 
+    // Equal for tables that define the same symbols in the same layering under the same root.
+    // Used to merge states whose tables are distinct objects but structurally equivalent.
+    std::size_t getContentHash() const
+    {
+        return contentHash;
+    }
+
+    // This table and all tables above it
+    std::unordered_set<const SymbolTable *> ancestors() const
+    {
+        std::unordered_set<const SymbolTable *> result;
+        for (const SymbolTable * table = this; table; table = table->parent.get())
+        {
+            result.insert(table);
+        }
+        return result;
+    }
+
+    // Names that may be bound differently in this table and in other:
+    // those defined in either chain below the nearest table both chains share.
+    // Sorted and deduplicated.
+    std::vector<std::string_view> namesDefinedSinceCommonAncestor(const SymbolTable & other) const
+    {
+        return namesDefinedSinceCommonAncestor(other, ancestors());
+    }
+
+    // As above, with this table's ancestors() computed by the caller, e.g. once for many others
+    std::vector<std::string_view> namesDefinedSinceCommonAncestor
+    (
+        const SymbolTable & other,
+        const std::unordered_set<const SymbolTable *> & ancestors
+    ) const
+    {
+        const SymbolTable * common = &other;
+        while (common && !ancestors.contains(common))
+        {
+            common = common->parent.get();
+        }
+
+        std::vector<std::string_view> names;
+        for (const SymbolTable * chain : {this, &other})
+        {
+            for (const SymbolTable * table = chain; table != common; table = table->parent.get())
+            {
+                table->symbols->appendNames(names);
+            }
+        }
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+        return names;
+    }
+
+    // Whether every name is bound to structurally equal symbols in this table and in other.
+    // Decides what equal content hashes only suggest.
+    bool sameBindings(const SymbolTable & other) const
+    {
+        if (this == &other) return true;
+        for (std::string_view name : namesDefinedSinceCommonAncestor(other))
+        {
+            if (!symbolsEqual(lookup(name), other.lookup(name))) return false;
+        }
+        return true;
+    }
+
+    // Segments defined on top of ancestor to reach this table, oldest first.
+    // Nullopt if ancestor is not in this table's chain, e.g. because the chain was flattened.
+    std::optional<std::vector<SymbolSegmentPtr>> segmentsSince(const SymbolTable & ancestor) const
+    {
+        std::vector<SymbolSegmentPtr> segments;
+        for (const SymbolTable * table = this; table; table = table->parent.get())
+        {
+            if (table == &ancestor)
+            {
+                std::reverse(segments.begin(), segments.end());
+                return segments;
+            }
+            segments.push_back(table->symbols);
+        }
+        return std::nullopt;
+    }
+
     std::string toString(int maxEntries = 10) const
     {
         return symbols->toString(maxEntries);
@@ -260,12 +491,47 @@ public:
         return ss.str();
     }
     
-    static int totalSymbolTables;
+    std::size_t getDepth() const
+    {
+        return depth;
+    }
+
+    // Chains deeper than this are collapsed into one segment over the root.
+    static constexpr std::size_t FlattenDepth = 32;
 
 private:
     SymbolSegmentPtr symbols;
     ConstSymbolTablePtr parent;
     std::optional<std::vector<std::string>> whitelist;
+    std::size_t contentHash = 0;
+    std::size_t depth = 0; // Number of segments above the root
+
+    // Replace the chain between this table and the root with a single segment holding
+    // the visible binding of every name. Ancestors are untouched, so other tables sharing
+    // them are not affected. The root stays a separate parent, since it keeps receiving
+    // forceDefine()s and holds the whitelist.
+    void flatten()
+    {
+        SymbolTableCounters::current()->flattens++;
+
+        std::vector<const SymbolSegment *> chain = {symbols.get()};
+        ConstSymbolTablePtr root = parent;
+        while (root->parent)
+        {
+            chain.push_back(root->symbols.get());
+            root = root->parent;
+        }
+
+        SymbolSegmentPtr flat = SymbolSegment::make();
+        // Oldest first, so that newer definitions overwrite older ones.
+        for (const SymbolSegment * segment : chain | std::views::reverse)
+        {
+            segment->copyInto(*flat);
+        }
+        symbols = std::move(flat);
+        parent = std::move(root);
+        depth = 1;
+    }
 
     SymbolTablePtr makeChild(SymbolSegmentPtr segment)
     {
@@ -273,8 +539,6 @@ private:
     }
 };
 
-int SymbolTable::totalSymbolTables = 0;
-
 // A top-level symbol table wrapper used for expanding macros
 // Undefines symbols in prevention of recursive expansion
 // Not intended for generating child symbol tables or being passd to other functions
@@ -301,6 +565,12 @@ public:
         undefStack.pop_back();
     }
 
+    // Number of expansions in progress
+    std::size_t depth() const
+    {
+        return undefStack.size();
+    }
+
     std::optional<Symbol> lookup(std::string_view name) const
     {
         // size
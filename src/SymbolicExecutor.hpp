@@ -8,6 +8,10 @@
 #include <filesystem>
 #include <ranges>
 #include <format>
+#include <memory>
+#include <map>
+#include <set>
+#include <unordered_set>
 
 #include <z3++.h>
 
@@ -23,6 +27,8 @@
 #include "MacroExpander.hpp"
 #include "ASTBank.hpp"
 #include "PremiseTree.hpp"
+#include "Z3CheckPool.hpp"
+#include "PioneerStats.hpp"
 
 namespace Hayroll
 {
@@ -45,13 +51,26 @@ struct State
     }
 
     // Merges the other state into this one if they have the same symbol table.
+    // With structural, distinct tables that bind every name to equal symbols also count as the same;
+    // their content hashes are compared first, and a match is confirmed binding by binding.
     // Returns whether the merge was successful or not.
     // The user is not supposed to even try to merge states with different include trees or nodes.
-    bool mergeInplace(const State & other)
+    bool mergeInplace(const State & other, bool structural = false)
     {
         // It's okay to try to merge states with different symbol tables,
         // but they won't be merged eventually.
-        if (symbolTable != other.symbolTable) return false;
+        if
+        (
+            symbolTable != other.symbolTable
+            && !(
+                structural
+                && symbolTable->getContentHash() == other.symbolTable->getContentHash()
+                && symbolTable->sameBindings(*other.symbolTable)
+            )
+        )
+        {
+            return false;
+        }
 
         premise = premise || other.premise;
         return true;
@@ -110,6 +129,19 @@ struct Warp
     }
 };
 
+// Settings that tune how a SymbolicExecutor explores a translation unit
+struct SymbolicExecutorOptions
+{
+    // Threads checking #if branch feasibility in parallel. 0 or 1 checks serially.
+    std::size_t checkThreads = 0;
+    // Max number of macros two states may disagree on and still be ITE-merged at a join point. 0 disables.
+    std::size_t iteMergeLimit = 0;
+    // Replay cached header summaries on re-includes with equivalent relevant macros.
+    bool memoizeHeaders = false;
+    SimplifyTier simplifyTier = PremiseSimplifier::DefaultTier;
+    IntEncoding intEncoding = IntEncoding::Int;
+};
+
 class SymbolicExecutor
 {
 public:
@@ -120,15 +152,34 @@ public:
     IncludeResolver includeResolver;
     ASTBank astBank;
     MacroExpander macroExpander;
-    IncludeTreePtr includeTree;
+    IncludeTreeRootPtr includeTree;
     // The root symbol segment stores #undefs produced by the key assumption:
     // any macro name that is ever defined or undefined in the code,
     // it is not intended to be supplemented by the user from the command line (-D).
     SymbolTablePtr symbolTableRoot;
+    // Every name #defined or #undefed in any translation unit entered so far, built-ins included.
+    // No symbol table can resolve a name outside of it, so executeCTokens skips such identifiers.
+    std::unordered_set<std::string_view> definedMacroNames;
+    std::size_t skippedIdentifiers = 0;
     PremiseTreeScribe scribe;
     std::optional<std::vector<std::string>> macroWhitelist;
 
     bool analyzeInvocations;
+    // Memoizes every z3Check on ctx while the executor lives, including those from the premise tree and Splitter.
+    std::unique_ptr<Z3QueryCache> queryCache;
+    // Serves simplifyOrOfAnd on ctx with the configured tier and prebuilt tactics.
+    std::unique_ptr<PremiseSimplifier> simplifier;
+    // Optional pool for checking #if branch feasibility in parallel. Null means serial checks.
+    std::unique_ptr<Z3CheckPool> checkPool;
+    // See SymbolicExecutorOptions
+    std::size_t iteMergeLimit;
+    bool memoizeHeaders;
+    std::size_t headerSummaryHits = 0;
+    std::size_t headerSummaryMisses = 0;
+    // #if conditions decided by MacroExpander::evaluateConstant vs. symbolized and checked with z3, per state
+    std::size_t concreteConditions = 0;
+    std::size_t symbolicConditions = 0;
+    PioneerStats stats;
 
     SymbolicExecutor
     (
@@ -136,14 +187,19 @@ public:
         std::filesystem::path projPath,
         const std::vector<std::filesystem::path> & includePaths = {},
         std::optional<std::vector<std::string>> macroWhitelist = std::nullopt,
-        bool analyzeInvocations = false
+        bool analyzeInvocations = false,
+        const SymbolicExecutorOptions & options = {}
     )
         : lang(CPreproc()), ctx(std::make_unique<z3::context>()), srcPath(std::filesystem::canonical(srcPath)),
           projPath(std::filesystem::canonical(projPath)), includeResolver(ClangExe, includePaths),
-          astBank(lang), macroExpander(lang, ctx.get()),
+          astBank(lang), macroExpander(lang, ctx.get(), options.intEncoding),
           includeTree(IncludeTree::make(TSNode{}, std::filesystem::canonical(srcPath))),
           symbolTableRoot(SymbolTable::make(SymbolSegment::make(), nullptr, macroWhitelist)),
-          scribe(), analyzeInvocations(analyzeInvocations), macroWhitelist(macroWhitelist)
+          scribe(), analyzeInvocations(analyzeInvocations), macroWhitelist(macroWhitelist),
+          queryCache(std::make_unique<Z3QueryCache>(*ctx)),
+          simplifier(std::make_unique<PremiseSimplifier>(*ctx, options.simplifyTier)),
+          checkPool(options.checkThreads > 1 ? std::make_unique<Z3CheckPool>(options.checkThreads) : nullptr),
+          iteMergeLimit(options.iteMergeLimit), memoizeHeaders(options.memoizeHeaders)
     {
         astBank.addFileOrFind(srcPath);
     }
@@ -152,15 +208,16 @@ public:
 
     Warp run()
     {
-        SymbolSegment::totalSymbolSegments = 0;
-        SymbolSegment::totalSymbols = 0;
-        SymbolTable::totalSymbolTables = 0;
+        stats = PioneerStats{};
+        PioneerStats::SymbolTableScope symbolTableScope(stats);
+        // The state of the predefined macros, which becomes the start state
+        stats.resetStates(1);
 
         // Generate a base symbol table with the predefined macros.
         std::string builtinMacros = includeResolver.getBuiltinMacros();
         const TSTree & predefinedMacroTree = astBank.addAnonymousSource(std::move(builtinMacros));
         State builtinMacroState{symbolTableRoot, ctx->bool_val(true)};
-        ProgramPoint predefinedMacroProgramPoint{IncludeTree::make(TSNode{}, "<built-in>"), predefinedMacroTree.rootNode()};
+        ProgramPoint predefinedMacroProgramPoint{includeTree->addRoot("<built-in>"), predefinedMacroTree.rootNode()};
         Warp predefinedMacroWarp{std::move(predefinedMacroProgramPoint), {std::move(builtinMacroState)}};
         predefinedMacroWarp = executeTranslationUnit(std::move(predefinedMacroWarp));
         assert(predefinedMacroWarp.states.size() == 1);
@@ -171,51 +228,109 @@ public:
         TSNode root = tree.rootNode();
         // The initial state is the root node of the tree.
         State startState{builtinMacroSymbolTable, ctx->bool_val(true)};
-        Warp startWarp{ProgramPoint{includeTree, root}, {std::move(startState)}};
+        Warp startWarp{ProgramPoint{includeTree.get(), root}, {std::move(startState)}};
         // Start the premise tree with a true premise.
         // When a state reaches an #error, it does not stop, instead, it conjuncts the negation
         // of its premise to the root node of the premise tree.
         scribe = PremiseTreeScribe(startWarp.programPoint, ctx->bool_val(true));
         Warp endWarp = executeTranslationUnit(std::move(startWarp));
+
+        if (memoizeHeaders)
+        {
+            SPDLOG_DEBUG("Header summaries: {} hits, {} misses", headerSummaryHits, headerSummaryMisses);
+        }
+        SPDLOG_DEBUG
+        (
+            "Solver query cache: {} hits, {} misses, cleared {} times",
+            queryCache->hits,
+            queryCache->misses,
+            queryCache->clears
+        );
+        SPDLOG_DEBUG
+        (
+            "Concrete #if fast path: {} of {} conditions ({:.1f}%)",
+            concreteConditions,
+            concreteConditions + symbolicConditions,
+            concreteConditions + symbolicConditions == 0 ? 0.0 : 100.0 * concreteConditions / (concreteConditions + symbolicConditions)
+        );
+        SPDLOG_DEBUG("Contextual simplifications timed out: {}", simplifier->timeouts);
+        SPDLOG_DEBUG("Identifiers skipped by the macro name filter: {}", skippedIdentifiers);
+        SPDLOG_DEBUG
+        (
+            "States: {} split, {} merged, {} dropped, peak {} live",
+            stats.statesSplit,
+            stats.statesMerged,
+            stats.statesDropped,
+            stats.peakLiveStates
+        );
+        SPDLOG_DEBUG
+        (
+            "Nested expansion definition memo: {} hits, {} misses ({:.1f}%)",
+            macroExpander.nestedDefinitionMemo.hits,
+            macroExpander.nestedDefinitionMemo.misses,
+            100.0 * macroExpander.nestedDefinitionMemo.hitRatio()
+        );
+        SPDLOG_DEBUG
+        (
+            "Object-like expansion memo: {} hits, {} misses ({:.1f}%)",
+            macroExpander.objectExpansionMemo.hits,
+            macroExpander.objectExpansionMemo.misses,
+            100.0 * macroExpander.objectExpansionMemo.hitRatio()
+        );
         
         return endWarp;
     }
 
+    // Instrumentation of the last run(), with the counters kept outside PioneerStats.
+    nlohmann::ordered_json statsJson() const
+    {
+        nlohmann::ordered_json result = stats.toJson();
+        nlohmann::ordered_json conditions = nlohmann::ordered_json::object();
+        conditions["concrete"] = concreteConditions;
+        conditions["symbolic"] = symbolicConditions;
+        result["conditions"] = conditions;
+        nlohmann::ordered_json headerSummaries = nlohmann::ordered_json::object();
+        headerSummaries["hits"] = headerSummaryHits;
+        headerSummaries["misses"] = headerSummaryMisses;
+        result["header_summaries"] = headerSummaries;
+        result["skipped_identifiers"] = skippedIdentifiers;
+        result["simplifier_timeouts"] = simplifier->timeouts;
+        return result;
+    }
+
     Warp executeTranslationUnit(Warp && startWarp, std::optional<ProgramPoint> joinPoint = std::nullopt)
     {
         SPDLOG_TRACE("Executing translation unit: {}", startWarp.programPoint.toString());
         assert(startWarp.programPoint.node.isSymbol(lang.translation_unit_s));
 
+        forceUndefineDefinedMacros(startWarp.programPoint.node);
+
+        // All states shall meet at the end of the translation unit (invalid node).
+        if (!joinPoint) joinPoint = startWarp.programPoint.nextSibling();
+        return executeInLockStep({std::move(startWarp)}, *joinPoint);
+    }
+
+    void forceUndefineDefinedMacros(const TSNode & translationUnit)
+    {
         // Key assumption: any macro name that is ever defined or undefined in the code,
         // it is not intended to be supplemented by the user from the command line (-D).
         // An example of this is header guard macros.
-        // We enforce this by scanning the translation unit for all #define and #undef nodes,
-        // and undefining them in the symbol table.
+        // We enforce this by taking all #define and #undef names of the translation unit
+        // from its directive index, and undefining them in the symbol table.
         // This does not apply to whitelisted macros.
-        for (TSNode node : startWarp.programPoint.node.iterateDescendants())
+        for (std::string_view nameStr : astBank.index(translationUnit).definedNames)
         {
-            if (node.isSymbol(lang.preproc_def_s) || node.isSymbol(lang.preproc_function_def_s) || node.isSymbol(lang.preproc_undef_s))
+            definedMacroNames.insert(nameStr);
+            if (macroWhitelist)
             {
-                // We need to undefine the macro in the symbol table.
-                // This is done by creating a new state with the same symbol table,
-                // but with the macro undefined.
-                TSNode name = node.childByFieldId(lang.preproc_undef_s.name_f);
-                std::string_view nameStr = name.textView();
-                if (macroWhitelist)
+                if (std::find(macroWhitelist->begin(), macroWhitelist->end(), nameStr) != macroWhitelist->end())
                 {
-                    if (std::find(macroWhitelist->begin(), macroWhitelist->end(), nameStr) != macroWhitelist->end())
-                    {
-                        // In whitelist mode, do not undefine whitelisted macros.
-                        continue;
-                    }
+                    // In whitelist mode, do not undefine whitelisted macros.
+                    continue;
                 }
-                symbolTableRoot->forceDefine(UndefinedSymbol{nameStr});
             }
+            symbolTableRoot->forceDefine(UndefinedSymbol{nameStr});
         }
-
-        // All states shall meet at the end of the translation unit (invalid node).
-        if (!joinPoint) joinPoint = startWarp.programPoint.nextSibling();
-        return executeInLockStep({std::move(startWarp)}, *joinPoint);
     }
 
     // Execute a single node or a segment of continuous #define nodes.
@@ -244,30 +359,37 @@ public:
         const TSSymbol symbol = node.symbol();
         if (symbol == lang.preproc_if_s || symbol == lang.preproc_ifdef_s || symbol == lang.preproc_ifndef_s)
         {
+            PioneerStats::DirectiveScope directive(stats, "if");
             return executeIf(std::move(startWarp));
         }
         else if (symbol == lang.preproc_include_s || symbol == lang.preproc_include_next_s)
         {
+            PioneerStats::DirectiveScope directive(stats, "include");
             return executeInclude(std::move(startWarp));
         }
         else if (symbol == lang.preproc_def_s || symbol == lang.preproc_function_def_s || symbol == lang.preproc_undef_s)
         {
+            PioneerStats::DirectiveScope directive(stats, "define");
             return {executeContinuousDefines(std::move(startWarp))};
         }
         else if (symbol == lang.preproc_error_s)
         {
+            PioneerStats::DirectiveScope directive(stats, "error");
             return {executeError(std::move(startWarp))};
         }
         else if (symbol == lang.preproc_line_s)
         {
+            PioneerStats::DirectiveScope directive(stats, "line");
             return {executeLine(std::move(startWarp))};
         }
         else if (symbol == lang.c_tokens_s)
         {
+            PioneerStats::DirectiveScope directive(stats, "c_tokens");
             return {executeCTokens(std::move(startWarp))};
         }
         else if (symbol == lang.preproc_call_s)
         {
+            PioneerStats::DirectiveScope directive(stats, "call");
             // Unknown preprocessor directive. Skip. 
             startWarp.programPoint = startWarp.programPoint.nextSibling();
             return {std::move(startWarp)};
@@ -303,6 +425,7 @@ public:
                 TSNode name = node.childByFieldId(lang.preproc_def_s.name_f);
                 TSNode value = node.childByFieldId(lang.preproc_def_s.value_f); // May not exist
                 std::string_view nameStr = name.textView();
+                macroExpander.internBody(value);
                 segment->define(ObjectSymbol{nameStr, startWarp.programPoint, value});
             }
             else if (node.isSymbol(lang.preproc_function_def_s))
@@ -318,6 +441,7 @@ public:
                     if (!param.isSymbol(lang.identifier_s)) continue;
                     paramsStrs.push_back(param.text());
                 }
+                macroExpander.internBody(body, paramsStrs);
                 segment->define(FunctionSymbol{nameStr, startWarp.programPoint, std::move(paramsStrs), body});
             }
             else if (node.isSymbol(lang.preproc_undef_s))
@@ -354,6 +478,12 @@ public:
         {
             if (!token.isSymbol(lang.identifier_s)) continue;
             std::string_view name = token.textView();
+            if (!definedMacroNames.contains(name))
+            {
+                // Not a macro in any state
+                ++skippedIdentifiers;
+                continue;
+            }
             PremiseTree * premiseTreeNode = nullptr;
             z3::expr unexpandedPremise = ctx->bool_val(false);
             // defProgramPoint -> collectedNestedExpansionDefinitions
@@ -445,7 +575,7 @@ public:
 
             // For tokens that are at least sometimes expanded, and also sometimes not expanded,
             // take down when it is not expanded.
-            if (premiseTreeNode && z3Check(unexpandedPremise) == z3::sat)
+            if (premiseTreeNode && z3Check(unexpandedPremise) != z3::unsat)
             {
                 premiseTreeNode->disjunctMacroPremise({includeTree, TSNode{}}, unexpandedPremise);
             }
@@ -568,23 +698,88 @@ public:
                 return simplifyOrOfAnd(result);
             };
 
-            // Split each state and put them into the then and else warps.
-            for (State & state : states)
+            // Symbolize the condition under each state first, so that all branch premises
+            // can be checked in one batch: [enterThen0, enterElse0, enterThen1, enterElse1, ...]
+            // A condition without symbolic atoms is evaluated natively and needs no check:
+            // the state's premise is satisfiable, so exactly the branch it selects is.
+            std::vector<z3::expr> enterPremises;
+            enterPremises.reserve(2 * states.size());
+            std::vector<z3::check_result> enterPremiseResults(2 * states.size(), z3::unknown);
+            std::vector<z3::expr> ifPremises;
+            ifPremises.reserve(states.size());
+            std::vector<std::size_t> symbolicStates;
+            for (std::size_t i = 0; i < states.size(); ++i)
             {
-                const auto & [symbolTable, premise] = state;
+                const auto & [symbolTable, premise] = states[i];
+
+                std::variant<bool, std::vector<PreprocToken>> evaluated = macroExpander.evaluateOrExpand(tokenList, symbolTable, prepend);
+                if (const bool * constant = std::get_if<bool>(&evaluated))
+                {
+                    ++concreteConditions;
+                    z3::expr ifPremise = ctx->bool_val(*constant);
+                    enterPremises.push_back(*constant ? premise : ctx->bool_val(false));
+                    enterPremises.push_back(*constant ? ctx->bool_val(false) : premise);
+                    enterPremiseResults[2 * i] = *constant ? z3::sat : z3::unsat;
+                    enterPremiseResults[2 * i + 1] = *constant ? z3::unsat : z3::sat;
+                    ifPremises.push_back(ifPremise);
+                    collectPremise(ifPremise, premise);
+                    continue;
+                }
 
-                z3::expr ifPremise = macroExpander.symbolizeToBoolExpr(tokenList, symbolTable, prepend);
-                z3::expr enterThenPremise = premise && ifPremise;
-                z3::expr elsePremise = !ifPremise;
-                z3::expr enterElsePremise = premise && elsePremise;
+                ++symbolicConditions;
+                z3::expr ifPremise = macroExpander.symbolizeExpandedToBoolExpr(std::get<std::vector<PreprocToken>>(evaluated), symbolTable);
+                enterPremises.push_back(premise && ifPremise);
+                enterPremises.push_back(premise && !ifPremise);
+                ifPremises.push_back(ifPremise);
+                symbolicStates.push_back(i);
 
                 collectPremise(ifPremise, premise);
+            }
+            if (checkPool)
+            {
+                std::vector<z3::expr> queries;
+                queries.reserve(2 * symbolicStates.size());
+                for (std::size_t i : symbolicStates)
+                {
+                    queries.push_back(enterPremises[2 * i]);
+                    queries.push_back(enterPremises[2 * i + 1]);
+                }
+                PioneerStats::SolverScope solver(stats, "if_branch", queries.size());
+                std::vector<z3::check_result> results = checkAll(queries);
+                for (std::size_t k = 0; k < symbolicStates.size(); ++k)
+                {
+                    enterPremiseResults[2 * symbolicStates[k]] = results[2 * k];
+                    enterPremiseResults[2 * symbolicStates[k] + 1] = results[2 * k + 1];
+                }
+            }
+            else
+            {
+                // Serially, the state premise is a shared prefix of both branch queries.
+                PioneerStats::SolverScope solver(stats, "if_branch", 2 * symbolicStates.size());
+                for (std::size_t i : symbolicStates)
+                {
+                    std::vector<z3::check_result> branchResults
+                        = queryCache->checkUnder(states[i].premise, {ifPremises[i], !ifPremises[i]});
+                    enterPremiseResults[2 * i] = branchResults[0];
+                    enterPremiseResults[2 * i + 1] = branchResults[1];
+                }
+            }
 
-                bool enterThenPremiseIsSat = z3Check(enterThenPremise) == z3::sat;
-                bool enterElsePremiseIsSat = z3Check(enterElsePremise) == z3::sat;
+            // Split each state and put them into the then and else warps.
+            for (std::size_t i = 0; i < states.size(); ++i)
+            {
+                State & state = states[i];
+                z3::expr enterThenPremise = enterPremises[2 * i];
+                z3::expr enterElsePremise = enterPremises[2 * i + 1];
+
+                // Undecided (unknown) premises are kept, so a feasible branch is never pruned
+                bool enterThenPremiseIsSat = enterPremiseResults[2 * i] != z3::unsat;
+                bool enterElsePremiseIsSat = enterPremiseResults[2 * i + 1] != z3::unsat;
 
                 if (enterThenPremiseIsSat && enterElsePremiseIsSat) // Both branch possible
                 {
+                    stats.statesSplit++;
+                    stats.statesAdded(1);
                     auto && [thenState, elseState] = state.split();
                     thenState.premise = enterThenPremise;
                     thenWarp.states.push_back(std::move(thenState));
@@ -702,14 +897,28 @@ public:
                 }
                 scribe.conjunctPremiseOntoRoot(!simplifyOrOfAnd(disallowed));
                 SPDLOG_TRACE("Include not found: {}, disallowed premise: {}", pathStr, disallowed.to_string());
+                stats.statesDroppedAway(states.size());
                 return std::nullopt;
             }
             std::filesystem::path includePath = *optionalIncludePath;
             if (includePath.string().starts_with(projPath.string())) // Header is in project path, execute symbolically. 
             {
+                // Re-include of a header whose guard every state has defined: it expands to nothing,
+                // so skip it without an include tree child, a premise tree node or solver calls.
+                if (isGuardedInAllStates(includePath, states))
+                {
+                    SPDLOG_TRACE("Skipping guarded re-include: {}", includePath.string());
+                    stats.guardedIncludesSkipped++;
+                    startWarp.programPoint = std::move(joinPoint);
+                    return {std::move(startWarp)};
+                }
                 // Include found, add it to the AST bank and create a new state for it.
+                stats.symbolicIncludes++;
                 const TSTree & tree = astBank.addFileOrFind(includePath);
                 TSNode root = tree.rootNode();
+                auto [guardIt, firstParse] = includeGuards.try_emplace(includePath);
+                if (firstParse) guardIt->second = detectIncludeGuard(root, includePath);
+                const std::optional<IncludeGuard> & guard = guardIt->second;
                 startWarp.programPoint = {includeTree->addChild(node, includePath), root};
                 // Print the startWarp for debugging.
                 SPDLOG_TRACE("Executing include symbolically: {}", startWarp.programPoint.toString());
@@ -721,10 +930,29 @@ public:
                     tempPremise = tempPremise || state.premise;
                 }
                 premiseTreeNode->disjunctPremise(simplifyOrOfAnd(tempPremise));
-                return executeTranslationUnit(std::move(startWarp), joinPoint);
+                ProgramPoint headerPoint = startWarp.programPoint;
+                Warp endWarp;
+                // Summaries drop definition sites and assume plain merging at join points.
+                if (memoizeHeaders && !analyzeInvocations && iteMergeLimit == 0)
+                {
+                    endWarp = executeHeaderMemoized(std::move(startWarp), joinPoint);
+                }
+                else
+                {
+                    endWarp = executeTranslationUnit(std::move(startWarp), joinPoint);
+                }
+                if (guard && guard->pragmaOnce)
+                {
+                    // #pragma once has no macro of its own, so define the synthetic one.
+                    SymbolSegmentPtr segment = SymbolSegment::make();
+                    segment->define(ObjectSymbol{guard->macro, std::move(headerPoint), TSNode{}});
+                    endWarp.defineAll(segment);
+                }
+                return endWarp;
             }
             else // Header is outsde of project path, execute concretely.
             {
+                stats.concreteIncludes++;
                 std::string concretelyExecuted = includeResolver.getConcretelyExecutedMacros(includePath);
                 // Include found, add it to the AST bank and create a new state for it.
                 const TSTree & concretelyExecutedTree = astBank.addAnonymousSource(std::move(concretelyExecuted));
@@ -749,6 +977,546 @@ public:
         return {};
     }
 
+    // A macro whose definition makes including a header a no-op.
+    struct IncludeGuard
+    {
+        // The X of #ifndef X, or a synthetic name (not an identifier) for #pragma once.
+        std::string macro;
+        bool pragmaOnce;
+    };
+
+    // Keyed by header path, filled when a header is first parsed. Entries are never moved,
+    // so guard macro names can be used as symbol names.
+    std::unordered_map<std::filesystem::path, std::optional<IncludeGuard>> includeGuards;
+
+    // Detects #pragma once, or a canonical include guard: the whole file is one
+    // #ifndef X / #if !defined X block without #else or #elif. Where X gets defined does not matter;
+    // once it is defined the file expands to nothing.
+    std::optional<IncludeGuard> detectIncludeGuard(const TSNode & root, const std::filesystem::path & path)
+    {
+        std::vector<TSNode> items;
+        for (const TSNode & item : root.iterateChildren())
+        {
+            if (!item.isNamed() || item.isSymbol(lang.comment_s)) continue;
+            if
+            (
+                item.isSymbol(lang.preproc_call_s)
+                && item.childByFieldId(lang.preproc_call_s.directive_f).textView() == "#pragma"
+            )
+            {
+                TSNode argument = item.childByFieldId(lang.preproc_call_s.argument_f);
+                if (argument && argument.textView() == "once")
+                {
+                    return IncludeGuard{std::format("#pragma once {}", path.string()), true};
+                }
+            }
+            items.push_back(item);
+        }
+        if (items.size() != 1) return std::nullopt;
+
+        const TSNode & guardIf = items[0];
+        if (guardIf.isSymbol(lang.preproc_ifndef_s))
+        {
+            if (guardIf.childByFieldId(lang.preproc_ifndef_s.alternative_f)) return std::nullopt;
+            return IncludeGuard{guardIf.childByFieldId(lang.preproc_ifndef_s.name_f).text(), false};
+        }
+        if (guardIf.isSymbol(lang.preproc_if_s))
+        {
+            if (guardIf.childByFieldId(lang.preproc_if_s.alternative_f)) return std::nullopt;
+            // !defined X or !defined(X)
+            std::vector<TSNode> tokens = lang.tokensToTokenVector(guardIf.childByFieldId(lang.preproc_if_s.condition_f));
+            std::vector<std::string_view> texts;
+            for (const TSNode & token : tokens)
+            {
+                texts.push_back(token.textView());
+            }
+            if (texts.size() == 3 && texts[0] == "!" && texts[1] == "defined" && tokens[2].isSymbol(lang.identifier_s))
+            {
+                return IncludeGuard{tokens[2].text(), false};
+            }
+            if
+            (
+                texts.size() == 5 && texts[0] == "!" && texts[1] == "defined" && texts[2] == "("
+                && tokens[3].isSymbol(lang.identifier_s) && texts[4] == ")"
+            )
+            {
+                return IncludeGuard{tokens[3].text(), false};
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Whether the header was seen before and its guard macro is concretely defined in every state.
+    bool isGuardedInAllStates(const std::filesystem::path & includePath, const std::vector<State> & states)
+    {
+        auto it = includeGuards.find(includePath);
+        if (it == includeGuards.end() || !it->second) return false;
+        std::string_view macro = it->second->macro;
+        for (const State & state : states)
+        {
+            std::optional<Symbol> symbol = state.symbolTable->lookup(macro);
+            if (!symbol) return false; // Symbolic
+            if (std::holds_alternative<UndefinedSymbol>(*symbol) || std::holds_alternative<ExpandedSymbol>(*symbol)) return false;
+        }
+        return true;
+    }
+
+    // Effect of one execution of a header, relative to the states that entered it.
+    // Premises are over summaryPlaceholder(i), standing for the premise of incoming state i.
+    struct HeaderSummary
+    {
+        // A premise tree node created inside the header
+        struct PremiseNode
+        {
+            TSNode node;
+            z3::expr premise;
+            std::size_t parent; // Index of the parent node, or NoParent for a child of the header's node
+        };
+        static constexpr std::size_t NoParent = SIZE_MAX;
+
+        // Premise tree nodes created inside the header, parents first.
+        std::vector<PremiseNode> premiseNodes;
+        // Conjuncted onto the premise tree root, e.g. by #error.
+        z3::expr rootPremise;
+        // (incoming state the table derives from, segments defined on top of it, premise)
+        std::vector<std::tuple<std::size_t, std::vector<SymbolSegmentPtr>, z3::expr>> outputs;
+    };
+
+    // What a header can read from the incoming symbol tables, scanned once per file.
+    struct HeaderInfo
+    {
+        // Headers with nested #includes grow the include tree, which a summary cannot replay.
+        bool memoizable = true;
+        // Identifiers in #if conditions, #ifdef names and macro bodies.
+        std::vector<std::string_view> seedNames;
+    };
+
+    // A name a header can read, and what an incoming table binds it to (nullopt: symbolic)
+    using RelevantBindings = std::vector<std::pair<std::string_view, std::optional<Symbol>>>;
+
+    // What a header summary depends on. Per incoming state: the bindings the header can read,
+    // and the index of the first state whose table merges with it, which decides what merges inside the header.
+    struct HeaderSummaryKey
+    {
+        std::vector<RelevantBindings> bindings;
+        std::vector<std::size_t> mergeClasses;
+
+        bool operator==(const HeaderSummaryKey & other) const
+        {
+            auto bindingsEqual = [](const RelevantBindings & lhs, const RelevantBindings & rhs)
+            {
+                return std::ranges::equal
+                (
+                    lhs,
+                    rhs,
+                    [](const auto & l, const auto & r) { return l.first == r.first && symbolsEqual(l.second, r.second); }
+                );
+            };
+            return mergeClasses == other.mergeClasses && std::ranges::equal(bindings, other.bindings, bindingsEqual);
+        }
+
+        std::size_t hash() const
+        {
+            std::size_t hash = 0;
+            for (const RelevantBindings & stateBindings : bindings)
+            {
+                for (const auto & [name, symbol] : stateBindings)
+                {
+                    hash = hashCombine(hash, std::hash<std::string_view>{}(name));
+                    hash = hashCombine(hash, symbol ? symbolContentHash(*symbol) : std::variant_npos);
+                }
+                hash = hashCombine(hash, stateBindings.size());
+            }
+            for (std::size_t mergeClass : mergeClasses) hash = hashCombine(hash, mergeClass);
+            return hash;
+        }
+    };
+
+    std::map<std::filesystem::path, HeaderInfo> headerInfos;
+    // Bucketed by header and key hash; keys in a bucket are told apart by comparing them in full.
+    std::map<std::pair<std::filesystem::path, std::size_t>, std::vector<std::pair<HeaderSummaryKey, HeaderSummary>>> headerSummaries;
+
+    // Executes an included header through the summary cache.
+    // On a miss, the header runs once with a placeholder premise per incoming state and a scratch
+    // scribe, so that everything it produces is relative to the incoming premises. The summary is
+    // keyed by the bindings of every macro the header can read, and replayed by substituting the
+    // actual premises for the placeholders.
+    Warp executeHeaderMemoized(Warp && startWarp, const ProgramPoint & joinPoint)
+    {
+        const ProgramPoint headerPoint = startWarp.programPoint;
+        const HeaderInfo & info = getHeaderInfo(headerPoint);
+        if (!info.memoizable) return executeTranslationUnit(std::move(startWarp), joinPoint);
+
+        // Normally done by executeTranslationUnit. Done first here, so that the header's own
+        // macros read the same on every include when computing the key.
+        forceUndefineDefinedMacros(headerPoint.node);
+
+        const std::vector<State> & states = startWarp.states;
+        HeaderSummaryKey key = headerSummaryKey(info, states);
+        std::vector<std::pair<HeaderSummaryKey, HeaderSummary>> & bucket = headerSummaries[{headerPoint.includeTree->path, key.hash()}];
+        for (const auto & [bucketKey, bucketSummary] : bucket)
+        {
+            if (!(bucketKey == key)) continue;
+            headerSummaryHits++;
+            SPDLOG_TRACE("Replaying header summary: {}", headerPoint.toString());
+            // The replayed states were split and merged inside the header when it was recorded.
+            const std::size_t outputCount = bucketSummary.outputs.size();
+            if (outputCount > states.size()) stats.statesAdded(outputCount - states.size());
+            else stats.statesMergedAway(states.size() - outputCount);
+            return replayHeaderSummary(bucketSummary, headerPoint, states, joinPoint);
+        }
+        headerSummaryMisses++;
+
+        std::vector<State> placeholderStates;
+        for (std::size_t i = 0; i < states.size(); ++i)
+        {
+            placeholderStates.push_back(State{states[i].symbolTable, summaryPlaceholder(i)});
+        }
+        PremiseTreeScribe realScribe = std::move(scribe);
+        scribe = PremiseTreeScribe(headerPoint, ctx->bool_val(true));
+        Warp endWarp = executeTranslationUnit(Warp{headerPoint, std::move(placeholderStates)}, joinPoint);
+        PremiseTreeScribe scratchScribe = std::move(scribe);
+        scribe = std::move(realScribe);
+
+        const PremiseTree * scratchRoot = scratchScribe.borrowTree();
+        HeaderSummary summary{{}, scratchRoot->premise, {}};
+        std::unordered_map<const PremiseTree *, std::size_t> premiseNodeIndices;
+        for (const PremiseTree * premiseNode : scratchRoot->getDescendantsPreOrder())
+        {
+            if (premiseNode == scratchRoot) continue;
+            assert(premiseNode->programPoint.includeTree == headerPoint.includeTree);
+            auto parentIt = premiseNodeIndices.find(premiseNode->parent);
+            const std::size_t parent = parentIt != premiseNodeIndices.end() ? parentIt->second : HeaderSummary::NoParent;
+            premiseNodeIndices.emplace(premiseNode, summary.premiseNodes.size());
+            summary.premiseNodes.push_back({premiseNode->programPoint.node, premiseNode->premise, parent});
+        }
+
+        // Express every output table as a delta over an incoming one.
+        // Flattening may hide the incoming table, then the summary only serves this include.
+        bool cacheable = true;
+        for (const State & endState : endWarp.states)
+        {
+            std::optional<std::vector<SymbolSegmentPtr>> segments;
+            std::size_t sourceIndex = 0;
+            for (std::size_t i = 0; i < states.size() && !segments; ++i)
+            {
+                segments = endState.symbolTable->segmentsSince(*states[i].symbolTable);
+                sourceIndex = i;
+            }
+            if (!segments)
+            {
+                cacheable = false;
+                break;
+            }
+            summary.outputs.emplace_back(sourceIndex, std::move(*segments), endState.premise);
+        }
+
+        if (!cacheable)
+        {
+            replayHeaderPremises(summary, headerPoint, states);
+            std::vector<State> outputs;
+            for (State & endState : endWarp.states)
+            {
+                outputs.push_back(State{std::move(endState.symbolTable), substitutePlaceholders(endState.premise, states)});
+            }
+            return {joinPoint, keepFeasible(std::move(outputs))};
+        }
+        bucket.emplace_back(std::move(key), std::move(summary));
+        return replayHeaderSummary(bucket.back().second, headerPoint, states, joinPoint);
+    }
+
+    const HeaderInfo & getHeaderInfo(const ProgramPoint & headerPoint)
+    {
+        const std::filesystem::path & path = headerPoint.includeTree->path;
+        if (auto it = headerInfos.find(path); it != headerInfos.end()) return it->second;
+
+        HeaderInfo info;
+        info.memoizable = astBank.index(headerPoint.node).includes.empty();
+        for (const TSNode & node : headerPoint.node.iterateDescendants())
+        {
+            if (node.isSymbol(lang.preproc_tokens_s))
+            {
+                for (const TSNode & token : node.iterateChildren())
+                {
+                    if (token.isSymbol(lang.identifier_s)) info.seedNames.push_back(token.textView());
+                }
+            }
+            else if
+            (
+                node.isSymbol(lang.preproc_ifdef_s)
+                || node.isSymbol(lang.preproc_ifndef_s)
+                || node.isSymbol(lang.preproc_elifdef_s)
+                || node.isSymbol(lang.preproc_elifndef_s)
+            )
+            {
+                info.seedNames.push_back(node.childByFieldId(lang.preproc_ifdef_s.name_f).textView());
+            }
+        }
+        std::sort(info.seedNames.begin(), info.seedNames.end());
+        info.seedNames.erase(std::unique(info.seedNames.begin(), info.seedNames.end()), info.seedNames.end());
+        return headerInfos.emplace(path, std::move(info)).first->second;
+    }
+
+    HeaderSummaryKey headerSummaryKey(const HeaderInfo & info, const std::vector<State> & states)
+    {
+        HeaderSummaryKey key;
+        for (const State & state : states)
+        {
+            key.bindings.push_back(relevantBindings(info.seedNames, *state.symbolTable));
+        }
+        // Mirrors the merge test at join points (State::mergeInplace)
+        for (std::size_t i = 0; i < states.size(); ++i)
+        {
+            const SymbolTable & table = *states[i].symbolTable;
+            std::size_t first = 0;
+            while
+            (
+                states[first].symbolTable->getContentHash() != table.getContentHash()
+                || !states[first].symbolTable->sameBindings(table)
+            )
+            {
+                first++;
+            }
+            key.mergeClasses.push_back(first);
+        }
+        return key;
+    }
+
+    // The bindings of the seed names and of every name reachable through their bodies, in visiting order.
+    RelevantBindings relevantBindings(const std::vector<std::string_view> & seedNames, const SymbolTable & symbolTable)
+    {
+        RelevantBindings bindings;
+        std::set<std::string_view> visited;
+        std::vector<std::string_view> workList(seedNames.rbegin(), seedNames.rend());
+        while (!workList.empty())
+        {
+            std::string_view name = workList.back();
+            workList.pop_back();
+            if (!visited.insert(name).second) continue;
+
+            std::optional<Symbol> symbol = symbolTable.lookup(name);
+            if (symbol && (std::holds_alternative<ObjectSymbol>(*symbol) || std::holds_alternative<FunctionSymbol>(*symbol)))
+            {
+                if (const TSNode & body = symbolBody(*symbol))
+                {
+                    for (const TSNode & token : body.iterateChildren())
+                    {
+                        if (token.isSymbol(lang.identifier_s)) workList.push_back(token.textView());
+                    }
+                }
+            }
+            bindings.emplace_back(name, std::move(symbol));
+        }
+        return bindings;
+    }
+
+    Warp replayHeaderSummary
+    (
+        const HeaderSummary & summary,
+        const ProgramPoint & headerPoint,
+        const std::vector<State> & states,
+        const ProgramPoint & joinPoint
+    )
+    {
+        replayHeaderPremises(summary, headerPoint, states);
+        std::vector<State> outputs;
+        for (const auto & [sourceIndex, segments, premise] : summary.outputs)
+        {
+            SymbolTablePtr symbolTable = states[sourceIndex].symbolTable;
+            for (const SymbolSegmentPtr & segment : segments)
+            {
+                symbolTable = symbolTable->define(segment);
+            }
+            outputs.push_back(State{std::move(symbolTable), substitutePlaceholders(premise, states)});
+        }
+        return {joinPoint, keepFeasible(std::move(outputs))};
+    }
+
+    // Premise nodes are replayed only where the actual premises can reach them.
+    // The summary was recorded under free placeholders, so it also holds nodes of branches
+    // the incoming states never enter, which a direct execution would not create.
+    void replayHeaderPremises(const HeaderSummary & summary, const ProgramPoint & headerPoint, const std::vector<State> & states)
+    {
+        std::vector<z3::expr> premises;
+        std::vector<z3::expr> completePremises;
+        for (const HeaderSummary::PremiseNode & premiseNode : summary.premiseNodes)
+        {
+            premises.push_back(substitutePlaceholders(premiseNode.premise, states));
+            completePremises.push_back
+            (
+                premiseNode.parent == HeaderSummary::NoParent
+                    ? premises.back()
+                    : premises.back() && completePremises[premiseNode.parent]
+            );
+        }
+        std::vector<z3::check_result> results;
+        {
+            PioneerStats::SolverScope solver(stats, "replay_premise", completePremises.size());
+            results = checkAll(completePremises);
+        }
+        std::vector<bool> reached(summary.premiseNodes.size(), false);
+        for (std::size_t i = 0; i < summary.premiseNodes.size(); ++i)
+        {
+            const HeaderSummary::PremiseNode & premiseNode = summary.premiseNodes[i];
+            const bool parentReached = premiseNode.parent == HeaderSummary::NoParent || reached[premiseNode.parent];
+            if (!parentReached) continue;
+            if (results[i] == z3::unsat)
+            {
+                // Marked unreachable, as executeIf does for a branch no state enters
+                scribe.createNode({headerPoint.includeTree, premiseNode.node}, ctx->bool_val(false));
+                continue;
+            }
+            reached[i] = true;
+            scribe.createNode({headerPoint.includeTree, premiseNode.node}, simplifyOrOfAnd(premises[i]));
+        }
+        if (!summary.rootPremise.is_true())
+        {
+            scribe.conjunctPremiseOntoRoot(simplifyOrOfAnd(substitutePlaceholders(summary.rootPremise, states)));
+        }
+    }
+
+    // Stands for the premise of the i-th state entering a header while its summary is recorded.
+    // Headers with summaries contain no #include, so recordings never nest and the names never clash.
+    z3::expr summaryPlaceholder(std::size_t i)
+    {
+        return ctx->bool_const(std::format("premise#{}", i).c_str());
+    }
+
+    z3::expr substitutePlaceholders(const z3::expr & expr, const std::vector<State> & states)
+    {
+        z3::expr_vector placeholders(*ctx);
+        z3::expr_vector premises(*ctx);
+        for (std::size_t i = 0; i < states.size(); ++i)
+        {
+            placeholders.push_back(summaryPlaceholder(i));
+            premises.push_back(states[i].premise);
+        }
+        z3::expr substituted = expr;
+        return substituted.substitute(placeholders, premises);
+    }
+
+    // Drops states whose premise became unsatisfiable, and simplifies the rest. Undecided premises are kept.
+    std::vector<State> keepFeasible(std::vector<State> && states)
+    {
+        std::vector<z3::expr> premises;
+        for (const State & state : states)
+        {
+            premises.push_back(state.premise);
+        }
+        std::vector<z3::check_result> results;
+        {
+            PioneerStats::SolverScope solver(stats, "keep_feasible", premises.size());
+            results = checkAll(premises);
+        }
+        std::vector<State> feasible;
+        for (std::size_t i = 0; i < states.size(); ++i)
+        {
+            if (results[i] == z3::unsat) continue;
+            feasible.push_back(std::move(states[i]));
+            feasible.back().simplify();
+        }
+        stats.statesDroppedAway(states.size() - feasible.size());
+        return feasible;
+    }
+
+    // Satisfiability of each expression, in input order, answered from the query cache where possible.
+    // Misses are dispatched to the check pool when there is one, which does not change the results,
+    // and cached alike, so runs with and without a pool share hits.
+    std::vector<z3::check_result> checkAll(const std::vector<z3::expr> & exprs)
+    {
+        std::vector<z3::check_result> results(exprs.size(), z3::unknown);
+        std::vector<std::size_t> missed;
+        std::vector<z3::expr> misses;
+        for (std::size_t i = 0; i < exprs.size(); ++i)
+        {
+            if (std::optional<z3::check_result> cached = queryCache->lookup(exprs[i]))
+            {
+                results[i] = *cached;
+                continue;
+            }
+            missed.push_back(i);
+            misses.push_back(exprs[i]);
+        }
+        std::vector<z3::check_result> checked;
+        if (checkPool && misses.size() > 1)
+        {
+            checked = checkPool->checkAll(misses);
+        }
+        else
+        {
+            for (const z3::expr & expr : misses) checked.push_back(z3CheckUncached(expr));
+        }
+        for (std::size_t k = 0; k < missed.size(); ++k)
+        {
+            results[missed[k]] = checked[k];
+            queryCache->remember(misses[k], checked[k]);
+        }
+        return results;
+    }
+
+    // Merges other into state if their tables disagree on at most iteMergeLimit macros,
+    // each an object-like macro with an integer-constant body (or already guarded) in both.
+    // Every disagreeing macro becomes a GuardedSymbol keyed by the two states' premises,
+    // which are disjoint since they belong to different paths.
+    // stateAncestors are the ancestors() of state's table.
+    // Returns whether the merge was successful or not.
+    bool iteMergeInplace
+    (
+        State & state,
+        const std::unordered_set<const SymbolTable *> & stateAncestors,
+        const State & other
+    )
+    {
+        std::vector<Symbol> guardedSymbols;
+        for (std::string_view name : state.symbolTable->namesDefinedSinceCommonAncestor(*other.symbolTable, stateAncestors))
+        {
+            std::optional<Symbol> symbol = state.symbolTable->lookup(name);
+            std::optional<Symbol> otherSymbol = other.symbolTable->lookup(name);
+            if (symbolsEqual(symbol, otherSymbol)) continue;
+            if (guardedSymbols.size() >= iteMergeLimit) return false;
+
+            std::optional<std::vector<std::pair<z3::expr, z3::expr>>> alternatives = guardedAlternatives(symbol, state.premise);
+            std::optional<std::vector<std::pair<z3::expr, z3::expr>>> otherAlternatives = guardedAlternatives(otherSymbol, other.premise);
+            if (!alternatives || !otherAlternatives) return false;
+            alternatives->insert(alternatives->end(), otherAlternatives->begin(), otherAlternatives->end());
+            guardedSymbols.push_back(GuardedSymbol{name, std::move(*alternatives)});
+        }
+
+        if (!guardedSymbols.empty())
+        {
+            SymbolSegmentPtr segment = SymbolSegment::make();
+            for (Symbol & guardedSymbol : guardedSymbols)
+            {
+                segment->define(std::move(guardedSymbol));
+            }
+            state.symbolTable = state.symbolTable->define(segment);
+        }
+        state.premise = state.premise || other.premise;
+        return true;
+    }
+
+    // A symbol's integer value(s) as (guard, value) pairs, if it has any.
+    std::optional<std::vector<std::pair<z3::expr, z3::expr>>> guardedAlternatives
+    (
+        const std::optional<Symbol> & symbol,
+        const z3::expr & premise
+    )
+    {
+        if (!symbol) return std::nullopt;
+        if (const GuardedSymbol * guardedSymbol = std::get_if<GuardedSymbol>(&*symbol))
+        {
+            return guardedSymbol->alternatives;
+        }
+        if (const ObjectSymbol * objectSymbol = std::get_if<ObjectSymbol>(&*symbol))
+        {
+            if (std::optional<z3::expr> value = macroExpander.symbolizeIntegerConstantBody(objectSymbol->body))
+            {
+                return std::vector<std::pair<z3::expr, z3::expr>>{{premise, *value}};
+            }
+        }
+        return std::nullopt;
+    }
+
     Warp executeError(Warp && startWarp)
     {
         assert(startWarp.programPoint.node.isSymbol(lang.preproc_error_s));
@@ -758,7 +1526,12 @@ public:
         {
             disallowed = disallowed || state.premise;
         }
-        if (z3CheckTautology(disallowed))
+        bool allDisallowed;
+        {
+            PioneerStats::SolverScope solver(stats, "error", 1);
+            allDisallowed = z3CheckTautology(disallowed);
+        }
+        if (allDisallowed)
         {
             SPDLOG_WARN("All states lead to #error at {}.", startWarp.programPoint.toString());
         }
@@ -862,21 +1635,34 @@ public:
             }
         }
 
-        // Before merging, sort all blocked states by their symbol table pointer value.
+        // Before merging, sort all blocked states by their symbol table content hash, then pointer value.
         // This way we can do a one pass merge.
         std::sort(blockedStates.begin(), blockedStates.end(), [](const State & a, const State & b)
         {
-            return a.symbolTable < b.symbolTable;
+            return std::make_pair(a.symbolTable->getContentHash(), a.symbolTable.get())
+                < std::make_pair(b.symbolTable->getContentHash(), b.symbolTable.get());
         });
 
+        // Structurally equal tables only differ in where their symbols were defined.
+        // Invocation analysis records definition sites, so it keeps such states apart.
+        const bool mergeStructurally = !analyzeInvocations;
         std::vector<State> mergedStates;
         for (State & blockedState : blockedStates)
         {
             State blockedStateOwned = std::move(blockedState);
-            if (mergedStates.empty() || !mergedStates.back().mergeInplace(blockedStateOwned))
+            // Only states with the same content hash can merge, and they are adjacent after sorting.
+            // Colliding tables that differ stay apart, so try every merged state of the hash.
+            bool merged = false;
+            for (State & mergedState : mergedStates | std::views::reverse)
             {
-                mergedStates.push_back(std::move(blockedStateOwned));
+                if (mergedState.symbolTable->getContentHash() != blockedStateOwned.symbolTable->getContentHash()) break;
+                if (mergedState.mergeInplace(blockedStateOwned, mergeStructurally))
+                {
+                    merged = true;
+                    break;
+                }
             }
+            if (!merged) mergedStates.push_back(std::move(blockedStateOwned));
         }
 
         for (State & mergedState : mergedStates)
@@ -884,6 +1670,37 @@ public:
             mergedState.simplify();
         }
 
+        // Veritesting-style: fold states whose tables only disagree on a few integer-valued macros.
+        // Guarded symbols have no definition site, so invocation analysis keeps such states apart.
+        if (iteMergeLimit > 0 && !analyzeInvocations && mergedStates.size() > 1)
+        {
+            std::vector<State> iteMergedStates;
+            // Ancestors of each ITE-merged state's table, updated when a merge replaces the table
+            std::vector<std::unordered_set<const SymbolTable *>> iteMergedAncestors;
+            for (State & mergedState : mergedStates)
+            {
+                bool merged = false;
+                for (std::size_t i = 0; i < iteMergedStates.size(); ++i)
+                {
+                    State & iteMergedState = iteMergedStates[i];
+                    const SymbolTable * table = iteMergedState.symbolTable.get();
+                    if (iteMergeInplace(iteMergedState, iteMergedAncestors[i], mergedState))
+                    {
+                        if (iteMergedState.symbolTable.get() != table) iteMergedAncestors[i] = iteMergedState.symbolTable->ancestors();
+                        iteMergedState.simplify();
+                        merged = true;
+                        break;
+                    }
+                }
+                if (!merged)
+                {
+                    iteMergedAncestors.push_back(mergedState.symbolTable->ancestors());
+                    iteMergedStates.push_back(std::move(mergedState));
+                }
+            }
+            mergedStates = std::move(iteMergedStates);
+        }
+
         #if DEBUG
         {
             SPDLOG_TRACE("Merged states ({}):", mergedStates.size());
@@ -895,9 +1712,16 @@ public:
         }
         #endif
 
-        SPDLOG_TRACE("Total symbol segments: {}", SymbolSegment::totalSymbolSegments);
-        SPDLOG_TRACE("Total symbols: {}", SymbolSegment::totalSymbols);
-        SPDLOG_TRACE("Total symbol tables: {}", SymbolTable::totalSymbolTables);
+        stats.joins++;
+        stats.statesMergedAway(blockedStates.size() - mergedStates.size());
+        for (const State & state : mergedStates)
+        {
+            stats.symbolChainDepths[state.symbolTable->getDepth()]++;
+        }
+        SPDLOG_TRACE("Total symbol segments: {}", stats.symbolTables.segments);
+        SPDLOG_TRACE("Total symbols: {}", stats.symbolTables.symbols);
+        SPDLOG_TRACE("Total symbol tables: {}", stats.symbolTables.tables);
+        SPDLOG_TRACE("Total symbol table flattens: {}", stats.symbolTables.flattens);
         
         return {joinPoint, std::move(mergedStates)};
     }
@@ -207,6 +207,7 @@ public:
     operator const ts::TSTree *() const;
     ts::TSTree * get();
 
+    TSTree copy() const;
     TSNode rootNode() const;
     TSNode rootNodeWithOffset(uint32_t offsetBytes, ts::TSPoint offsetExtent) const;
     const TSLanguage language() const;
@@ -246,6 +247,7 @@ public:
 
     TSTree parseString(std::string_view source);
     TSTree parseString(std::string && source);
+    TSTree parseString(std::string_view source, const TSTree & oldTree);
     void reset();
 private:
     std::unique_ptr<ts::TSParser, decltype(&ts::ts_parser_delete)> parser;
@@ -1203,6 +1205,12 @@ ts::TSTree * TSTree::get()
     return *this;
 }
 
+// Copy the syntax tree, e.g. to edit it while the original is in use. The nodes are shared, the source is copied.
+TSTree TSTree::copy() const
+{
+    return { ts::ts_tree_copy(*this), getSource() };
+}
+
 // Get the root node of the syntax tree.
 TSNode TSTree::rootNode() const
 {
@@ -1320,6 +1328,12 @@ TSTree TSParser::parseString(std::string && source)
     return { ts::ts_parser_parse_string(*this, nullptr, source.data(), source.size()), source };
 }
 
+// Parse incrementally, reusing the unchanged parts of an old tree that has been edited to match the new source.
+TSTree TSParser::parseString(std::string_view source, const TSTree & oldTree)
+{
+    return { ts::ts_parser_parse_string(*this, oldTree, source.data(), source.size()), source };
+}
+
 // Reset the parser to start the next parse from the beginning.
 void TSParser::reset()
 {
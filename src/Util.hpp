@@ -13,14 +13,23 @@
 #include <fstream>
 #include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <format>
 #include <sstream>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
 
 #include <boost/stacktrace.hpp>
 #include <spdlog/spdlog.h>
 #include <z3++.h>
 #include "json.hpp"
 
+#include "PremiseBdd.hpp"
+
 namespace Hayroll
 {
 
@@ -191,14 +200,265 @@ struct Z3ExprEqual
     }
 };
 
-z3::check_result z3Check(const z3::expr & expr)
+// Order-dependent combination of two hash values (64-bit variant of boost::hash_combine)
+std::size_t hashCombine(std::size_t seed, std::size_t value)
+{
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 12) + (seed >> 4));
+}
+
+// Hash of a token sequence that ignores how the tokens are separated by whitespace,
+// so "a+b" and "a + b" still differ but "a  b" and "a b" do not
+std::size_t hashIgnoringWhitespaceRuns(std::string_view text)
+{
+    std::size_t hash = 0;
+    bool seenToken = false;
+    bool pendingSpace = false;
+    for (char c : text)
+    {
+        if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            pendingSpace = seenToken;
+            continue;
+        }
+        if (pendingSpace) hash = hashCombine(hash, ' ');
+        pendingSpace = false;
+        seenToken = true;
+        hash = hashCombine(hash, static_cast<unsigned char>(c));
+    }
+    return hash;
+}
+
+// Equality that hashIgnoringWhitespaceRuns agrees with
+bool equalIgnoringWhitespaceRuns(std::string_view lhs, std::string_view rhs)
+{
+    // Token characters of text from pos on, with a single ' ' for each inner whitespace run
+    auto next = [](std::string_view text, std::size_t & pos, bool & seenToken) -> int
+    {
+        bool space = false;
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+        {
+            space = seenToken;
+            ++pos;
+        }
+        if (pos == text.size()) return -1;
+        if (space)
+        {
+            seenToken = false; // Report the run once, then the character after it
+            return ' ';
+        }
+        seenToken = true;
+        return static_cast<unsigned char>(text[pos++]);
+    };
+    std::size_t lhsPos = 0, rhsPos = 0;
+    bool lhsSeen = false, rhsSeen = false;
+    while (true)
+    {
+        int l = next(lhs, lhsPos, lhsSeen);
+        int r = next(rhs, rhsPos, rhsSeen);
+        if (l != r) return false;
+        if (l == -1) return true;
+    }
+}
+
+// Objects of type T serving one z3 context each, found from any expression of that context.
+// An object adds itself while it lives and must be destroyed before its context.
+// Lookups go through a per-thread memo of the last answer, taken without the lock for as long as
+// no object was added or removed since; z3 contexts are single-threaded, so threads rarely share one.
+template <typename T>
+class ContextRegistry
+{
+public:
+    // Returns false if another object already serves ctx.
+    static bool add(const z3::context & ctx, T * object)
+    {
+        std::lock_guard lock(mutex());
+        bool added = entries().try_emplace(ctx, object).second;
+        if (added) generation().fetch_add(1, std::memory_order_release);
+        return added;
+    }
+
+    static void remove(const z3::context & ctx)
+    {
+        std::lock_guard lock(mutex());
+        if (entries().erase(ctx)) generation().fetch_add(1, std::memory_order_release);
+    }
+
+    static T * find(const z3::context & ctx)
+    {
+        thread_local Memo memo;
+        const Z3_context key = ctx;
+        if (memo.ctx == key && memo.generation == generation().load(std::memory_order_acquire)) return memo.object;
+
+        std::lock_guard lock(mutex());
+        auto it = entries().find(key);
+        memo = Memo{key, it == entries().end() ? nullptr : it->second, generation().load(std::memory_order_relaxed)};
+        return memo.object;
+    }
+
+private:
+    struct Memo
+    {
+        Z3_context ctx = nullptr;
+        T * object = nullptr;
+        std::uint64_t generation = 0;
+    };
+
+    static std::unordered_map<Z3_context, T *> & entries()
+    {
+        static std::unordered_map<Z3_context, T *> objects;
+        return objects;
+    }
+
+    // Bumped by every add and remove, which invalidates all memos
+    static std::atomic<std::uint64_t> & generation()
+    {
+        static std::atomic<std::uint64_t> counter{1};
+        return counter;
+    }
+
+    static std::mutex & mutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+};
+
+z3::check_result z3CheckUncached(const z3::expr & expr)
 {
+    // Pure boolean premises are decided on their BDD: satisfiable iff not the false node.
+    if (std::optional<PremiseBdd::Ref> bdd = PremiseBdd({expr}).fromExpr(expr))
+    {
+        return *bdd == PremiseBdd::False ? z3::unsat : z3::sat;
+    }
+
     z3::context & ctx = expr.ctx();
     z3::solver solver(ctx);
     solver.add(expr);
-    z3::check_result result = solver.check();
-    assert(result == z3::sat || result == z3::unsat);
-    return result;
+    // May be unknown; callers treat that as satisfiable
+    return solver.check();
+}
+
+// Memoized satisfiability queries over one z3 context, with one reused solver.
+// While alive, it serves every z3Check on expressions of that context.
+// The owner must destroy it before the context; cached expressions pin their ASTs, so ids are never recycled.
+// Results are dropped all at once when maxEntries is reached, so a long-lived cache stays bounded.
+class Z3QueryCache
+{
+public:
+    static constexpr std::size_t DefaultMaxEntries = 1 << 18;
+
+    explicit Z3QueryCache(z3::context & ctx, std::size_t maxEntries = DefaultMaxEntries)
+        : ctx(ctx), solver(ctx), maxEntries(maxEntries)
+    {
+        bool added = ContextRegistry<Z3QueryCache>::add(ctx, this);
+        assert(added);
+    }
+
+    Z3QueryCache(const Z3QueryCache &) = delete;
+    Z3QueryCache & operator=(const Z3QueryCache &) = delete;
+
+    ~Z3QueryCache()
+    {
+        ContextRegistry<Z3QueryCache>::remove(ctx);
+    }
+
+    z3::check_result check(const z3::expr & expr)
+    {
+        if (std::optional<z3::check_result> cached = lookup(expr)) return *cached;
+        z3::check_result result = z3CheckUncached(expr);
+        remember(expr, result);
+        return result;
+    }
+
+    // The cached result of a query, counted as a hit or a miss.
+    // A miss checked elsewhere (e.g. by a Z3CheckPool) should be passed to remember.
+    std::optional<z3::check_result> lookup(const z3::expr & expr)
+    {
+        if (auto it = results.find(expr); it != results.end())
+        {
+            ++hits;
+            return it->second;
+        }
+        ++misses;
+        return std::nullopt;
+    }
+
+    void remember(const z3::expr & query, z3::check_result result)
+    {
+        if (results.size() >= maxEntries)
+        {
+            results.clear();
+            ++clears;
+        }
+        results.emplace(query, result);
+    }
+
+    // Satisfiability of prefix && cond for each cond, in input order.
+    // Misses share one solver scope in which prefix is asserted only once.
+    std::vector<z3::check_result> checkUnder(const z3::expr & prefix, const std::vector<z3::expr> & conds)
+    {
+        std::vector<z3::check_result> out(conds.size(), z3::unknown);
+        std::vector<std::size_t> missed;
+        for (std::size_t i = 0; i < conds.size(); ++i)
+        {
+            const z3::expr query = prefix && conds[i];
+            if (auto it = results.find(query); it != results.end())
+            {
+                ++hits;
+                out[i] = it->second;
+            }
+            else if (std::optional<PremiseBdd::Ref> bdd = PremiseBdd({query}).fromExpr(query))
+            {
+                ++misses;
+                out[i] = *bdd == PremiseBdd::False ? z3::unsat : z3::sat;
+                remember(query, out[i]);
+            }
+            else
+            {
+                ++misses;
+                missed.push_back(i);
+            }
+        }
+        if (missed.empty()) return out;
+
+        solver.push();
+        solver.add(prefix);
+        for (std::size_t i : missed)
+        {
+            solver.push();
+            solver.add(conds[i]);
+            out[i] = solver.check();
+            solver.pop();
+            remember(prefix && conds[i], out[i]);
+        }
+        solver.pop();
+        return out;
+    }
+
+    std::size_t size() const
+    {
+        return results.size();
+    }
+
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    // Times the results were dropped for reaching maxEntries
+    std::size_t clears = 0;
+
+private:
+    z3::context & ctx;
+    z3::solver solver;
+    std::size_t maxEntries;
+    std::unordered_map<z3::expr, z3::check_result, Z3ExprHash, Z3ExprEqual> results;
+};
+
+z3::check_result z3Check(const z3::expr & expr)
+{
+    if (Z3QueryCache * cache = ContextRegistry<Z3QueryCache>::find(expr.ctx()))
+    {
+        return cache->check(expr);
+    }
+    return z3CheckUncached(expr);
 }
 
 bool z3CheckTautology(const z3::expr & expr)
@@ -438,50 +698,194 @@ z3::expr factorCommonTerm(const z3::expr & e)
     }
 }
 
+// How much work simplifyOrOfAnd may spend on premises that are not pure boolean.
+enum class SimplifyTier
+{
+    Syntactic, // Rewriting, factoring and dominator-based subsumption only
+    Adaptive, // Plus solver-based contextual simplification for expressions above a size threshold
+    Full // Solver-based contextual simplification for every expression, without a time limit; the default
+};
+
+// Number of distinct subexpressions of expr
+std::size_t exprDagSize(const z3::expr & expr)
+{
+    std::unordered_set<unsigned> seen;
+    std::vector<z3::expr> worklist{expr};
+    while (!worklist.empty())
+    {
+        z3::expr e = worklist.back();
+        worklist.pop_back();
+        if (!seen.insert(e.id()).second) continue;
+        if (!e.is_app()) continue;
+        for (unsigned i = 0; i < e.num_args(); ++i) worklist.push_back(e.arg(i));
+    }
+    return seen.size();
+}
+
+// Tiered premise simplifier with tactics built once for its context.
+// Serves simplifyOrOfAnd for that context while it lives, see ContextRegistry.
+class PremiseSimplifier
+{
+public:
+    // Full keeps the premises emitted before tiers existed, and is never cut short, so its output
+    // does not depend on timing; the others trade them for speed
+    static constexpr SimplifyTier DefaultTier = SimplifyTier::Full;
+    static constexpr std::size_t DefaultSizeThreshold = 32;
+    static constexpr unsigned DefaultTimeoutMs = 500;
+
+    explicit PremiseSimplifier
+    (
+        z3::context & ctx,
+        SimplifyTier tier = DefaultTier,
+        std::size_t sizeThreshold = DefaultSizeThreshold,
+        unsigned timeoutMs = DefaultTimeoutMs
+    )
+        : ctx(ctx), tier(tier), sizeThreshold(sizeThreshold), timeoutMs(timeoutMs),
+          tacticSimplify(with(z3::tactic(ctx, "simplify"), simplifyParams(ctx))),
+          tacticCheap
+          (
+              tacticSimplify
+              & z3::tactic(ctx, "propagate-values")
+              & z3::tactic(ctx, "dom-simplify")
+              & tacticSimplify
+          ),
+          tacticFull
+          (
+              tacticSimplify
+              & z3::tactic(ctx, "propagate-values")
+              & z3::tactic(ctx, "unit-subsume-simplify")
+              & z3::tactic(ctx, "dom-simplify")
+              & z3::tactic(ctx, "ctx-solver-simplify")
+              & tacticSimplify
+          ),
+          tacticContextual
+          (
+              z3::try_for
+              (
+                  z3::tactic(ctx, "unit-subsume-simplify")
+                  & z3::tactic(ctx, "ctx-solver-simplify")
+                  & tacticSimplify,
+                  timeoutMs
+              )
+          )
+    {
+        registered = ContextRegistry<PremiseSimplifier>::add(ctx, this);
+    }
+
+    PremiseSimplifier(const PremiseSimplifier &) = delete;
+    PremiseSimplifier & operator=(const PremiseSimplifier &) = delete;
+
+    ~PremiseSimplifier()
+    {
+        if (registered) ContextRegistry<PremiseSimplifier>::remove(ctx);
+    }
+
+    z3::expr simplify(const z3::expr & expr)
+    {
+        // Tier 1: flatten and/or, factor common terms, then cheap rewriting.
+        z3::expr result = apply(tacticSimplify, expr);
+        result = factorCommonTerm(result);
+        if (tier == SimplifyTier::Full)
+        {
+            result = apply(tacticFull, result);
+            assert(z3Check(result != expr) == z3::unsat);
+            return result;
+        }
+        result = apply(tacticCheap, result);
+        if (tier == SimplifyTier::Syntactic) return result;
+        if (tier == SimplifyTier::Adaptive && exprDagSize(result) <= sizeThreshold) return result;
+
+        // Tier 2 of Adaptive: solver-based contextual simplification, bounded by the timeout.
+        // On timeout the tier 1 result is kept.
+        try
+        {
+            result = apply(tacticContextual, result);
+        }
+        catch (const z3::exception & e)
+        {
+            ++timeouts;
+            SPDLOG_TRACE("Contextual simplification gave up: {}", e.msg());
+        }
+        assert(z3Check(result != expr) == z3::unsat);
+        return result;
+    }
+
+    std::size_t timeouts = 0;
+
+    SimplifyTier getTier() const
+    {
+        return tier;
+    }
+
+    std::size_t getSizeThreshold() const
+    {
+        return sizeThreshold;
+    }
+
+    unsigned getTimeoutMs() const
+    {
+        return timeoutMs;
+    }
+
+private:
+    z3::context & ctx;
+    SimplifyTier tier;
+    std::size_t sizeThreshold;
+    unsigned timeoutMs;
+    bool registered = false;
+    z3::tactic tacticSimplify;
+    z3::tactic tacticCheap;
+    z3::tactic tacticFull; // The unbounded sequence premises were simplified with before tiers
+    z3::tactic tacticContextual;
+
+    static z3::params simplifyParams(z3::context & ctx)
+    {
+        z3::params params(ctx);
+        params.set("flat_and_or", true);
+        params.set("bv_ite2id", true);
+        params.set("local_ctx", true);
+        return params;
+    }
+
+    z3::expr apply(z3::tactic & tactic, const z3::expr & expr)
+    {
+        z3::goal goal(ctx);
+        goal.add(expr);
+        z3::apply_result res = tactic(goal);
+        assert(res.size() > 0);
+        return res[0].as_expr();
+    }
+};
+
 // Simplify expressions
 // Most effective for the form: (x && y) || (x && z) => x && (y || z) => x (y || z == 1)
-// Does more setup and cleanup work than the factorCommonTerm function
+// Pure boolean premises are simplified on their BDD; others go through the PremiseSimplifier
+// serving their context. One-off calls on a context without one build a default-tier simplifier each;
+// hot callers (SymbolicExecutor, PremiseTree::refine) keep one alive instead.
 z3::expr simplifyOrOfAnd(const z3::expr & expr)
 {
     z3::context & ctx = expr.ctx();
-    
-    z3::params paramsSimplify(ctx);
-    paramsSimplify.set("flat_and_or", true);
-    paramsSimplify.set("bv_ite2id", true);
-    paramsSimplify.set("local_ctx", true);
-    z3::tactic tacticSimplify = with(z3::tactic(ctx, "simplify"), paramsSimplify);
-
-    // Flat and/or before sending to factorCommonTerm
-    z3::goal goal1(ctx);
-    goal1.add(expr);
-    z3::apply_result res1 = tacticSimplify(goal1);
-    assert(res1.size() > 0);
-    z3::expr expr1 = res1[0].as_expr();
-
-    z3::expr expr2 = factorCommonTerm(expr1);
-
-    z3::tactic tacticCompound =
-        tacticSimplify
-        & z3::tactic(ctx, "propagate-values")
-        & z3::tactic(ctx, "unit-subsume-simplify")
-        // & z3::tactic(ctx, "aig")
-        // & z3::tactic(ctx, "nnf")
-        & z3::tactic(ctx, "dom-simplify")
-        & z3::tactic(ctx, "ctx-solver-simplify")
-        // & z3::tactic(ctx, "simplify")
-        & tacticSimplify
-    ;
-
-    z3::goal goal2(ctx);
-    goal2.add(expr2);
-    z3::apply_result res2 = tacticCompound(goal2);
-    assert(res2.size() > 0);
-    z3::expr expr3 = res2[0].as_expr();
-
-    // Check that resExpr is equivalent to expr
-    assert(z3Check(expr3 != expr) == z3::unsat);
-    
-    return expr3;
+
+    // Pure boolean premises are canonical as BDDs. Lower the BDD and only flatten it,
+    // skipping the solver-backed tactics.
+    PremiseBdd bdd({expr});
+    if (std::optional<PremiseBdd::Ref> ref = bdd.fromExpr(expr))
+    {
+        if (*ref == PremiseBdd::True || *ref == PremiseBdd::False) return ctx.bool_val(*ref == PremiseBdd::True);
+        z3::params paramsSimplify(ctx);
+        paramsSimplify.set("flat_and_or", true);
+        z3::goal goal(ctx);
+        goal.add(bdd.toExpr(*ref, ctx));
+        z3::apply_result res = with(z3::tactic(ctx, "simplify"), paramsSimplify)(goal);
+        assert(res.size() > 0);
+        return res[0].as_expr();
+    }
+
+    if (PremiseSimplifier * simplifier = ContextRegistry<PremiseSimplifier>::find(ctx))
+    {
+        return simplifier->simplify(expr);
+    }
+    return PremiseSimplifier(ctx).simplify(expr);
 }
 
 std::pair<int, int> parseLnCol(const std::string_view lnCol)
@@ -0,0 +1,386 @@
+// Keeps Hayroll resident over a project and reruns only what an edit affects.
+// Files are watched with inotify. A changed file is reparsed incrementally in the SharedASTStore,
+// and the translation units whose include trees contain it are rerun: Pioneer only if the edit
+// touched a directive, otherwise its artifact is moved past the edit and the run starts at Maki.
+
+#ifndef HAYROLL_WATCHSESSION_HPP
+#define HAYROLL_WATCHSESSION_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include <spdlog/spdlog.h>
+#include "json.hpp"
+
+#include "Util.hpp"
+#include "CompileCommand.hpp"
+#include "TreeSitter.hpp"
+#include "TreeSitterCPreproc.hpp"
+#include "ASTBank.hpp"
+#include "PioneerArtifact.hpp"
+
+namespace Hayroll
+{
+
+class WatchSession
+{
+public:
+    // Runs the pipeline over the given tasks, or all of them, reusing Pioneer artifacts where valid.
+    // The argument is meant for PipelineOptions::tasksToRun, with PipelineOptions::reusePioneer set.
+    using RunPipeline = std::function<int(const std::unordered_set<std::filesystem::path> * tasksToRun)>;
+    // The Pioneer artifact key of a task's options, see Pipeline::pioneerArtifactConfigHash
+    using PioneerConfigHash = std::function<std::uint64_t(const CompileCommand &)>;
+
+    WatchSession
+    (
+        const std::filesystem::path & compileCommandsJsonPath,
+        const std::filesystem::path & outputDir,
+        const std::filesystem::path & projDir,
+        RunPipeline runPipeline,
+        PioneerConfigHash pioneerConfigHash,
+        SharedASTStore & store = SharedASTStore::instance()
+    )
+        : compileCommandsJsonPath(compileCommandsJsonPath), outputDir(outputDir), projDir(projDir),
+          runPipeline(std::move(runPipeline)), pioneerConfigHash(std::move(pioneerConfigHash)), store(store)
+    {
+    }
+
+    // Run everything once, then rerun on every change until interrupted.
+    [[noreturn]] void run()
+    {
+        rebuildAll();
+        Inotify inotify;
+        inotify.watchTree(projDir, outputDir);
+        SPDLOG_INFO("Watching {} for changes", projDir.string());
+        while (true)
+        {
+            const std::unordered_set<std::filesystem::path> changed = inotify.wait();
+            if (changed.contains(compileCommandsJsonPath))
+            {
+                SPDLOG_INFO("{} changed; rebuilding everything", compileCommandsJsonPath.string());
+                rebuildAll();
+                continue;
+            }
+            rebuild(changed);
+        }
+    }
+
+    // Rerun the tasks affected by changes to the given files. Returns the pipeline's exit code.
+    int rebuild(const std::unordered_set<std::filesystem::path> & changed)
+    {
+        const auto begin = std::chrono::steady_clock::now();
+
+        // Reparse the changed files we know of, noting which edits left the directives alone
+        std::unordered_map<std::filesystem::path, std::optional<PioneerArtifact::FileEdit>> edits;
+        for (const std::filesystem::path & changedPath : changed)
+        {
+            std::error_code ec;
+            const std::filesystem::path path = std::filesystem::canonical(changedPath, ec);
+            if (ec || !taskFiles.contains(path)) continue;
+            std::optional<SharedASTStore::Reparse> reparse;
+            try
+            {
+                reparse = store.update(path);
+            }
+            catch (const std::exception & e)
+            {
+                SPDLOG_WARN("Failed to reparse {}: {}", path.string(), e.what());
+                edits.emplace(path, std::nullopt);
+                continue;
+            }
+            if (!reparse) continue;
+            heldFiles[path] = reparse->current;
+            std::optional<PioneerArtifact::FileEdit> edit;
+            if (editsCodeOnly(*reparse))
+            {
+                edit = PioneerArtifact::FileEdit
+                {
+                    PioneerArtifact::fnv1a(reparse->previous->tree.getSource()),
+                    PioneerArtifact::fnv1a(reparse->current->tree.getSource()),
+                    reparse->edit.start_byte,
+                    reparse->edit.old_end_byte,
+                    reparse->edit.new_end_byte
+                };
+            }
+            SPDLOG_INFO("{} changed ({})", path.string(), edit ? "code only" : "directives");
+            edits.emplace(path, edit);
+        }
+        if (edits.empty()) return 0;
+
+        std::unordered_set<std::filesystem::path> tasksToRun;
+        std::size_t pioneerReruns = 0;
+        for (const CompileCommand & command : compileCommands)
+        {
+            const std::unordered_set<std::filesystem::path> & files = filesOfTask[command.file];
+            PioneerArtifact::FileEdits taskEdits;
+            bool affected = false;
+            bool codeOnly = true;
+            for (const auto & [path, edit] : edits)
+            {
+                if (!files.contains(path)) continue;
+                affected = true;
+                if (edit) taskEdits.emplace(path.string(), *edit);
+                else codeOnly = false;
+            }
+            if (!affected) continue;
+            tasksToRun.insert(command.file);
+            if (!codeOnly || !rebasePioneerArtifact(command, taskEdits)) ++pioneerReruns;
+        }
+        if (tasksToRun.empty()) return 0;
+
+        SPDLOG_INFO("Rerunning {} task(s), {} from Pioneer", tasksToRun.size(), pioneerReruns);
+        const int result = runPipeline(&tasksToRun);
+        for (const CompileCommand & command : compileCommands)
+        {
+            if (tasksToRun.contains(command.file)) loadTaskFiles(command);
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        SPDLOG_INFO("Rebuilt {} task(s) in {:.2f} s", tasksToRun.size(), elapsed.count());
+        return result;
+    }
+
+    // Whether an edit only touched C code, so that symbolic execution would give the same result.
+    // The directive nodes of both trees must match one to one in kind, and their tokens in text,
+    // with every token before the edit in place and every token after it shifted by the edit.
+    static bool editsCodeOnly(const SharedASTStore::Reparse & reparse)
+    {
+        const std::vector<TSNode> & before = reparse.previous->index.directiveNodes;
+        const std::vector<TSNode> & after = reparse.current->index.directiveNodes;
+        if (before.size() != after.size()) return false;
+        const ts::TSInputEdit & edit = reparse.edit;
+        const int64_t shift = static_cast<int64_t>(edit.new_end_byte) - static_cast<int64_t>(edit.old_end_byte);
+        for (std::size_t i = 0; i < before.size(); ++i)
+        {
+            const TSNode & previous = before[i];
+            const TSNode & current = after[i];
+            if (previous.symbol() != current.symbol()) return false;
+            // Only tokens have a fixed extent; blocks and conditionals grow and shrink with the code in them
+            if (previous.childCount() != 0 || current.childCount() != 0) continue;
+            if (previous.textView() != current.textView()) return false;
+            int64_t expectedStart = previous.startByte();
+            if (previous.startByte() >= edit.old_end_byte) expectedStart += shift;
+            else if (previous.endByte() > edit.start_byte) return false; // The edit is inside the token
+            if (current.startByte() != expectedStart) return false;
+        }
+        return true;
+    }
+
+private:
+    // An inotify instance watching a directory tree, including directories created later
+    class Inotify
+    {
+    public:
+        Inotify()
+            : fd(inotify_init1(IN_CLOEXEC))
+        {
+            if (fd < 0) throw std::runtime_error("Failed to initialize inotify");
+        }
+
+        Inotify(const Inotify &) = delete;
+        Inotify & operator=(const Inotify &) = delete;
+
+        ~Inotify()
+        {
+            ::close(fd);
+        }
+
+        // Watch a directory and everything below it, except the excluded directory and hidden ones
+        void watchTree(const std::filesystem::path & root, const std::filesystem::path & excluded)
+        {
+            this->excluded = excluded;
+            watchDir(root);
+            std::error_code ec;
+            for (auto it = std::filesystem::recursive_directory_iterator(root, ec); it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+            {
+                if (ec) break;
+                if (!it->is_directory(ec)) continue;
+                if (isExcluded(it->path()))
+                {
+                    it.disable_recursion_pending();
+                    continue;
+                }
+                watchDir(it->path());
+            }
+        }
+
+        // Block until files are written, then collect changes until things are quiet for a moment.
+        // Editors that save by renaming a temporary file over the original are covered by IN_MOVED_TO.
+        std::unordered_set<std::filesystem::path> wait(std::chrono::milliseconds quiet = std::chrono::milliseconds(150))
+        {
+            std::unordered_set<std::filesystem::path> changed;
+            int timeout = -1;
+            while (true)
+            {
+                pollfd pfd{fd, POLLIN, 0};
+                const int ready = ::poll(&pfd, 1, timeout);
+                if (ready < 0 && errno == EINTR) continue;
+                if (ready < 0) throw std::runtime_error("Failed to poll inotify");
+                if (ready == 0) return changed;
+                read(changed);
+                if (!changed.empty()) timeout = static_cast<int>(quiet.count());
+            }
+        }
+
+    private:
+        int fd;
+        std::filesystem::path excluded;
+        std::unordered_map<int, std::filesystem::path> dirs;
+
+        bool isExcluded(const std::filesystem::path & dir) const
+        {
+            return dir == excluded || dir.filename().string().starts_with(".");
+        }
+
+        void watchDir(const std::filesystem::path & dir)
+        {
+            const int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+            if (wd < 0)
+            {
+                SPDLOG_WARN("Cannot watch {}", dir.string());
+                return;
+            }
+            dirs[wd] = dir;
+        }
+
+        void read(std::unordered_set<std::filesystem::path> & changed)
+        {
+            alignas(inotify_event) char buffer[64 * 1024];
+            const ssize_t length = ::read(fd, buffer, sizeof(buffer));
+            if (length <= 0) return;
+            for (ssize_t offset = 0; offset < length; )
+            {
+                const inotify_event * event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+                auto it = dirs.find(event->wd);
+                if (it == dirs.end() || event->len == 0) continue;
+                const std::filesystem::path path = it->second / event->name;
+                if (event->mask & IN_ISDIR)
+                {
+                    if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && !isExcluded(path)) watchTree(path, excluded);
+                    continue;
+                }
+                if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) changed.insert(path);
+            }
+        }
+    };
+
+    std::filesystem::path compileCommandsJsonPath;
+    std::filesystem::path outputDir;
+    std::filesystem::path projDir;
+    RunPipeline runPipeline;
+    PioneerConfigHash pioneerConfigHash;
+    SharedASTStore & store;
+
+    std::vector<CompileCommand> compileCommands;
+    // Files in the include tree of each task, by canonical path
+    std::unordered_map<std::filesystem::path, std::unordered_set<std::filesystem::path>> filesOfTask;
+    // How many tasks include each file
+    std::unordered_map<std::filesystem::path, std::size_t> taskFiles;
+    // The trees of taskFiles, held so that the store keeps them to reparse edits incrementally from
+    std::unordered_map<std::filesystem::path, SharedASTStore::ParsedFilePtr> heldFiles;
+
+    void rebuildAll()
+    {
+        const std::string compileCommandsJsonStr = loadFileToString(compileCommandsJsonPath);
+        compileCommands = CompileCommand::fromCompileCommandsJson(nlohmann::json::parse(compileCommandsJsonStr));
+        filesOfTask.clear();
+        taskFiles.clear();
+        heldFiles.clear();
+        runPipeline(nullptr);
+        for (const CompileCommand & command : compileCommands) loadTaskFiles(command);
+    }
+
+    std::filesystem::path pioneerArtifactPath(const CompileCommand & command) const
+    {
+        return command.withSanitizedPaths(projDir)
+            .withUpdatedFilePathPrefix(outputDir / "src", projDir)
+            .withUpdatedFileExtension(".pioneer")
+            .file;
+    }
+
+    // Learn which files a task depends on from its Pioneer artifact, and hold their trees.
+    // Trees still held by the store are not parsed again.
+    void loadTaskFiles(const CompileCommand & command)
+    {
+        std::unordered_set<std::filesystem::path> & files = filesOfTask[command.file];
+        for (const std::filesystem::path & path : files)
+        {
+            if (--taskFiles[path] == 0)
+            {
+                taskFiles.erase(path);
+                heldFiles.erase(path);
+            }
+        }
+        files.clear();
+        std::optional<PioneerArtifact> artifact;
+        try
+        {
+            const std::filesystem::path artifactPath = pioneerArtifactPath(command);
+            if (std::filesystem::exists(artifactPath))
+            {
+                artifact = PioneerArtifact::deserialize(loadFileToString(artifactPath), pioneerConfigHash(command));
+            }
+        }
+        catch (const std::exception & e)
+        {
+            SPDLOG_WARN("Cannot read Pioneer artifact of {}: {}", command.file.string(), e.what());
+        }
+        if (artifact)
+        {
+            for (const IncludeTreePtr & tree : *artifact->includeTree)
+            {
+                if (std::filesystem::is_regular_file(tree->path)) files.insert(store.canonical(tree->path));
+            }
+        }
+        // Without an artifact, at least the main file triggers a rerun
+        files.insert(store.canonical(command.file));
+        for (const std::filesystem::path & path : files)
+        {
+            ++taskFiles[path];
+            if (heldFiles.contains(path)) continue;
+            try
+            {
+                heldFiles.emplace(path, store.addFileOrFind(path));
+            }
+            catch (const std::exception & e)
+            {
+                SPDLOG_WARN("Cannot parse {}: {}", path.string(), e.what());
+            }
+        }
+    }
+
+    // Move a task's Pioneer artifact past code-only edits, so the next run loads it instead of running Pioneer.
+    // Returns false if the artifact cannot be moved, in which case the run falls back to Pioneer.
+    bool rebasePioneerArtifact(const CompileCommand & command, const PioneerArtifact::FileEdits & edits)
+    {
+        const std::filesystem::path artifactPath = pioneerArtifactPath(command);
+        const std::uint64_t configHash = pioneerConfigHash(command);
+        try
+        {
+            if (!std::filesystem::exists(artifactPath)) return false;
+            std::optional<PioneerArtifact> artifact = PioneerArtifact::deserialize(loadFileToString(artifactPath), configHash, edits);
+            if (!artifact) return false;
+            saveStringToFile(PioneerArtifact::serialize(artifact->includeTree.get(), *artifact->premiseTree, configHash), artifactPath);
+            return true;
+        }
+        catch (const std::exception & e)
+        {
+            SPDLOG_DEBUG("Cannot move Pioneer artifact of {} past the edit: {}", command.file.string(), e.what());
+            return false;
+        }
+    }
+};
+
+} // namespace Hayroll
+
+#endif // HAYROLL_WATCHSESSION_HPP
@@ -0,0 +1,152 @@
+// Worker pool that checks the satisfiability of batches of z3 expressions in parallel.
+// z3 contexts are not thread-safe, so each worker owns a private context.
+// Expressions are translated into the worker contexts on the calling thread (fork),
+// and only the check results travel back (join), so the caller's context is never shared.
+
+#ifndef HAYROLL_Z3CHECKPOOL_HPP
+#define HAYROLL_Z3CHECKPOOL_HPP
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <cassert>
+
+#include <z3++.h>
+
+#include <spdlog/spdlog.h>
+
+namespace Hayroll
+{
+
+class Z3CheckPool
+{
+public:
+    explicit Z3CheckPool(std::size_t numWorkers)
+    {
+        assert(numWorkers > 0);
+        workers.reserve(numWorkers);
+        for (std::size_t i = 0; i < numWorkers; ++i)
+        {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (std::unique_ptr<Worker> & worker : workers)
+        {
+            worker->thread = std::thread([this, w = worker.get()]() { workerLoop(*w); });
+        }
+    }
+
+    Z3CheckPool(const Z3CheckPool &) = delete;
+    Z3CheckPool & operator=(const Z3CheckPool &) = delete;
+
+    ~Z3CheckPool()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+        for (std::unique_ptr<Worker> & worker : workers)
+        {
+            worker->thread.join();
+        }
+    }
+
+    std::size_t size() const
+    {
+        return workers.size();
+    }
+
+    // Check every expression. Results are returned in input order regardless of scheduling,
+    // so callers observe exactly what a serial z3Check loop would produce.
+    std::vector<z3::check_result> checkAll(const std::vector<z3::expr> & exprs)
+    {
+        std::vector<z3::check_result> results(exprs.size(), z3::unknown);
+        if (exprs.empty()) return results;
+
+        // Fork: round-robin the expressions, translated into each worker's own context.
+        // Workers are idle here, so touching their contexts from this thread is safe.
+        for (std::size_t i = 0; i < exprs.size(); ++i)
+        {
+            Worker & worker = *workers[i % workers.size()];
+            z3::expr translated(worker.ctx, Z3_translate(exprs[i].ctx(), exprs[i], worker.ctx));
+            worker.batch.emplace_back(i, std::move(translated));
+        }
+
+        {
+            std::unique_lock lock(mutex);
+            this->results = &results;
+            pendingWorkers = workers.size();
+            ++generation;
+            workAvailable.notify_all();
+            // Join: wait until every worker has drained its batch.
+            batchDone.wait(lock, [this]() { return pendingWorkers == 0; });
+            this->results = nullptr;
+        }
+
+        // An undecided query may still be satisfiable, so it is reported as sat, as z3CheckContradiction does;
+        // reporting it as unsat would prune a feasible branch.
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            if (results[i] != z3::unknown) continue;
+            SPDLOG_WARN("z3 could not decide {}, treating it as satisfiable.", exprs[i].to_string());
+            results[i] = z3::sat;
+        }
+        return results;
+    }
+
+private:
+    struct Worker
+    {
+        z3::context ctx;
+        // Declared after ctx so the translated expressions die before their context.
+        std::vector<std::pair<std::size_t, z3::expr>> batch;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable batchDone;
+    std::size_t generation = 0;
+    std::size_t pendingWorkers = 0;
+    std::vector<z3::check_result> * results = nullptr;
+    bool stopping = false;
+
+    void workerLoop(Worker & worker)
+    {
+        std::size_t seenGeneration = 0;
+        while (true)
+        {
+            std::vector<z3::check_result> * out = nullptr;
+            {
+                std::unique_lock lock(mutex);
+                workAvailable.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+                if (stopping) return;
+                seenGeneration = generation;
+                out = results;
+            }
+
+            for (auto & [index, expr] : worker.batch)
+            {
+                z3::solver solver(worker.ctx);
+                solver.add(expr);
+                // Each worker writes disjoint indices, no locking needed.
+                (*out)[index] = solver.check();
+            }
+            worker.batch.clear();
+
+            {
+                std::lock_guard lock(mutex);
+                --pendingWorkers;
+            }
+            batchDone.notify_one();
+        }
+    }
+};
+
+} // namespace Hayroll
+
+#endif // HAYROLL_Z3CHECKPOOL_HPP
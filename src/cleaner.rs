@@ -6,26 +6,34 @@ use tracing::error;
 fn main() -> Result<()> {
     let args: Vec<String> = env::args().collect();
     let mut keep_src_loc = false;
+    let mut tag_table_arg: Option<String> = None;
     let mut workspace_arg: Option<String> = None;
 
-    for arg in args.iter().skip(1) {
+    let mut arg_iter = args.iter().skip(1);
+    while let Some(arg) = arg_iter.next() {
         if arg == "--keep-src-loc" {
             keep_src_loc = true;
+        } else if arg == "--tag-table" {
+            tag_table_arg = arg_iter.next().cloned();
         } else if workspace_arg.is_none() {
             workspace_arg = Some(arg.clone());
         } else {
-            error!(usage = %format!("Usage: {} <workspace-path> [--keep-src-loc]", args[0]));
+            error!(usage = %format!("Usage: {} <workspace-path> [--keep-src-loc] [--tag-table <path>]", args[0]));
             std::process::exit(1);
         }
     }
 
     if workspace_arg.is_none() {
-        error!(usage = %format!("Usage: {} <workspace-path> [--keep-src-loc]", args[0]));
+        error!(usage = %format!("Usage: {} <workspace-path> [--keep-src-loc] [--tag-table <path>]", args[0]));
         std::process::exit(1);
     }
 
     util::init_logging();
 
+    if let Some(tag_table_path) = tag_table_arg.as_ref() {
+        util::load_hayroll_tag_table(Path::new(tag_table_path))?;
+    }
+
     let workspace_path = Path::new(workspace_arg.as_ref().unwrap());
     cleaner_core::run(workspace_path, keep_src_loc)
 }
@@ -174,6 +174,7 @@ impl<T: HasHayrollTag> HayrollMeta for T {
     }
     fn with_appended_merged_variants(&self, new_variant: &str) -> ast::Literal {
         // Clone and update mergedVariants
+        // Rewritten tags are always inline JSON, even if the original was a compact id
         let mut new_tag = self.hayroll_tag().tag.clone();
         let mut merged_variants = self.merged_variants();
         merged_variants.push(new_variant.to_string());
@@ -1372,24 +1373,28 @@ pub fn extract_hayroll_seeds_from_syntax_roots_impl(
         .filter_map(|(element, file_id)| {
             if let Some(token) = element.clone().into_token() {
                 if let Some(byte_str) = ast::ByteString::cast(token) {
-                    // Try to parse into serde_json::Value, if it fails, it's not a JSON string
+                    // Resolve compact ids or parse inline JSON; anything else is not a hayroll tag
                     let content = match byte_str.value() {
                         Ok(cow) => String::from_utf8_lossy(&cow).to_string(),
                         Err(_) => return None,
                     };
                     // Delete the last \0 byte
                     let content = content.trim_end_matches(char::from(0));
-                    let tag_res = serde_json::from_str::<serde_json::Value>(&content);
-                    trace!(byte_string = %content, tag = ?tag_res, "Byte String parsed");
-                    if let Ok(tag) = tag_res {
-                        if tag["hayroll"] == true {
-                            let tag = HayrollTag {
-                                literal: ast::Literal::cast(element.parent()?)?,
-                                tag,
-                                file_id: file_id.clone(),
-                            };
-                            return Some(tag);
+                    let tag_res = match parse_hayroll_tag(content) {
+                        Ok(tag_res) => tag_res,
+                        Err(e) => {
+                            error!(byte_string = %content, "{}", e);
+                            return None;
                         }
+                    };
+                    trace!(byte_string = %content, tag = ?tag_res, "Byte String parsed");
+                    if let Some(tag) = tag_res {
+                        let tag = HayrollTag {
+                            literal: ast::Literal::cast(element.parent()?)?,
+                            tag,
+                            file_id: file_id.clone(),
+                        };
+                        return Some(tag);
                     }
                 }
             }
@@ -6,29 +6,37 @@ use tracing::error;
 fn main() -> Result<()> {
     let args: Vec<String> = env::args().collect();
     let mut keep_src_loc = false;
+    let mut tag_table_arg: Option<String> = None;
     let mut base_arg: Option<String> = None;
     let mut patch_arg: Option<String> = None;
 
-    for arg in args.iter().skip(1) {
+    let mut arg_iter = args.iter().skip(1);
+    while let Some(arg) = arg_iter.next() {
         if arg == "--keep-src-loc" {
             keep_src_loc = true;
+        } else if arg == "--tag-table" {
+            tag_table_arg = arg_iter.next().cloned();
         } else if base_arg.is_none() {
             base_arg = Some(arg.clone());
         } else if patch_arg.is_none() {
             patch_arg = Some(arg.clone());
         } else {
-            error!(usage = %format!("Usage: {} <base-workspace-path> <patch-workspace-path> [--keep-src-loc]", args[0]));
+            error!(usage = %format!("Usage: {} <base-workspace-path> <patch-workspace-path> [--keep-src-loc] [--tag-table <path>]", args[0]));
             std::process::exit(1);
         }
     }
 
     if base_arg.is_none() || patch_arg.is_none() {
-        error!(usage = %format!("Usage: {} <base-workspace-path> <patch-workspace-path> [--keep-src-loc]", args[0]));
+        error!(usage = %format!("Usage: {} <base-workspace-path> <patch-workspace-path> [--keep-src-loc] [--tag-table <path>]", args[0]));
         std::process::exit(1);
     }
 
     util::init_logging();
 
+    if let Some(tag_table_path) = tag_table_arg.as_ref() {
+        util::load_hayroll_tag_table(Path::new(tag_table_path))?;
+    }
+
     let base_workspace_path = Path::new(base_arg.as_ref().unwrap());
     let patch_workspace_path = Path::new(patch_arg.as_ref().unwrap());
     merger_core::run(base_workspace_path, patch_workspace_path, keep_src_loc)
@@ -1,4 +1,6 @@
 use std::collections::{HashMap, HashSet};
+use std::path::Path;
+use std::sync::OnceLock;
 
 use hir::Semantics;
 use ide_db::{
@@ -6,6 +8,7 @@ use ide_db::{
     source_change::SourceChangeBuilder,
     EditionedFileId,
 };
+use tracing::error;
 use tracing_subscriber::{fmt, prelude::*, EnvFilter};
 
 use ide::{Edition, RootDatabase};
@@ -313,23 +316,112 @@ pub fn collect_syntax_roots_from_sema(sema: &Semantics<'_, RootDatabase>) -> Has
     out
 }
 
+// Compact tags emitted by Seeder look like "<prefix><id>", and their payloads live in a side-table.
+// The prefix ("HR#<salt>#") is derived from the seeded code, so no string literal in that code spells it,
+// and is recorded on the first line of the side-table.
+pub struct HayrollTagTable {
+    prefix: String,
+    tags: HashMap<u64, serde_json::Value>,
+}
+
+impl HayrollTagTable {
+    // Parse a side-table: a {"prefix": <prefix>} line, then JSON lines of {"id": <id>, "tag": <payload>}
+    pub fn from_json_lines(content: &str) -> anyhow::Result<Self> {
+        let mut lines = content.lines().filter(|line| !line.trim().is_empty());
+        let header = lines
+            .next()
+            .ok_or_else(|| anyhow::anyhow!("Tag table without prefix line"))?;
+        let prefix = serde_json::from_str::<serde_json::Value>(header)?["prefix"]
+            .as_str()
+            .ok_or_else(|| anyhow::anyhow!("Tag table without prefix: {}", header))?
+            .to_string();
+        let mut tags = HashMap::new();
+        for line in lines {
+            let mut entry = serde_json::from_str::<serde_json::Value>(line)?;
+            let id = entry["id"]
+                .as_u64()
+                .ok_or_else(|| anyhow::anyhow!("Tag table entry without id: {}", line))?;
+            tags.insert(id, entry["tag"].take());
+        }
+        Ok(HayrollTagTable { prefix, tags })
+    }
+
+    // The payload of a compact tag of this table, or None if the content is not one.
+    // A well-formed compact tag whose id is missing from the table is an error.
+    pub fn resolve(&self, content: &str) -> anyhow::Result<Option<serde_json::Value>> {
+        let Some(id) = content.strip_prefix(self.prefix.as_str()) else {
+            return Ok(None);
+        };
+        let Ok(id) = id.parse::<u64>() else {
+            return Ok(None);
+        };
+        match self.tags.get(&id) {
+            Some(tag) => Ok(Some(tag.clone())),
+            None => Err(anyhow::anyhow!("Hayroll tag id {} not found in tag table", id)),
+        }
+    }
+}
+
+static HAYROLL_TAG_TABLE: OnceLock<HayrollTagTable> = OnceLock::new();
+
+// Load the side-table once per process
+pub fn load_hayroll_tag_table(path: &Path) -> anyhow::Result<()> {
+    let content = std::fs::read_to_string(path)?;
+    HAYROLL_TAG_TABLE
+        .set(HayrollTagTable::from_json_lines(&content)?)
+        .map_err(|_| anyhow::anyhow!("Tag table already loaded"))
+}
+
+// Decode the content of a byte string into a hayroll tag payload.
+// Accepts compact ids of the loaded side-table, if any, and inline JSON.
+pub fn parse_hayroll_tag(content: &str) -> anyhow::Result<Option<serde_json::Value>> {
+    if let Some(table) = HAYROLL_TAG_TABLE.get() {
+        if let Some(tag) = table.resolve(content)? {
+            return Ok(Some(tag));
+        }
+    }
+    Ok(parse_inline_hayroll_tag(content))
+}
+
+fn parse_inline_hayroll_tag(content: &str) -> Option<serde_json::Value> {
+    // Cheap pre-check before parsing: inline tags are JSON objects
+    if !content.starts_with('{') {
+        return None;
+    }
+    let val = serde_json::from_str::<serde_json::Value>(content).ok()?;
+    if val.get("hayroll").and_then(|v| v.as_bool()) == Some(true) {
+        Some(val)
+    } else {
+        None
+    }
+}
+
+fn byte_string_is_hayroll_tag(byte_str: &ast::ByteString) -> bool {
+    let content = match byte_str.value() {
+        Ok(cow) => String::from_utf8_lossy(&cow).to_string(),
+        Err(_) => return false,
+    };
+    let content = content.trim_end_matches(char::from(0));
+    match parse_hayroll_tag(content) {
+        Ok(tag) => tag.is_some(),
+        Err(e) => {
+            error!(byte_string = %content, "{}", e);
+            false
+        }
+    }
+}
+
 pub fn stmt_is_hayroll_tag(stmt: &ast::Stmt) -> bool {
     // Strategy: look for any byte string literal inside the stmt whose decoded contents
-    // parse as JSON and contain { "hayroll": true }.
+    // is a hayroll tag, either a compact id or JSON containing { "hayroll": true }.
     // This matches instrumentation like:
     // *(b"{\"astKind\":\"Stmts\",... ,\"hayroll\":true,...}\0" as *const u8 as *const libc::c_char);
+    // *(b"HR#12\0" as *const u8 as *const libc::c_char);
     for element in stmt.syntax().descendants_with_tokens() {
         if let Some(token) = element.clone().into_token() {
             if let Some(byte_str) = ast::ByteString::cast(token) {
-                let content = match byte_str.value() {
-                    Ok(cow) => String::from_utf8_lossy(&cow).to_string(),
-                    Err(_) => continue,
-                };
-                let content = content.trim_end_matches(char::from(0));
-                if let Ok(val) = serde_json::from_str::<serde_json::Value>(&content) {
-                    if val.get("hayroll").and_then(|v| v.as_bool()) == Some(true) {
-                        return true;
-                    }
+                if byte_string_is_hayroll_tag(&byte_str) {
+                    return true;
                 }
             }
         }
@@ -357,15 +449,8 @@ pub fn item_is_hayroll_tag(item: &ast::Item) -> bool {
     for element in st.syntax().descendants_with_tokens() {
         if let Some(token) = element.clone().into_token() {
             if let Some(byte_str) = ast::ByteString::cast(token) {
-                let content = match byte_str.value() {
-                    Ok(cow) => String::from_utf8_lossy(&cow).to_string(),
-                    Err(_) => continue,
-                };
-                let content = content.trim_end_matches(char::from(0));
-                if let Ok(val) = serde_json::from_str::<serde_json::Value>(&content) {
-                    if val.get("hayroll").and_then(|v| v.as_bool()) == Some(true) {
-                        return true;
-                    }
+                if byte_string_is_hayroll_tag(&byte_str) {
+                    return true;
                 }
             }
         }
@@ -543,3 +628,31 @@ pub fn apply_source_change(db: &mut RootDatabase, source_change: &ide::SourceCha
         db.set_file_text(*file_id, &code);
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const TAG_TABLE: &str = concat!(
+        "{\"prefix\":\"HR#00000000000000ab#\"}\n",
+        "{\"id\":0,\"tag\":{\"hayroll\":true,\"astKind\":\"Expr\"}}\n",
+        "{\"id\":1,\"tag\":{\"hayroll\":true,\"astKind\":\"Stmts\"}}\n",
+    );
+
+    #[test]
+    fn compact_tags_round_trip() {
+        let table = HayrollTagTable::from_json_lines(TAG_TABLE).unwrap();
+        let tag = table.resolve("HR#00000000000000ab#1").unwrap().unwrap();
+        assert_eq!(tag["astKind"], "Stmts");
+        assert!(table.resolve("HR#00000000000000ab#7").is_err());
+    }
+
+    #[test]
+    fn user_literals_are_not_tags() {
+        let table = HayrollTagTable::from_json_lines(TAG_TABLE).unwrap();
+        assert!(table.resolve("HR#1").unwrap().is_none());
+        assert!(table.resolve("HR#00000000000000ab#x").unwrap().is_none());
+        assert!(parse_hayroll_tag("HR#1").unwrap().is_none());
+        assert!(parse_hayroll_tag("{\"hayroll\":false}").unwrap().is_none());
+    }
+}
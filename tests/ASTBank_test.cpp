@@ -1,4 +1,7 @@
 #include <iostream>
+#include <deque>
+#include <thread>
+#include <vector>
 
 #include "ASTBank.hpp"
 #include "IncludeTree.hpp"
@@ -26,8 +29,8 @@ int main(int argc, char **argv)
         << "#eval 1 + 2 - 3 * 4 / 5 \n #endeval" << std::endl;
     srcFile.close();
 
-    IncludeTreePtr includeRoot = IncludeTree::make(TSNode{}, srcPath);
-    IncludeTreePtr includeNode = includeRoot;
+    IncludeTreeRootPtr includeRoot = IncludeTree::make(TSNode{}, srcPath);
+    IncludeTreePtr includeNode = includeRoot.get();
 
     // (isSystemInclude, includeName)
     std::vector<std::pair<bool, std::string>> includes =
@@ -54,19 +57,33 @@ int main(int argc, char **argv)
         auto ancestorDirs = includeNode->getAncestorDirs();
         auto includePath = *resolver.resolveInclude(isSystemInclude, includeName, ancestorDirs);
         std::cout << "Resolved include path: " << includePath << std::endl;
-        includeNode->addChild(TSNode{}, includePath);
-        includeNode = includeNode->children[TSNode{}];
+        includeNode = includeNode->addChild(TSNode{}, includePath);
         astBank.addFileOrFind(includePath);
     }
 
     // Go from the last node to the root (excluding the root), printing the included files
-    for (IncludeTreePtr it = includeNode; it; it = it->parent.lock())
+    for (IncludeTreePtr it = includeNode; it; it = it->parent)
     {
         std::cout << "Included file: " << it->path << std::endl;
         std::cout << std::flush;
         const TSTree & ast = astBank.find(it->path);
         TSNode root = ast.rootNode();
         std::cout << root.sExpression() << std::endl;
+
+        // The directive index must agree with a full walk of the tree
+        const DirectiveIndex & index = astBank.index(root);
+        std::size_t conditionals = 0;
+        std::size_t includes = 0;
+        for (TSNode node : root.iterateDescendants())
+        {
+            if (node.isSymbol(lang.preproc_if_s) || node.isSymbol(lang.preproc_ifdef_s) || node.isSymbol(lang.preproc_ifndef_s)) ++conditionals;
+            if (node.isSymbol(lang.preproc_include_s) || node.isSymbol(lang.preproc_include_next_s)) ++includes;
+        }
+        if (index.conditionals.size() != conditionals || index.includes.size() != includes)
+        {
+            std::cerr << "Directive index mismatch for " << it->path << std::endl;
+            return 1;
+        }
         for (TSNode node : root.iterateChildren())
         {
             if (node.isSymbol(lang.preproc_ifndef_s))
@@ -97,5 +114,82 @@ int main(int argc, char **argv)
 
     std::cout << includeRoot->toString() << std::endl;
 
+    // Banks share one parse of each file, even when they add it concurrently
+    SharedASTStore store;
+    std::vector<const TSTree *> trees(8);
+    std::deque<ASTBank> concurrentBanks;
+    for (std::size_t i = 0; i < trees.size(); ++i) concurrentBanks.emplace_back(lang, store);
+    {
+        std::vector<std::jthread> threads;
+        for (std::size_t i = 0; i < trees.size(); ++i)
+        {
+            threads.emplace_back
+            (
+                [&, i]()
+                {
+                    trees[i] = &concurrentBanks[i].addFileOrFind(srcPath);
+                }
+            );
+        }
+    }
+    ASTBank bankA(lang, store);
+    ASTBank bankB(lang, store);
+    if (&bankA.addFileOrFind(srcPath) != &bankB.addFileOrFind(tmpPath / "." / "test.c") || store.parses() != 1)
+    {
+        std::cerr << "Shared store parsed " << store.parses() << " times" << std::endl;
+        return 1;
+    }
+    for (const TSTree * tree : trees)
+    {
+        if (tree != &bankA.find(srcPath))
+        {
+            std::cerr << "Concurrent banks got different trees" << std::endl;
+            return 1;
+        }
+    }
+
+    // An edited file is parsed again; banks holding the old tree keep it
+    std::ofstream editedFile(srcPath, std::ios::app);
+    editedFile << "#define EDITED 1" << std::endl;
+    editedFile.close();
+    std::filesystem::last_write_time(srcPath, std::filesystem::last_write_time(srcPath) + std::chrono::seconds(1));
+    ASTBank bankC(lang, store);
+    if (bankC.addFileOrFind(srcPath).getSource() == bankA.find(srcPath).getSource() || store.parses() != 2)
+    {
+        std::cerr << "Edited file was not parsed again" << std::endl;
+        return 1;
+    }
+
+    // The store drops a file once no bank holds it, and parses it again when it is next added
+    {
+        std::filesystem::path evictedPath = tmpPath / "evicted.h";
+        std::ofstream evictedFile(evictedPath);
+        evictedFile << "#define EVICTED 1" << std::endl;
+        evictedFile.close();
+        const std::size_t residentBefore = store.resident();
+        {
+            ASTBank bank(lang, store);
+            bank.addFileOrFind(evictedPath);
+            if (store.resident() != residentBefore + 1)
+            {
+                std::cerr << "Added file is not resident" << std::endl;
+                return 1;
+            }
+        }
+        const std::size_t parsesBefore = store.parses();
+        if (store.resident() != residentBefore)
+        {
+            std::cerr << "File no bank holds is still resident" << std::endl;
+            return 1;
+        }
+        ASTBank bank(lang, store);
+        bank.addFileOrFind(evictedPath);
+        if (store.parses() != parsesBefore + 1)
+        {
+            std::cerr << "Evicted file was not parsed again" << std::endl;
+            return 1;
+        }
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -37,8 +37,8 @@ int main(int argc, char **argv)
             "#endif\n";
     srcFile.close();
 
-    auto root = IncludeTree::make(TSNode{}, srcPath);
-    auto node = root;
+    IncludeTreeRootPtr root = IncludeTree::make(TSNode{}, srcPath);
+    IncludeTreePtr node = root.get();
 
     // (isSystemInclude, includeName)
     std::vector<std::pair<bool, std::string>> includes =
@@ -66,8 +66,13 @@ int main(int argc, char **argv)
         }
         auto includePath = *resolver.resolveInclude(isSystemInclude, includeName, ancestorDirs);
         std::cout << "Resolved include path: " << includePath << std::endl;
-        node->addChild(TSNode{}, includePath);
-        node = node->children[TSNode{}];
+        IncludeTreePtr child = node->addChild(TSNode{}, includePath);
+        if (node->child(TSNode{}) != child || child->getAncestorDirs().size() != node->getAncestorDirs().size() + 1)
+        {
+            std::cerr << "Child of " << node->path << " not found by its include node" << std::endl;
+            return 1;
+        }
+        node = child;
     }
 
     std::cout << root->toString() << std::endl;
@@ -88,7 +88,7 @@ int main(int argc, char **argv)
 
         Warp endWarp = executor.run();
         PremiseTree * premiseTree = executor.scribe.borrowTree();
-        IncludeTreePtr includeTree = executor.includeTree;
+        IncludeTreePtr includeTree = executor.includeTree.get();
         const CPreproc & lang = executor.lang;
 
         premiseTree->refine();
@@ -2,6 +2,7 @@
 #include <filesystem>
 #include <fstream>
 #include <format>
+#include <chrono>
 
 #include <z3++.h>
 
@@ -21,7 +22,8 @@ int main(int argc, char **argv)
 
     spdlog::set_level(spdlog::level::debug);
 
-    IncludeTreePtr includeTree = IncludeTree::make(TSNode{}, "<built-in>");
+    IncludeTreeRootPtr includeTreeRoot = IncludeTree::make(TSNode{}, "<built-in>");
+    IncludeTreePtr includeTree = includeTreeRoot.get();
     SymbolTablePtr symbolTable = SymbolTable::make();
 
     TempDir tmpDir;
@@ -130,6 +132,20 @@ int main(int argc, char **argv)
                 { "T Y Z (1))", "T ( ( 1 + 1 ) + ( 1 + 1 ) )" },
             },
         },
+        {
+            // W's expansion ends in a function-like macro name, so it depends on what follows it
+            // and must not be replayed from the memo as is
+            {
+                "#define F(x) (x + 1)",
+                "#define W 2 * F",
+            },
+            {
+                { "W(3)", "2 * ( 3 + 1 )" },
+                { "W + 1", "2 * F + 1" },
+                { "W(1) + W", "2 * ( 1 + 1 ) + 2 * F" },
+                { "W", "2 * F" },
+            },
+        },
         {
             {
                 "#define G(a, b) a + b",
@@ -207,6 +223,8 @@ int main(int argc, char **argv)
     size_t trialId = 0;
     bool allPassed = true;
     bool lastWasIf = true;
+    // Conditions that expand without error, replayed by the throughput benchmark below
+    std::vector<std::tuple<std::vector<TSNode>, ConstSymbolTablePtr, std::vector<PreprocToken>>> benchCases;
     
     // There are only preproc_def, preproc_function_def, preproc_undef and preproc_if nodes
     // Seeing a def or undef, add to the symbol table
@@ -263,7 +281,7 @@ int main(int argc, char **argv)
             std::vector<TSNode> conditionTokens = lang.tokensToTokenVector(condition);
 
             bool isError = false;
-            std::vector<Hayroll::TSNode> expanded;
+            std::vector<PreprocToken> expanded;
             try
             {
                 expanded = expander.expandPreprocTokens(conditionTokens, symbolTable);
@@ -280,10 +298,11 @@ int main(int argc, char **argv)
             }
             else
             {
-                for (const TSNode & token : expanded)
+                for (const PreprocToken & token : expanded)
                 {
-                    expandedStr += token.text() + " ";
+                    expandedStr += std::string(expander.tokenText(token)) + " ";
                 }
+                benchCases.emplace_back(conditionTokens, symbolTable, expanded);
                 // Remove trailing space
                 if (!expandedStr.empty())
                 {
@@ -308,6 +327,13 @@ int main(int argc, char **argv)
                         z3::expr expr = expander.int2bool(expander.symbolizeExpression(exprNode));
                         expr = simplifyOrOfAnd(expr);
                         std::cout << std::format("Symbolized: \n{}\n", expr.to_string()) << std::endl;
+
+                        // The token parser must agree with the tree-sitter round trip
+                        z3::expr direct = expander.symbolizeExpandedToBoolExpr(expanded);
+                        z3::expr reparsed = expander.symbolizeExpandedToBoolExprReparsed(expanded);
+                        bool agree = z3CheckTautology(direct == reparsed);
+                        std::cout << std::format("{} token parser agrees with tree-sitter\n", agree ? "OK" : "FAIL");
+                        if (!agree) allPassed = false;
                     }
                 }
                 catch (const std::runtime_error & e)
@@ -327,6 +353,195 @@ int main(int argc, char **argv)
         else assert(false);
     }
 
+    // In the 64-bit bit-vector encoding, unsigned operands switch operators to uintmax_t semantics
+    {
+        MacroExpander bvExpander(lang, &ctx, IntEncoding::BitVector64);
+        const std::vector<std::pair<std::string, bool>> bvBenches =
+        {
+            {"-1 < 0", true},
+            {"-1 < 0u", false},
+            {"-1 >> 63 == -1", true},
+            {"-1u >> 63 == 1", true},
+            {"0xFFFFFFFFFFFFFFFF > 0", true},
+            {"(1 << 40) != 0", true},
+            {"-7 / 2 == -3", true},
+        };
+        for (const auto & [bench, expected] : bvBenches)
+        {
+            auto [exprTree, exprNode] = bvExpander.parseIntoExpression(bench);
+            z3::expr expr = bvExpander.int2bool(bvExpander.symbolizeExpression(exprNode));
+            bool pass = expected ? z3CheckTautology(expr) : z3CheckContradiction(expr);
+            std::cout << std::format("{} bv64: {} is {}\n", pass ? "OK" : "FAIL", bench, expected ? "true" : "false");
+            if (!pass) allPassed = false;
+
+            auto [tokensTree, tokensNode] = bvExpander.parseIntoPreprocTokens(bench);
+            std::vector<TSNode> tokens = lang.tokensToTokenVector(tokensNode);
+            bool agree = z3CheckTautology(bvExpander.symbolizeExpandedToBoolExpr(bvExpander.internTokens(tokens)) == expr);
+            std::cout << std::format("{} bv64 token parser: {}\n", agree ? "OK" : "FAIL", bench);
+            if (!agree) allPassed = false;
+        }
+    }
+
+    // The concrete fast path decides every condition exactly as symbolization does, in either encoding
+    for (IntEncoding encoding : {IntEncoding::Int, IntEncoding::BitVector64})
+    {
+        MacroExpander encodedExpander(lang, &ctx, encoding);
+        const std::string_view encodingName = encoding == IntEncoding::Int ? "int" : "bv64";
+        const std::vector<std::string> constantBenches =
+        {
+            "(1 << 40) != 0",
+            "-1 < 0u",
+            "(1 << 31) < 0",
+            "-1 >> 40 == -1",
+            "~0 == -1",
+            "-7 / 2 == -3",
+            "-7 % 2 == 1",
+            "0x7FFFFFFF + 1 > 0",
+            "(3 ? 0u : 1) - 1 > 0",
+        };
+        for (const std::string & bench : constantBenches)
+        {
+            auto [tokensTree, tokensNode] = encodedExpander.parseIntoPreprocTokens(bench);
+            std::vector<PreprocToken> tokens = encodedExpander.internTokens(lang.tokensToTokenVector(tokensNode));
+            std::optional<bool> constant = encodedExpander.evaluateConstant(tokens);
+            z3::expr symbolic = encodedExpander.symbolizeExpandedToBoolExpr(tokens);
+            bool agree = constant && (*constant ? z3CheckTautology(symbolic) : z3CheckContradiction(symbolic));
+            std::cout << std::format
+            (
+                "{} {} fast path: {} is {}\n",
+                agree ? "OK" : "FAIL",
+                encodingName,
+                bench,
+                constant ? (*constant ? "true" : "false") : "undecided"
+            );
+            if (!agree) allPassed = false;
+        }
+    }
+
+    // Memoized expansions and nested definition collections must match those of an expander without memos
+    {
+        MacroExpander plainExpander(lang, &ctx);
+        plainExpander.useMemos = false;
+        auto tokensText = [](const MacroExpander & tokenExpander, const std::vector<PreprocToken> & tokens)
+        {
+            std::string text;
+            for (const PreprocToken & token : tokens) text += std::string(tokenExpander.tokenText(token)) + " ";
+            return text;
+        };
+        for (const auto & [tokens, table, firstExpansion] : benchCases)
+        {
+            std::string memoized = tokensText(expander, expander.expandPreprocTokens(tokens, table));
+            std::string plain = tokensText(plainExpander, plainExpander.expandPreprocTokens(tokens, table));
+            if (memoized != plain)
+            {
+                std::cout << std::format("FAIL memoized expansion {} differs from plain expansion {}\n", memoized, plain);
+                allPassed = false;
+            }
+            for (const TSNode & token : tokens)
+            {
+                if (!token.isSymbol(lang.identifier_s)) continue;
+                std::vector<ProgramPoint> uncached = plainExpander.collectNestedExpansionDefinitions(token, table);
+                for (int replay = 0; replay < 2; ++replay)
+                {
+                    if (expander.collectNestedExpansionDefinitions(token, table) != uncached)
+                    {
+                        std::cout << std::format("FAIL memoized nested definitions of {} differ\n", token.text());
+                        allPassed = false;
+                    }
+                }
+            }
+        }
+        if (expander.nestedDefinitionMemo.hits == 0 || plainExpander.nestedDefinitionMemo.hits + plainExpander.nestedDefinitionMemo.misses != 0)
+        {
+            std::cout << "FAIL nested definition memo was not used, or used while disabled\n";
+            allPassed = false;
+        }
+        if (plainExpander.objectExpansionMemo.hits + plainExpander.objectExpansionMemo.misses != 0)
+        {
+            std::cout << "FAIL object-like expansion memo used while disabled\n";
+            allPassed = false;
+        }
+    }
+
+    // Throughput microbenchmark, old path against new in one run: expansion without memos against
+    // the memoized expander, and symbolization through tree-sitter against the token parser
+    {
+        // Runs body over every round, returning the rate of items per second
+        auto measure = [](std::string_view name, std::size_t rounds, std::size_t itemsPerRound, auto && body)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (std::size_t round = 0; round < rounds; ++round) body(round);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double rate = rounds * itemsPerRound / seconds;
+            std::cout << std::format("{}: {} in {:.3f}s, {:.0f}/s\n", name, rounds * itemsPerRound, seconds, rate);
+            return rate;
+        };
+
+        constexpr std::size_t expansionRounds = 1000;
+        MacroExpander plainExpander(lang, &ctx);
+        plainExpander.useMemos = false;
+        double plainRate = measure
+        (
+            "Expansion without memos", expansionRounds, benchCases.size(),
+            [&](std::size_t)
+            {
+                for (const auto & [tokens, table, firstExpansion] : benchCases) plainExpander.expandPreprocTokens(tokens, table);
+            }
+        );
+        double memoizedRate = measure
+        (
+            "Expansion with memos", expansionRounds, benchCases.size(),
+            [&](std::size_t round)
+            {
+                for (const auto & [tokens, table, firstExpansion] : benchCases)
+                {
+                    // Replays are served from the object-like expansion memo and must match the first expansion
+                    std::vector<PreprocToken> expansion = expander.expandPreprocTokens(tokens, table);
+                    if (round == 0 && expansion != firstExpansion)
+                    {
+                        std::cout << "FAIL memoized expansion differs from the first one\n";
+                        allPassed = false;
+                    }
+                }
+            }
+        );
+        std::cout << std::format("Expansion speedup: {:.2f}x\n", memoizedRate / plainRate);
+        std::cout << std::format("Object-like expansion memo hit ratio: {:.3f}\n", expander.objectExpansionMemo.hitRatio());
+
+        // Only expansions that symbolize, as the reparsing path throws on the rest
+        std::vector<std::vector<PreprocToken>> symbolizable;
+        for (const auto & [tokens, table, firstExpansion] : benchCases)
+        {
+            try
+            {
+                expander.symbolizeExpandedToBoolExprReparsed(firstExpansion);
+                symbolizable.push_back(firstExpansion);
+            }
+            catch (const std::runtime_error &)
+            {
+                // Not symbolizable, left out of the benchmark
+            }
+        }
+        constexpr std::size_t symbolizationRounds = 100;
+        double reparsedRate = measure
+        (
+            "Symbolization through tree-sitter", symbolizationRounds, symbolizable.size(),
+            [&](std::size_t)
+            {
+                for (const std::vector<PreprocToken> & expanded : symbolizable) expander.symbolizeExpandedToBoolExprReparsed(expanded);
+            }
+        );
+        double directRate = measure
+        (
+            "Symbolization by the token parser", symbolizationRounds, symbolizable.size(),
+            [&](std::size_t)
+            {
+                for (const std::vector<PreprocToken> & expanded : symbolizable) expander.symbolizeExpandedToBoolExpr(expanded);
+            }
+        );
+        std::cout << std::format("Symbolization speedup: {:.2f}x\n", directRate / reparsedRate);
+    }
+
     if (!allPassed)
     {
         std::cerr << "Some expansions failed\n";
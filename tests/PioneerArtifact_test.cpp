@@ -0,0 +1,187 @@
+#include <iostream>
+#include <fstream>
+#include <optional>
+
+#include <z3++.h>
+
+#include <spdlog/spdlog.h>
+
+#include "Util.hpp"
+#include "TempDir.hpp"
+#include "SymbolicExecutor.hpp"
+#include "PioneerArtifact.hpp"
+
+int main()
+{
+    using namespace Hayroll;
+
+    spdlog::set_level(spdlog::level::debug);
+
+    TempDir tmpDir(false);
+    std::filesystem::path tmpPath = tmpDir.getPath();
+
+    auto saveSource = [&tmpPath](const std::string & source, const std::string & filename) -> std::filesystem::path
+    {
+        std::filesystem::path srcPath = tmpPath / filename;
+        std::ofstream srcFile(srcPath);
+        srcFile << source;
+        srcFile.close();
+        return srcPath;
+    };
+
+    std::filesystem::path headerPath = saveSource
+    (
+        R"(
+            #ifdef USER_A
+                #define BUFSZ 64
+            #else
+                #define BUFSZ 128
+            #endif
+        )",
+        "config.h"
+    );
+    std::filesystem::path entryPath = saveSource
+    (
+        R"(
+            #include "config.h"
+            #if BUFSZ > 100
+                int big;
+            #elif defined USER_B
+                int smallB;
+            #else
+                int small;
+            #endif
+            #include "config.h"
+            #ifndef USER_C
+                int noC;
+            #endif
+        )",
+        "main.c"
+    );
+
+    SymbolicExecutor executor(entryPath, tmpPath);
+    executor.run();
+    PremiseTree * premiseTree = executor.scribe.borrowTree();
+    premiseTree->refine();
+
+    const std::uint64_t configHash = PioneerArtifact::configHash({"main.c", "int"});
+    const std::string data = PioneerArtifact::serialize(executor.includeTree.get(), *premiseTree, configHash);
+
+    // A round trip gives back the same trees, with program points resolved in fresh parses
+    std::optional<PioneerArtifact> artifact = PioneerArtifact::deserialize(data, configHash);
+    if (!artifact)
+    {
+        std::cerr << "Fresh artifact was rejected" << std::endl;
+        return 1;
+    }
+    if (artifact->premiseTree->toString() != premiseTree->toString())
+    {
+        std::cerr << std::format("Premise trees differ:\n{}\n{}\n", premiseTree->toString(), artifact->premiseTree->toString());
+        return 1;
+    }
+    if (artifact->includeTree->toString() != executor.includeTree->toString())
+    {
+        std::cerr << std::format("Include trees differ:\n{}\n{}\n", executor.includeTree->toString(), artifact->includeTree->toString());
+        return 1;
+    }
+    // Loaded program points belong to trees of the loaded bank, as the Pipeline needs them to (index() throws otherwise)
+    for (const PremiseTree * node : artifact->premiseTree->getDescendantsPreOrder())
+    {
+        if (node->programPoint.node) artifact->astBank->index(node->programPoint.node);
+    }
+
+    // Other options invalidate the artifact
+    if (PioneerArtifact::deserialize(data, PioneerArtifact::configHash({"main.c", "bv64"})))
+    {
+        std::cerr << "Artifact accepted under different options" << std::endl;
+        return 1;
+    }
+
+    // So does an edit to any file in the include tree
+    saveSource(loadFileToString(headerPath) + "\n#define EXTRA 1\n", "config.h");
+    if (PioneerArtifact::deserialize(data, configHash))
+    {
+        std::cerr << "Artifact accepted after a header changed" << std::endl;
+        return 1;
+    }
+
+    // Truncated artifacts are reported, not misread
+    bool threw = false;
+    try
+    {
+        PioneerArtifact::deserialize(std::string_view(data).substr(0, data.size() / 2), configHash);
+    }
+    catch (const std::exception &)
+    {
+        threw = true;
+    }
+    if (!threw)
+    {
+        std::cerr << "Truncated artifact was not rejected" << std::endl;
+        return 1;
+    }
+
+    // An edit of C code only is followed by moving the artifact past it, which must give
+    // what symbolic execution of the edited file gives
+    SymbolicExecutor before(entryPath, tmpPath);
+    before.run();
+    PremiseTree * beforeTree = before.scribe.borrowTree();
+    beforeTree->refine();
+    const std::string beforeData = PioneerArtifact::serialize(before.includeTree.get(), *beforeTree, configHash);
+    saveSource
+    (
+        R"(
+            #include "config.h"
+            #if BUFSZ > 100
+                int big; int bigger;
+            #elif defined USER_B
+                int smallB;
+            #else
+                int small;
+            #endif
+            #include "config.h"
+            #ifndef USER_C
+                int noC;
+            #endif
+        )",
+        "main.c"
+    );
+    std::optional<SharedASTStore::Reparse> reparse = SharedASTStore::instance().update(std::filesystem::canonical(entryPath));
+    if (!reparse)
+    {
+        std::cerr << "Edited file was not reparsed" << std::endl;
+        return 1;
+    }
+    const PioneerArtifact::FileEdits edits
+    {
+        {
+            std::filesystem::canonical(entryPath).string(),
+            PioneerArtifact::FileEdit
+            {
+                PioneerArtifact::fnv1a(reparse->previous->tree.getSource()),
+                PioneerArtifact::fnv1a(reparse->current->tree.getSource()),
+                reparse->edit.start_byte,
+                reparse->edit.old_end_byte,
+                reparse->edit.new_end_byte
+            }
+        }
+    };
+    if (PioneerArtifact::deserialize(beforeData, configHash))
+    {
+        std::cerr << "Artifact accepted after an edit it was not told about" << std::endl;
+        return 1;
+    }
+    std::optional<PioneerArtifact> rebased = PioneerArtifact::deserialize(beforeData, configHash, edits);
+    SymbolicExecutor after(entryPath, tmpPath);
+    after.run();
+    PremiseTree * afterTree = after.scribe.borrowTree();
+    afterTree->refine();
+    if (!rebased || rebased->premiseTree->toString() != afterTree->toString())
+    {
+        std::cerr << std::format("Rebased premise tree differs:\n{}\n{}\n", afterTree->toString(), rebased ? rebased->premiseTree->toString() : "");
+        return 1;
+    }
+
+    std::cout << std::format("Pioneer artifact of {} bytes round-tripped\n", data.size());
+    return 0;
+}
@@ -0,0 +1,236 @@
+#include <iostream>
+#include <optional>
+#include <format>
+#include <cstdlib>
+
+#include <z3++.h>
+
+#include "Util.hpp"
+#include "PremiseBdd.hpp"
+
+int main()
+{
+    using namespace Hayroll;
+
+    z3::context ctx;
+    z3::expr defA = ctx.bool_const("defA");
+    z3::expr defB = ctx.bool_const("defB");
+    z3::expr defC = ctx.bool_const("defC");
+    z3::expr valX = ctx.int_const("valX");
+
+    z3::expr factorable = (defA && defB) || (defA && defC) || (defA && !defB && !defC);
+    z3::expr mixed = (defA != defB) && z3::implies(defC, defA) && (defA == defC);
+    PremiseBdd bdd({factorable, mixed, defA || !defA, defB && !defB});
+
+    // Hash-consing: equivalent premises get the same node
+    if (bdd.fromExpr(factorable) != bdd.fromExpr(defA))
+    {
+        std::cerr << "Equivalent premises map to different nodes" << std::endl;
+        return 1;
+    }
+    if (bdd.fromExpr(defA || !defA) != PremiseBdd::True || bdd.fromExpr(defB && !defB) != PremiseBdd::False)
+    {
+        std::cerr << "Tautology or contradiction not detected" << std::endl;
+        return 1;
+    }
+
+    // Arithmetic is left to z3
+    if (bdd.fromExpr(defA && valX > 3))
+    {
+        std::cerr << "Premise with valXXX accepted" << std::endl;
+        return 1;
+    }
+
+    // Lowering preserves meaning
+    z3::expr lowered = bdd.toExpr(*bdd.fromExpr(mixed), ctx);
+    std::cout << lowered.to_string() << std::endl;
+    z3::solver solver(ctx);
+    solver.add(lowered != mixed);
+    if (solver.check() != z3::unsat)
+    {
+        std::cerr << "Lowered premise is not equivalent" << std::endl;
+        return 1;
+    }
+
+    // Atoms not given at construction are rejected
+    if (bdd.fromExpr(ctx.bool_const("defD")))
+    {
+        std::cerr << "Premise over an unknown atom accepted" << std::endl;
+        return 1;
+    }
+
+    // The variable order is fixed by the atom names, so lowering does not depend on what was built before
+    {
+        z3::expr premise = (defC && defB) || (defA && !defB);
+        PremiseBdd fresh({premise});
+        PremiseBdd primed({defC && defB && defA, premise});
+        primed.fromExpr(defC && defB && defA);
+        if (!z3::eq(fresh.toExpr(*fresh.fromExpr(premise), ctx), primed.toExpr(*primed.fromExpr(premise), ctx)))
+        {
+            std::cerr << "Lowered premise depends on earlier conversions" << std::endl;
+            return 1;
+        }
+        if (!z3::eq(simplifyOrOfAnd(premise), simplifyOrOfAnd(premise)))
+        {
+            std::cerr << "simplifyOrOfAnd is not deterministic" << std::endl;
+            return 1;
+        }
+    }
+
+    // Building past the node budget gives up and leaves the premise to z3
+    {
+        z3::expr wide = ctx.bool_val(false);
+        for (int i = 0; i < 12; ++i)
+        {
+            wide = wide || (ctx.bool_const(std::format("defL{}", i).c_str()) && ctx.bool_const(std::format("defR{}", i).c_str()));
+        }
+        if (PremiseBdd({wide}, 16).fromExpr(wide) || !PremiseBdd({wide}).fromExpr(wide))
+        {
+            std::cerr << "Node budget not enforced" << std::endl;
+            return 1;
+        }
+        if (z3Check(wide) != z3::sat)
+        {
+            std::cerr << "z3Check fallback disagrees" << std::endl;
+            return 1;
+        }
+    }
+
+    // Util entry points take the BDD path for pure boolean premises and z3 otherwise
+    if (!z3CheckTautology(z3::implies(defA && defB, defA || defC)) || z3Check(valX > 3 && valX < 2) != z3::unsat)
+    {
+        std::cerr << "z3Check disagrees" << std::endl;
+        return 1;
+    }
+    std::cout << simplifyOrOfAnd(factorable).to_string() << std::endl;
+    if (!z3::eq(simplifyOrOfAnd(factorable), defA))
+    {
+        std::cerr << "simplifyOrOfAnd did not reduce to defA" << std::endl;
+        return 1;
+    }
+
+    // Simplification tiers on a premise the BDD rejects. Only the solver-based tier sees that
+    // valX > 3 makes the disjunction redundant; adaptive uses it above its size threshold only.
+    {
+        z3::expr premise = valX > 3 && (valX > 2 || defC);
+        auto simplifyWith = [&](SimplifyTier tier, std::size_t sizeThreshold = PremiseSimplifier::DefaultSizeThreshold)
+        {
+            z3::expr simplified = PremiseSimplifier(ctx, tier, sizeThreshold).simplify(premise);
+            std::cout << simplified.to_string() << std::endl;
+            if (z3Check(simplified != premise) != z3::unsat)
+            {
+                std::cerr << "Simplified premise is not equivalent" << std::endl;
+                std::exit(1);
+            }
+            return simplified;
+        };
+        z3::expr syntactic = simplifyWith(SimplifyTier::Syntactic);
+        z3::expr full = simplifyWith(SimplifyTier::Full);
+        z3::expr adaptiveSmall = simplifyWith(SimplifyTier::Adaptive);
+        z3::expr adaptiveLarge = simplifyWith(SimplifyTier::Adaptive, 0);
+        if (exprDagSize(full) >= exprDagSize(syntactic))
+        {
+            std::cerr << "Full tier did not remove the redundant disjunction" << std::endl;
+            return 1;
+        }
+        if (!z3::eq(adaptiveSmall, syntactic) || !z3::eq(adaptiveLarge, full))
+        {
+            std::cerr << "Adaptive tier does not follow its size threshold" << std::endl;
+            return 1;
+        }
+        // Without a simplifier serving the context, the default tier is used, and it is Full
+        if (PremiseSimplifier::DefaultTier != SimplifyTier::Full || !z3::eq(simplifyOrOfAnd(premise), full))
+        {
+            std::cerr << "simplifyOrOfAnd does not default to the full tier" << std::endl;
+            return 1;
+        }
+    }
+
+    // The full tier gives what simplifyOrOfAnd gave before tiers existed, whatever the timeout
+    {
+        auto legacySimplifyOrOfAnd = [&](const z3::expr & expr)
+        {
+            z3::params paramsSimplify(ctx);
+            paramsSimplify.set("flat_and_or", true);
+            paramsSimplify.set("bv_ite2id", true);
+            paramsSimplify.set("local_ctx", true);
+            z3::tactic tacticSimplify = with(z3::tactic(ctx, "simplify"), paramsSimplify);
+            z3::goal goal1(ctx);
+            goal1.add(expr);
+            z3::expr expr2 = factorCommonTerm(tacticSimplify(goal1)[0].as_expr());
+            z3::tactic tacticCompound =
+                tacticSimplify
+                & z3::tactic(ctx, "propagate-values")
+                & z3::tactic(ctx, "unit-subsume-simplify")
+                & z3::tactic(ctx, "dom-simplify")
+                & z3::tactic(ctx, "ctx-solver-simplify")
+                & tacticSimplify;
+            z3::goal goal2(ctx);
+            goal2.add(expr2);
+            return tacticCompound(goal2)[0].as_expr();
+        };
+        z3::expr valY = ctx.int_const("valY");
+        z3::expr large = ctx.bool_val(false);
+        for (int i = 0; i < 24; ++i)
+        {
+            z3::expr def = ctx.bool_const(std::format("def{}", i % 6).c_str());
+            large = large || (defA && valX > i && (valY < 2 * i || def) && (valX + valY != i % 5));
+        }
+        const z3::expr expected = legacySimplifyOrOfAnd(large);
+        PremiseSimplifier hurried(ctx, SimplifyTier::Full, PremiseSimplifier::DefaultSizeThreshold, 1);
+        if (!z3::eq(hurried.simplify(large), expected) || hurried.timeouts != 0)
+        {
+            std::cerr << "Full tier differs from the premises emitted before tiers" << std::endl;
+            return 1;
+        }
+        if (!z3::eq(simplifyOrOfAnd(large), expected))
+        {
+            std::cerr << "simplifyOrOfAnd differs from the premises emitted before tiers" << std::endl;
+            return 1;
+        }
+    }
+
+    // Repeated queries on a context with a query cache are answered from the cache
+    {
+        Z3QueryCache cache(ctx);
+        z3::expr query = defA && valX > 3;
+        z3Check(query);
+        z3Check(query);
+        std::vector<z3::check_result> branches = cache.checkUnder(defA, {valX > 3, valX < 2});
+        if (cache.hits != 2 || cache.misses != 2 || branches[0] != z3::sat || branches[1] != z3::sat)
+        {
+            std::cerr << "Unexpected query cache behavior: " << cache.hits << " hits, " << cache.misses << " misses" << std::endl;
+            return 1;
+        }
+    }
+
+    // A full cache drops its results instead of growing, and keeps answering correctly
+    {
+        z3::context boundedCtx;
+        z3::expr valY = boundedCtx.int_const("valY");
+        Z3QueryCache cache(boundedCtx, 2);
+        for (int i = 0; i < 5; ++i) z3Check(valY > i);
+        if (cache.size() > 2 || cache.clears == 0 || z3Check(valY > 7 && valY < 3) != z3::unsat)
+        {
+            std::cerr << "Query cache not bounded: " << cache.size() << " entries, " << cache.clears << " clears" << std::endl;
+            return 1;
+        }
+    }
+
+    // Lookups memoized per thread notice a cache registered after them
+    {
+        z3::context lateCtx;
+        z3::expr valZ = lateCtx.int_const("valZ");
+        z3Check(valZ > 1);
+        Z3QueryCache cache(lateCtx);
+        z3Check(valZ > 1);
+        z3Check(valZ > 1);
+        if (cache.hits != 1 || cache.misses != 1)
+        {
+            std::cerr << "Late query cache not found: " << cache.hits << " hits, " << cache.misses << " misses" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
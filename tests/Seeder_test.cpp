@@ -9,6 +9,7 @@
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <sstream>
 
 #include "SymbolicExecutor.hpp"
 #include "LineMatcher.hpp"
@@ -75,7 +76,7 @@ int main(const int argc, const char* argv[])
     
     Warp endWarp = executor.run();
     PremiseTree * premiseTree = executor.scribe.borrowTree();
-    IncludeTreePtr includeTree = executor.includeTree;
+    IncludeTreePtr includeTree = executor.includeTree.get();
     const CPreproc & lang = executor.lang;
     
     premiseTree->refine();
@@ -113,5 +114,54 @@ int main(const int argc, const char* argv[])
 
     std::cout << "Seeder completed. Instrumented CU file saved to: " << tmpDstPath << std::endl;
 
+    // Compact tags: every tag in the code resolves through the side-table, and a user literal
+    // that looks like a tag is left alone
+    {
+        const std::string userLiteral = "\"HR#1\"";
+        std::string cuWithLiteralStr = cuStr + "\nstatic const char * hayrollUserLiteral = " + userLiteral + ";\n";
+        Seeder::TagTable tagTable(std::hash<std::string>{}(cuWithLiteralStr));
+        auto [compactOutput, compactReport] = Seeder::run(cpp2cInvocations, cpp2cRanges, cuWithLiteralStr, lineMap, inverseLineMap, &tagTable);
+
+        std::istringstream tableLines(tagTable.toJsonLines());
+        std::string line;
+        std::getline(tableLines, line);
+        const std::string prefix = json::parse(line).at("prefix").get<std::string>();
+        std::vector<json> tags;
+        while (std::getline(tableLines, line))
+        {
+            json entry = json::parse(line);
+            if (entry.at("id").get<std::size_t>() != tags.size() || !entry.at("tag").at("hayroll").get<bool>())
+            {
+                std::cerr << "Malformed tag table entry: " << line << std::endl;
+                return 1;
+            }
+            tags.push_back(entry.at("tag"));
+        }
+        if (tags.empty() || prefix != tagTable.getPrefix() || std::string_view("HR#1").starts_with(prefix))
+        {
+            std::cerr << "Unexpected tag table with prefix " << prefix << std::endl;
+            return 1;
+        }
+
+        std::size_t compactTagCount = 0;
+        for (std::size_t pos = compactOutput.find("\"" + prefix); pos != std::string::npos; pos = compactOutput.find("\"" + prefix, pos + 1))
+        {
+            const std::size_t idBegin = pos + 1 + prefix.size();
+            const std::size_t idEnd = compactOutput.find('"', idBegin);
+            if (std::stoull(compactOutput.substr(idBegin, idEnd - idBegin)) >= tags.size())
+            {
+                std::cerr << "Compact tag without a table entry: " << compactOutput.substr(pos, idEnd - pos + 1) << std::endl;
+                return 1;
+            }
+            ++compactTagCount;
+        }
+        if (compactTagCount == 0 || compactOutput.find("hayrollUserLiteral = " + userLiteral) == std::string::npos)
+        {
+            std::cerr << "Compact seeding lost the tags or the user literal" << std::endl;
+            return 1;
+        }
+        std::cout << "Compact seeding emitted " << compactTagCount << " tag(s) for " << tags.size() << " payload(s)" << std::endl;
+    }
+
     return 0;
 }
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <optional>
+
+#include <z3++.h>
+
+#include "IncludeTree.hpp"
+#include "PremiseTree.hpp"
+#include "Splitter.hpp"
+
+int main()
+{
+    using namespace Hayroll;
+
+    z3::context ctx;
+    z3::expr defA = ctx.bool_const("defA");
+    z3::expr defB = ctx.bool_const("defB");
+    z3::expr defC = ctx.bool_const("defC");
+
+    IncludeTreeRootPtr includeTree = IncludeTree::make(TSNode{}, "test.c");
+    const ProgramPoint point{includeTree.get(), TSNode{}};
+
+    // Sibling #if bodies; all but the last can be entered at once
+    PremiseTreePtr root = PremiseTree::make(point, ctx.bool_val(true));
+    root->addChild(point, defA);
+    root->addChild(point, defB);
+    root->addChild(point, defC);
+    root->addChild(point, !defA);
+
+    CompileCommand command;
+    command.file = "test.c";
+    const std::size_t greedySplits = Splitter::countSplits(root.get(), command, SplitPlanning::Greedy);
+    const std::size_t coverSplits = Splitter::countSplits(root.get(), command, SplitPlanning::Cover);
+    std::cout << "Greedy: " << greedySplits << ", cover: " << coverSplits << std::endl;
+    if (coverSplits != 2 || coverSplits > greedySplits)
+    {
+        std::cerr << "Cover planning did not find the minimum number of DefineSets" << std::endl;
+        return 1;
+    }
+
+    // Every node is still covered by some DefineSet the planner generates
+    Splitter splitter(root.get(), command, SplitPlanning::Cover);
+    std::vector<DefineSet> defineSets;
+    for (Splitter::Feedback feedback = Splitter::Feedback::initial(); auto defineSet = splitter.next(feedback); feedback = Splitter::Feedback::success())
+    {
+        defineSets.push_back(*defineSet);
+    }
+    for (const PremiseTree * node : root->getDescendantsLevelOrder())
+    {
+        const z3::expr premise = node->getCompletePremise();
+        if (std::ranges::none_of(defineSets, [&](const DefineSet & defineSet) { return defineSet.satisfies(premise); }))
+        {
+            std::cerr << "Premise " << premise.to_string() << " is not covered" << std::endl;
+            return 1;
+        }
+    }
+
+    // A failing cover DefineSet is retried with the pivot's own model before the pivot is given up
+    {
+        Splitter retrySplitter(root.get(), command, SplitPlanning::Cover);
+        std::optional<DefineSet> cover = retrySplitter.next(Splitter::Feedback::initial());
+        std::optional<DefineSet> retry = retrySplitter.next(Splitter::Feedback::failStage("Maki", "test"));
+        const PremiseTree * pivot = root->getDescendantsLevelOrder().back();
+        if (!cover || !retry || retry->toString() != pivot->getDefineSet().toString())
+        {
+            std::cerr << "Failed cover DefineSet was not retried with the pivot's own model" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -3,6 +3,8 @@
 #include <optional>
 #include <variant>
 #include <memory>
+#include <chrono>
+#include <format>
 
 #include <spdlog/spdlog.h>
 
@@ -18,7 +20,8 @@ int main()
 
     spdlog::set_level(spdlog::level::debug);
 
-    IncludeTreePtr includeTree = IncludeTree::make(TSNode{}, "<built-in>");
+    IncludeTreeRootPtr includeTreeRoot = IncludeTree::make(TSNode{}, "<built-in>");
+    IncludeTreePtr includeTree = includeTreeRoot.get();
     SymbolSegmentPtr symbolSegment = SymbolSegment::make();
     IncludeResolver resolver(ClangExe, {});
     CPreproc lang = CPreproc();
@@ -59,5 +62,99 @@ int main()
 
     std::cout << symbolTable->toString() << std::endl;
 
+    // Content hash: the same definitions written in different places (and orders) hash the same
+    auto defineFromSource = [&](const TSTree & defTree) -> SymbolTablePtr
+    {
+        SymbolSegmentPtr segment = SymbolSegment::make();
+        for (TSNode node : defTree.rootNode().iterateChildren())
+        {
+            TSNode nameNode = node.childByFieldId(lang.preproc_def_s.name_f);
+            TSNode valueNode = node.childByFieldId(lang.preproc_def_s.value_f);
+            segment->define(ObjectSymbol{nameNode.textView(), {includeTree, node}, valueNode});
+        }
+        return symbolTable->define(segment);
+    };
+    TSTree treeA = parser.parseString(std::string("#define X 1\n#define Y (a + b)\n"));
+    TSTree treeB = parser.parseString(std::string("#define Y (a  +  b)\n#define X 1\n"));
+    TSTree treeC = parser.parseString(std::string("#define X 2\n#define Y (a + b)\n"));
+    SymbolTablePtr tableA = defineFromSource(treeA);
+    SymbolTablePtr tableB = defineFromSource(treeB);
+    SymbolTablePtr tableC = defineFromSource(treeC);
+    if (tableA->getContentHash() != tableB->getContentHash())
+    {
+        std::cout << "Error: equivalent symbol tables have different content hashes\n";
+        return 1;
+    }
+    if (tableA->getContentHash() == tableC->getContentHash())
+    {
+        std::cout << "Error: different symbol tables have the same content hash\n";
+        return 1;
+    }
+    // Equal hashes only suggest equal bindings; sameBindings decides
+    if (!tableA->sameBindings(*tableB) || tableA->sameBindings(*tableC))
+    {
+        std::cout << "Error: sameBindings disagrees with the definitions\n";
+        return 1;
+    }
+
+    // Lookup latency against chain depth. Each layer defines one macro, as a run of
+    // executeContinuousDefines would; flattening should keep deep chains as fast as shallow ones.
+    const std::size_t maxDepth = 1024;
+    std::string layerSource;
+    for (std::size_t i = 0; i < maxDepth; ++i)
+    {
+        layerSource += std::format("#define LAYER_{} {}\n", i, i);
+    }
+    TSTree layerTree = parser.parseString(std::move(layerSource));
+    std::vector<TSNode> layerDefs;
+    for (TSNode node : layerTree.rootNode().iterateChildren())
+    {
+        layerDefs.push_back(node);
+    }
+    assert(layerDefs.size() == maxDepth);
+
+    const std::size_t lookupsPerDepth = 100000;
+    for (std::size_t depth : {1, 8, 32, 128, 512, 1024})
+    {
+        SymbolTablePtr chain = symbolTable;
+        for (std::size_t i = 0; i < depth; ++i)
+        {
+            SymbolSegmentPtr segment = SymbolSegment::make();
+            TSNode nameNode = layerDefs[i].childByFieldId(lang.preproc_def_s.name_f);
+            TSNode valueNode = layerDefs[i].childByFieldId(lang.preproc_def_s.value_f);
+            segment->define(ObjectSymbol{nameNode.textView(), {includeTree, layerDefs[i]}, valueNode});
+            chain = chain->define(segment);
+        }
+        if (chain->getDepth() > SymbolTable::FlattenDepth + 1)
+        {
+            std::cout << std::format("Error: chain of {} layers was not flattened (depth {})\n", depth, chain->getDepth());
+            return 1;
+        }
+
+        // The oldest layer and a missing name are the slowest lookups of an unflattened chain.
+        std::optional<Symbol> oldest = chain->lookup("LAYER_0");
+        if (!oldest || !std::holds_alternative<ObjectSymbol>(*oldest) || std::get<ObjectSymbol>(*oldest).body.text() != "0")
+        {
+            std::cout << std::format("Error: LAYER_0 lost in a chain of {} layers\n", depth);
+            return 1;
+        }
+        std::size_t found = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < lookupsPerDepth; ++i)
+        {
+            found += chain->lookup("LAYER_0").has_value();
+            found += chain->lookup("NOT_A_MACRO").has_value();
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << std::format
+        (
+            "Lookup at depth {:>4}: {:.1f} ns/lookup ({} segments walked at most)\n",
+            depth,
+            static_cast<double>(elapsed.count()) / (2 * lookupsPerDepth),
+            chain->getDepth() + 1
+        );
+        assert(found == lookupsPerDepth);
+    }
+
     return 0;
 }
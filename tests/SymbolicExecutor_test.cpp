@@ -1,4 +1,8 @@
 #include <iostream>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <algorithm>
 
 #include <z3++.h>
 
@@ -100,9 +104,101 @@ int main(int argc, char **argv)
     )";
     saveSource(incSrcString, "inc.h");
 
+    // States disagreeing only on BUFSZ are ITE-merged, and the guarded value still decides the #if
+    std::string iteSrcString =
+    R"(
+        #ifdef USER_A
+            #define BUFSZ 64
+        #else
+            #define BUFSZ 128
+        #endif
+
+        #if BUFSZ > 100
+            #check !defined USER_A
+        #else
+            #check defined USER_A
+        #endif
+    )";
+    std::filesystem::path itePath = saveSource(iteSrcString, "ite.c");
+
+    // An unguarded header included repeatedly; later includes replay its summary
+    std::string configSrcString =
+    R"(
+        #ifdef USER_A
+            #check defined USER_A
+            #define CFG 1
+        #else
+            #check !defined USER_A
+            #define CFG 2
+        #endif
+    )";
+    saveSource(configSrcString, "config.h");
+    // Its second include replays a summary in which the USER_B branch can no longer be entered
+    std::string branchSrcString =
+    R"(
+        #ifdef USER_B
+            #if USER_N > 3
+                #define BIG 1
+            #endif
+        #endif
+    )";
+    saveSource(branchSrcString, "branch.h");
+    std::string memoSrcString =
+    R"(
+        #include "config.h"
+        #include "config.h"
+        #include "config.h"
+        #if CFG == 1
+            #check defined USER_A
+        #endif
+        #include "branch.h"
+        #ifndef USER_B
+            #include "branch.h"
+        #endif
+    )";
+    std::filesystem::path memoPath = saveSource(memoSrcString, "memo.c");
+
+    // Re-includes of guarded headers are skipped once the guard is defined
+    saveSource
+    (
+        R"(
+            // Include guard
+            #ifndef GUARD_H
+            #define GUARD_H
+                #check 1
+            #endif
+        )",
+        "guard.h"
+    );
+    saveSource
+    (
+        R"(
+            #pragma once
+            #check 1
+        )",
+        "once.h"
+    );
+    std::string guardSrcString =
+    R"(
+        #include "guard.h"
+        #include "once.h"
+        #include "guard.h"
+        #include "once.h"
+    )";
+    std::filesystem::path guardPath = saveSource(guardSrcString, "guard.c");
+
     std::vector<SymbolicExecutor> executors;
 
     executors.push_back(std::move(SymbolicExecutor(entryPath, tmpPath)));
+    // Same source, with #if branch feasibility checked on a worker pool
+    executors.push_back(std::move(SymbolicExecutor(entryPath, tmpPath, {}, std::nullopt, false, {.checkThreads = 4})));
+    // ITE merging on both sources
+    executors.push_back(std::move(SymbolicExecutor(entryPath, tmpPath, {}, std::nullopt, false, {.iteMergeLimit = 2})));
+    executors.push_back(std::move(SymbolicExecutor(itePath, tmpPath, {}, std::nullopt, false, {.iteMergeLimit = 2})));
+    // Header summaries on both sources
+    executors.push_back(std::move(SymbolicExecutor(entryPath, tmpPath, {}, std::nullopt, false, {.memoizeHeaders = true})));
+    executors.push_back(std::move(SymbolicExecutor(memoPath, tmpPath, {}, std::nullopt, false, {.memoizeHeaders = true})));
+    executors.push_back(std::move(SymbolicExecutor(guardPath, tmpPath)));
 
     executors.push_back(std::move(SymbolicExecutor(LibmcsDir / "libm/mathf/sinhf.c", LibmcsDir, {LibmcsDir / "libm/include/"})));
     executors.push_back(std::move(SymbolicExecutor(LibmcsDir / "libm/mathd/roundd.c", LibmcsDir, {LibmcsDir / "libm/include/"})));
@@ -114,7 +210,7 @@ int main(int argc, char **argv)
 
         Warp endWarp = executor.run();
         PremiseTree * premiseTree = executor.scribe.borrowTree();
-        IncludeTreePtr includeTree = executor.includeTree;
+        IncludeTreePtr includeTree = executor.includeTree.get();
         const CPreproc & lang = executor.lang;
 
         for (const State & state : endWarp.states)
@@ -183,6 +279,299 @@ int main(int argc, char **argv)
         }
     }
 
+    // The parallel branch checks must produce exactly the same premise tree as the serial ones
+    {
+        SymbolicExecutor serialExecutor(LibmcsDir / "libm/mathf/sinhf.c", LibmcsDir, {LibmcsDir / "libm/include/"});
+        SymbolicExecutor parallelExecutor(LibmcsDir / "libm/mathf/sinhf.c", LibmcsDir, {LibmcsDir / "libm/include/"}, std::nullopt, false, {.checkThreads = 4});
+        serialExecutor.run();
+        parallelExecutor.run();
+        std::string serialTree = serialExecutor.scribe.borrowTree()->toString();
+        std::string parallelTree = parallelExecutor.scribe.borrowTree()->toString();
+        if (serialTree != parallelTree)
+        {
+            std::cout << std::format("Error: parallel premise tree differs from serial one:\n{}\n{}\n", serialTree, parallelTree);
+            allPass = false;
+        }
+        // So must refining the subtrees on worker threads
+        serialExecutor.scribe.borrowTree()->refine();
+        parallelExecutor.scribe.borrowTree()->refine(4);
+        std::string serialRefined = serialExecutor.scribe.borrowTree()->toString();
+        std::string parallelRefined = parallelExecutor.scribe.borrowTree()->toString();
+        if (serialRefined != parallelRefined)
+        {
+            std::cout << std::format("Error: parallel refined premise tree differs from serial one:\n{}\n{}\n", serialRefined, parallelRefined);
+            allPass = false;
+        }
+    }
+
+    // Batched checks go through the query cache with and without a pool, so a repeated batch is all hits
+    {
+        SymbolicExecutor serialExecutor(entryPath, tmpPath);
+        SymbolicExecutor parallelExecutor(entryPath, tmpPath, {}, std::nullopt, false, {.checkThreads = 4});
+        std::vector<std::vector<z3::check_result>> batchResults;
+        for (SymbolicExecutor * executor : {&serialExecutor, &parallelExecutor})
+        {
+            z3::context & batchCtx = *executor->ctx;
+            z3::expr valX = batchCtx.int_const("valX");
+            z3::expr valY = batchCtx.int_const("valY");
+            const std::vector<z3::expr> batch{valX > 3 && valY < valX, valX > 3 && valX < 2, valX + valY == 7};
+            std::vector<z3::check_result> first = executor->checkAll(batch);
+            const std::size_t hitsBefore = executor->queryCache->hits;
+            std::vector<z3::check_result> second = executor->checkAll(batch);
+            if (first != second || executor->queryCache->hits - hitsBefore != batch.size())
+            {
+                std::cout << "Error: repeated batch was not answered from the query cache\n";
+                allPass = false;
+            }
+            batchResults.push_back(std::move(first));
+        }
+        if (batchResults[0] != batchResults[1])
+        {
+            std::cout << "Error: batched checks differ with and without a pool\n";
+            allPass = false;
+        }
+    }
+
+    // A TU made of headers whose premises are pure boolean, in different atom orders, so refinement goes
+    // through the premise BDDs. Refining on worker threads must emit exactly the serial premises.
+    {
+        std::string headerHeavySrcString;
+        const std::vector<std::string> flags = {"USER_A", "USER_B", "USER_C", "USER_D", "USER_E"};
+        for (std::size_t i = 0; i < 6; ++i)
+        {
+            const std::string & outer = flags[i % flags.size()];
+            const std::string & inner = flags[(i + 2) % flags.size()];
+            const std::string & other = flags[(flags.size() - 1 - i % flags.size())];
+            std::string headerSrcString = std::format
+            (
+                R"(
+                    #ifndef HEADER_{0}_H
+                    #define HEADER_{0}_H
+                    #ifdef {1}
+                        #if defined {2} || !defined {3}
+                            #define FEATURE_{0} 1
+                        #endif
+                    #elif !defined {2}
+                        #define FEATURE_{0} 2
+                    #endif
+                    #endif
+                )",
+                i, outer, inner, other
+            );
+            std::string headerName = std::format("heavy{}.h", i);
+            saveSource(headerSrcString, headerName);
+            headerHeavySrcString += std::format("#include \"{}\"\n#ifdef FEATURE_{}\nint feature{};\n#endif\n", headerName, i, i);
+        }
+        std::filesystem::path headerHeavyPath = saveSource(headerHeavySrcString, "heavy.c");
+
+        SymbolicExecutor serialExecutor(headerHeavyPath, tmpPath);
+        SymbolicExecutor parallelExecutor(headerHeavyPath, tmpPath);
+        serialExecutor.run();
+        parallelExecutor.run();
+        serialExecutor.scribe.borrowTree()->refine();
+        parallelExecutor.scribe.borrowTree()->refine(4);
+        std::string serialRefined = serialExecutor.scribe.borrowTree()->toString();
+        std::string parallelRefined = parallelExecutor.scribe.borrowTree()->toString();
+        if (serialRefined != parallelRefined)
+        {
+            std::cout << std::format("Error: refine(4) differs from refine() on a header-heavy TU:\n{}\n{}\n", serialRefined, parallelRefined);
+            allPass = false;
+        }
+    }
+
+    // The 64-bit bit-vector encoding explores the same premise tree shape as the Int encoding.
+    // Timings of both are printed for comparison.
+    {
+        auto timeRun = [](SymbolicExecutor & executor)
+        {
+            auto begin = std::chrono::steady_clock::now();
+            executor.run();
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        };
+        SymbolicExecutor intExecutor(LibmcsDir / "libm/mathf/sinhf.c", LibmcsDir, {LibmcsDir / "libm/include/"});
+        SymbolicExecutor bvExecutor
+        (
+            LibmcsDir / "libm/mathf/sinhf.c", LibmcsDir, {LibmcsDir / "libm/include/"},
+            std::nullopt, false, {.intEncoding = IntEncoding::BitVector64}
+        );
+        double intMs = timeRun(intExecutor);
+        double bvMs = timeRun(bvExecutor);
+        std::size_t intNodes = intExecutor.scribe.borrowTree()->getDescendantsPreOrder().size();
+        std::size_t bvNodes = bvExecutor.scribe.borrowTree()->getDescendantsPreOrder().size();
+        std::cout << std::format("Int encoding: {:.1f} ms, {} premise nodes; bv64 encoding: {:.1f} ms, {} premise nodes\n", intMs, intNodes, bvMs, bvNodes);
+        if (intNodes != bvNodes)
+        {
+            std::cout << "Error: encodings produced premise trees of different shapes\n";
+            allPass = false;
+        }
+        // Conditions over builtin macros only, such as __GNUC__ checks, never reach z3
+        std::cout << std::format("Concrete #if conditions: {} of {}\n", intExecutor.concreteConditions, intExecutor.concreteConditions + intExecutor.symbolicConditions);
+        if (intExecutor.concreteConditions == 0)
+        {
+            std::cout << "Error: no #if condition took the concrete fast path\n";
+            allPass = false;
+        }
+    }
+
+    // Invocation analysis skips identifiers that are never defined as macros, such as locals and fields
+    {
+        SymbolicExecutor invocationExecutor(LibmcsDir / "libm/mathf/sinhf.c", LibmcsDir, {LibmcsDir / "libm/include/"}, std::nullopt, true);
+        invocationExecutor.run();
+        std::cout << std::format("Identifiers skipped by the macro name filter: {}\n", invocationExecutor.skippedIdentifiers);
+        if (invocationExecutor.skippedIdentifiers == 0)
+        {
+            std::cout << "Error: the macro name filter skipped no identifier\n";
+            allPass = false;
+        }
+    }
+
+    // Stats are per executor, so executors running concurrently count exactly what a lone run counts
+    {
+        auto makeExecutor = [&]()
+        {
+            return SymbolicExecutor(LibmcsDir / "libm/mathf/sinhf.c", LibmcsDir, {LibmcsDir / "libm/include/"});
+        };
+        SymbolicExecutor loneExecutor = makeExecutor();
+        loneExecutor.run();
+        SymbolicExecutor executorA = makeExecutor();
+        SymbolicExecutor executorB = makeExecutor();
+        std::thread threadA([&executorA]() { executorA.run(); });
+        std::thread threadB([&executorB]() { executorB.run(); });
+        threadA.join();
+        threadB.join();
+        const PioneerStats & lone = loneExecutor.stats;
+        std::cout << std::format("Pioneer stats:\n{}\n", loneExecutor.statsJson().dump(4));
+        for (const SymbolicExecutor * executor : {&executorA, &executorB})
+        {
+            const PioneerStats & concurrent = executor->stats;
+            if
+            (
+                concurrent.symbolTables.tables != lone.symbolTables.tables
+                || concurrent.symbolTables.segments != lone.symbolTables.segments
+                || concurrent.statesSplit != lone.statesSplit
+                || concurrent.peakLiveStates != lone.peakLiveStates
+            )
+            {
+                std::cout << "Error: concurrent executors counted differently from a lone one\n";
+                allPass = false;
+            }
+        }
+        if (lone.statesSplit == 0 || lone.symbolicIncludes == 0 || lone.concreteIncludes == 0 || lone.directives.empty())
+        {
+            std::cout << "Error: Pioneer stats missed activity of sinhf.c\n";
+            allPass = false;
+        }
+    }
+
+    // With ITE merging the two BUFSZ paths collapse into one end state
+    {
+        SymbolicExecutor iteExecutor(itePath, tmpPath, {}, std::nullopt, false, {.iteMergeLimit = 2});
+        Warp endWarp = iteExecutor.run();
+        if (endWarp.states.size() != 1)
+        {
+            std::cout << std::format("Error: expected 1 ITE-merged end state, got {}\n", endWarp.states.size());
+            allPass = false;
+        }
+    }
+
+    // Each guarded header is entered only once
+    {
+        SymbolicExecutor guardExecutor(guardPath, tmpPath);
+        guardExecutor.run();
+        std::size_t guardIncludes = 0;
+        std::size_t onceIncludes = 0;
+        for (IncludeTreePtr child : guardExecutor.includeTree->children)
+        {
+            if (child->path.filename() == "guard.h") guardIncludes++;
+            if (child->path.filename() == "once.h") onceIncludes++;
+        }
+        if (guardIncludes != 1 || onceIncludes != 1)
+        {
+            std::cout << std::format("Error: guarded headers entered {} and {} times\n", guardIncludes, onceIncludes);
+            allPass = false;
+        }
+    }
+
+    // The third include of config.h enters with the same relevant bindings as the second.
+    // Replaying summaries gives the same refined premise tree and end states as executing the headers.
+    {
+        SymbolicExecutor memoExecutor(memoPath, tmpPath, {}, std::nullopt, false, {.memoizeHeaders = true});
+        Warp memoWarp = memoExecutor.run();
+        if (memoExecutor.headerSummaryHits == 0)
+        {
+            std::cout << std::format("Error: no header summary hits ({} misses)\n", memoExecutor.headerSummaryMisses);
+            allPass = false;
+        }
+
+        SymbolicExecutor plainExecutor(memoPath, tmpPath);
+        Warp plainWarp = plainExecutor.run();
+        PremiseTree * memoTree = memoExecutor.scribe.borrowTree();
+        PremiseTree * plainTree = plainExecutor.scribe.borrowTree();
+        memoTree->refine();
+        plainTree->refine();
+
+        z3::context & ctx = *memoExecutor.ctx;
+        auto equivalent = [&ctx](const z3::expr & memoExpr, const z3::expr & plainExpr)
+        {
+            z3::expr translated(ctx, Z3_translate(plainExpr.ctx(), plainExpr, ctx));
+            return z3Check(memoExpr != translated) == z3::unsat;
+        };
+        auto samePoint = [](const ProgramPoint & memoPoint, const ProgramPoint & plainPoint)
+        {
+            return memoPoint.includeTree->path == plainPoint.includeTree->path
+                && memoPoint.node.startByte() == plainPoint.node.startByte()
+                && memoPoint.node.endByte() == plainPoint.node.endByte();
+        };
+        // Children may have been created in a different order
+        std::function<bool(const PremiseTree &, const PremiseTree &)> sameTree =
+            [&](const PremiseTree & memoNode, const PremiseTree & plainNode)
+        {
+            if (!samePoint(memoNode.programPoint, plainNode.programPoint)) return false;
+            if (!equivalent(memoNode.getCompletePremise(), plainNode.getCompletePremise())) return false;
+            if (memoNode.children.size() != plainNode.children.size()) return false;
+            for (const PremiseTreePtr & memoChild : memoNode.children)
+            {
+                bool matched = std::ranges::any_of
+                (
+                    plainNode.children,
+                    [&](const PremiseTreePtr & plainChild) { return sameTree(*memoChild, *plainChild); }
+                );
+                if (!matched) return false;
+            }
+            return true;
+        };
+        if (!sameTree(*memoTree, *plainTree))
+        {
+            std::cout << "Error: replayed header summaries changed the premise tree\n";
+            std::cout << "With summaries:\n" << memoTree->toString() << "\nWithout:\n" << plainTree->toString() << std::endl;
+            allPass = false;
+        }
+
+        bool sameStates = memoWarp.states.size() == plainWarp.states.size();
+        for (const State & memoState : memoWarp.states)
+        {
+            sameStates = sameStates && std::ranges::any_of
+            (
+                plainWarp.states,
+                [&](const State & plainState)
+                {
+                    return memoState.symbolTable->sameBindings(*plainState.symbolTable)
+                        && equivalent(memoState.premise, plainState.premise);
+                }
+            );
+        }
+        if (!sameStates)
+        {
+            std::cout << std::format
+            (
+                "Error: replayed header summaries changed the end states ({} with summaries, {} without)\n",
+                memoWarp.states.size(),
+                plainWarp.states.size()
+            );
+            allPass = false;
+        }
+    }
+
     if (!allPass) return 1;
 
     std::cout << "All checks passed.\n";
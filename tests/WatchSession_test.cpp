@@ -0,0 +1,158 @@
+#include <iostream>
+#include <fstream>
+#include <optional>
+#include <string>
+
+#include <spdlog/spdlog.h>
+
+#include "TempDir.hpp"
+#include "ASTBank.hpp"
+#include "WatchSession.hpp"
+
+int main()
+{
+    using namespace Hayroll;
+
+    spdlog::set_level(spdlog::level::debug);
+
+    TempDir tmpDir;
+    const std::filesystem::path srcPath = tmpDir.getPath() / "main.c";
+
+    auto saveSource = [&srcPath](const std::string & source)
+    {
+        std::ofstream srcFile(srcPath);
+        srcFile << source;
+        srcFile.close();
+    };
+
+    const std::string original =
+        "#include \"config.h\"\n"
+        "#if BUFSZ > 100\n"
+        "    int big;\n"
+        "#else\n"
+        "    int small;\n"
+        "#endif\n"
+        "/* Limits */\n"
+        "#define LIMIT 4\n"
+        "#define TWICE(x) ((x) * 2)\n"
+        "int tail;\n";
+
+    // Whether editing the original into the given source is a code-only edit
+    auto editsCodeOnly = [&](const std::string & edited) -> std::optional<bool>
+    {
+        SharedASTStore store;
+        saveSource(original);
+        const SharedASTStore::ParsedFilePtr held = store.addFileOrFind(std::filesystem::canonical(srcPath));
+        saveSource(edited);
+        const std::optional<SharedASTStore::Reparse> reparse = store.update(std::filesystem::canonical(srcPath));
+        if (!reparse) return std::nullopt;
+        return WatchSession::editsCodeOnly(*reparse);
+    };
+
+    // (edited source, whether only code changed)
+    const std::vector<std::pair<std::string, bool>> cases =
+    {
+        // Code inside a conditional grows, shifting every directive after it
+        {
+            "#include \"config.h\"\n"
+            "#if BUFSZ > 100\n"
+            "    int big; int bigger;\n"
+            "#else\n"
+            "    int small;\n"
+            "#endif\n"
+            "/* Limits */\n"
+            "#define LIMIT 4\n"
+            "#define TWICE(x) ((x) * 2)\n"
+            "int tail;\n",
+            true
+        },
+        // Comments do not count
+        {
+            "#include \"config.h\"\n"
+            "#if BUFSZ > 100\n"
+            "    int big;\n"
+            "#else\n"
+            "    int small;\n"
+            "#endif\n"
+            "/* Limits, again */\n"
+            "#define LIMIT 4\n"
+            "#define TWICE(x) ((x) * 2)\n"
+            "int tail;\n",
+            true
+        },
+        // A macro body changes
+        {
+            "#include \"config.h\"\n"
+            "#if BUFSZ > 100\n"
+            "    int big;\n"
+            "#else\n"
+            "    int small;\n"
+            "#endif\n"
+            "/* Limits */\n"
+            "#define LIMIT 5\n"
+            "#define TWICE(x) ((x) * 2)\n"
+            "int tail;\n",
+            false
+        },
+        // A condition changes
+        {
+            "#include \"config.h\"\n"
+            "#if BUFSZ > 200\n"
+            "    int big;\n"
+            "#else\n"
+            "    int small;\n"
+            "#endif\n"
+            "/* Limits */\n"
+            "#define LIMIT 4\n"
+            "#define TWICE(x) ((x) * 2)\n"
+            "int tail;\n",
+            false
+        },
+        // A directive appears among the code
+        {
+            "#include \"config.h\"\n"
+            "#if BUFSZ > 100\n"
+            "    int big;\n"
+            "#else\n"
+            "    int small;\n"
+            "#define EXTRA\n"
+            "#endif\n"
+            "/* Limits */\n"
+            "#define LIMIT 4\n"
+            "#define TWICE(x) ((x) * 2)\n"
+            "int tail;\n",
+            false
+        },
+        // Same tokens, but the function-like macro becomes object-like
+        {
+            "#include \"config.h\"\n"
+            "#if BUFSZ > 100\n"
+            "    int big;\n"
+            "#else\n"
+            "    int small;\n"
+            "#endif\n"
+            "/* Limits */\n"
+            "#define LIMIT 4\n"
+            "#define TWICE (x) ((x) * 2)\n"
+            "int tail;\n",
+            false
+        },
+    };
+
+    for (const auto & [edited, expected] : cases)
+    {
+        const std::optional<bool> codeOnly = editsCodeOnly(edited);
+        if (!codeOnly)
+        {
+            std::cerr << "Edited file was not reparsed:\n" << edited << std::endl;
+            return 1;
+        }
+        if (*codeOnly != expected)
+        {
+            std::cerr << "Expected a " << (expected ? "code-only" : "directive") << " edit:\n" << edited << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}